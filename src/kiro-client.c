@@ -20,6 +20,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
 #include <rdma/rdma_verbs.h>
 #include <glib.h>
 #include <uv.h>
@@ -36,6 +38,38 @@
 
 #define KIRO_CLIENT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), KIRO_TYPE_CLIENT, KiroClientPrivate))
 
+// Maximum number of RDMA_READs that are posted as one chain. Only the last
+// one is signaled, so the send queue must be able to hold a whole chain.
+#define KIRO_CLIENT_MAX_CHAIN 16
+
+// Number of chains that may be in flight at the same time. The send queue is
+// sized to hold all of them.
+#define KIRO_CLIENT_CHAINS_IN_FLIGHT 4
+
+// Number of receives that are posted in addition to the generic one while
+// subscribed. Every push consumes a receive, so this is how many pushes may
+// arrive before the event loop has handled the first one.
+#define KIRO_CLIENT_PUSH_RECEIVES 8
+
+// Number of times kiro_client_sync_consistent reads the memory before it
+// gives up on getting a consistent snapshot
+#define KIRO_CLIENT_MAX_SNAPSHOT_TRIES 64
+
+// Granularity in which a lazy mirror is populated, registered and evicted
+#define KIRO_CLIENT_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Minimum size in bytes of a stripe. Syncs that are smaller than two stripes
+// are not spread across the rails.
+#define KIRO_CLIENT_MIN_STRIPE (1024 * 1024)
+
+// Maximum number of bytes that are read into a new mirror in one go after a
+// realloc. Syncs get their turn in between two slices.
+#define KIRO_CLIENT_HANDOFF_SLICE (64 * 1024 * 1024)
+
+// Number of times a new mirror is filled again, because the server reported
+// an update while it was filled
+#define KIRO_CLIENT_MAX_HANDOFF_TRIES 4
+
 struct _KiroClientPrivate {
 
     /* Properties */
@@ -52,7 +86,130 @@ struct _KiroClientPrivate {
     uv_loop_t *uv_event_loop;
     uv_poll_t *uv_recv_cq_fd_poll;
     uv_poll_t *uv_ec_fd_poll;
-    uv_idle_t *uv_idle_handle;
+    uv_async_t *uv_close_async;               // Wakes the event loop up for connection tear-down
+
+    GMutex                      update_lock;      // Protects the update notification state
+    GCond                       update_cond;      // Signalled when the server reports an update
+    uint64_t                    update_sequence;  // Latest sequence number reported by the server
+    gboolean                    update_requested; // A KIRO_REQ_UPDATE is outstanding at the server
+    uint64_t                    update_offset;    // Changed range reported with the latest update
+    uint64_t                    update_size;
+
+    GRecMutex                   hook_lock;        // Protects update_callbacks
+    GHookList                   update_callbacks; // List of registered update-callbacks
+
+    struct kiro_rdma_mem        *retired_mr;      // Local memory that was replaced by the last realloc
+    GThread                     *handoff_thread;  // Switches to the new memory of a realloc
+    struct ibv_mr               handoff_peer_mr;  // New server memory of the realloc
+
+    gboolean                    lazy_enabled;     // Create lazy mirrors (see kiro_client_set_lazy_mirror)
+    gulong                      lazy_limit;       // Maximum resident size of a lazy mirror. 0 for no limit
+    struct kiro_lazy_mirror     *lazy;            // Backs ctx->rdma_mr in lazy mode (protected by sync_lock)
+    struct kiro_lazy_mirror     *retired_lazy;    // Backs retired_mr in lazy mode
+
+    struct ibv_mr               dir_peer_mr;      // Region directory of the server (zero length if there is none)
+    struct kiro_rdma_mem        *directory;       // Local copy of the region directory
+    GList                       *regions;         // Known regions of the server (struct kiro_client_region)
+    gint                        regions_stale;    // The directory needs to be read again (atomic)
+
+    gboolean                    subscribed;       // The server pushes updates into our memory
+    struct ibv_mr               *push_mr;         // Registration of our memory that the server writes to
+    struct kiro_rdma_mem        *push_recv;       // Buffers of the receives that are posted for pushes
+    uint64_t                    push_sequence;    // Sequence number of the last push (protected by update_lock)
+
+    GMutex                      delta_lock;       // Serializes delta syncs, which consist of several reads
+    GMutex                      version_lock;     // Protects the local copy of the version table (shared with the read cache)
+    uint64_t                    *seen_versions;   // Block versions of the last delta sync (protected by delta_lock)
+    uint64_t                    seen_blocks;      // Number of entries in seen_versions
+    gint                        seen_region;      // Region ID of the version table seen_versions was read from
+
+    GMutex                      snapshot_lock;    // Serializes consistent syncs, which share the local copy of the counter
+
+    /* Mirror buffers in rotation (protected by buffer_lock) */
+    GMutex                      buffer_lock;
+    struct kiro_client_buffer   *buffers;         // Allocated on the first kiro_client_sync_snapshot
+    guint                       num_buffers;      // Number of buffers as given to kiro_client_set_buffers
+    gint                        latest_buffer;    // Index of the newest complete snapshot. -1 if there is none
+    uint64_t                    buffer_count;     // Number of snapshots taken so far
+
+    /* Read cache (protected by cache_lock) */
+    GMutex                      cache_lock;
+    guint                       cache_pages;      // Capacity of the cache in pages. 0 if there is no cache
+    gulong                      cache_page_size;  // Size in bytes of a page
+    struct kiro_rdma_mem        *cache_mem;       // Storage of all pages. Allocated on first use
+    struct kiro_cache_slot      *cache_slots;
+    GHashTable                  *cache_map;       // Page number -> struct kiro_cache_slot
+    GQueue                      cache_lru;        // Used slots, most recently used first
+    guint                       cache_used;       // Number of slots that have been used so far
+    gint                        cache_region;     // Region ID of the version table the cached versions belong to
+    guint64                     cache_hits;
+    guint64                     cache_misses;
+
+    /* Additional connections to the server (protected by sync_lock) */
+    GList                       *rails;           // struct kiro_client_rail
+    uint64_t                    rail_group;       // Identifies our connections at the server
+    gboolean                    rails_stale;      // The memory has changed. Rails need to be dialed again.
+    gboolean                    rails_dialing;    // A thread is dialing the rails again
+};
+
+
+/*
+ * A rail is an additional connection to the server that only carries
+ * RDMA_READs. It has its own registration of the server memory and of our
+ * mirror, since it may use a different device.
+ */
+struct kiro_client_rail {
+
+    gchar                       *local_address;   // Local address to connect from. NULL for any
+    gchar                       *address;
+    gchar                       *port;
+    guint                       number;           // Number of the rail in our group (starting at 1)
+    struct rdma_cm_id           *conn;            // NULL while the rail is down
+    struct ibv_mr               peer_mr;          // Server memory as registered for this rail
+    struct ibv_mr               *mr;              // Registration of the mirror with the rail's protection domain
+};
+
+
+struct kiro_cache_slot {
+
+    uint64_t                    page;             // Number of the cached page
+    uint64_t                    version;          // Version of the block the page was read in
+    GList                       link;             // Link in cache_lru
+};
+
+
+/*
+ * A lazy mirror only reserves address space for the server memory. Chunks
+ * are registered (and thereby populated) when they are first read into, and
+ * may be evicted again later. Everything that was never read reads as zero.
+ */
+struct kiro_lazy_mirror {
+
+    void                        *mem;             // Reserved address space
+    size_t                      size;             // Size in bytes of the mirror
+    guint                       num_chunks;
+    struct ibv_mr               **chunks;         // Registration of every chunk. NULL while it is not resident
+    uint64_t                    *last_use;        // Tick of the last read into every chunk
+    uint64_t                    tick;
+    gulong                      resident;         // Size in bytes of all registered chunks
+};
+
+
+struct kiro_client_buffer {
+
+    struct kiro_rdma_mem        *mem;             // Local memory. Allocated on first use
+    guint                       refs;             // Number of times the snapshot is acquired
+    gboolean                    filling;          // A sync into this buffer is in progress
+    uint64_t                    number;           // Number of the snapshot it holds. 0 if it holds none
+};
+
+
+struct kiro_client_region {
+
+    guint                       id;               // ID of the region at the server
+    gchar                       name[KIRO_REGION_NAME_LENGTH];
+    struct ibv_mr               peer_mr;          // Only addr, length and rkey are valid
+    struct kiro_rdma_mem        *local;           // Local memory of the region. Allocated on first use
 };
 
 
@@ -64,11 +221,20 @@ volatile struct timeval ping_time;
 
 G_LOCK_DEFINE (sync_lock);
 
+
+/*
+ * Sends the given message over the connection. The message is copied into
+ * the registered send memory of the connection only while sync_lock is held,
+ * so a message that is still being sent can't be overwritten by another
+ * thread.
+ */
 static inline gboolean
-send_msg (struct rdma_cm_id *id, struct kiro_rdma_mem *r)
+send_msg (struct rdma_cm_id *id, struct kiro_ctrl_msg *msg)
 {
     gboolean retval = TRUE;
+    struct kiro_rdma_mem *r = ((struct kiro_connection_context *)id->context)->cf_mr_send;
     G_LOCK (sync_lock);
+    memcpy (r->mem, msg, sizeof (struct kiro_ctrl_msg));
     if (rdma_post_send (id, id, r->mem, r->size, r->mr, IBV_SEND_SIGNALED)) {
         retval = FALSE;
     }
@@ -117,7 +283,21 @@ kiro_client_init (KiroClient *self)
 
     priv->uv_recv_cq_fd_poll = (uv_poll_t *) malloc (sizeof(uv_poll_t));
     priv->uv_ec_fd_poll = (uv_poll_t *) malloc (sizeof(uv_poll_t));
-    priv->uv_idle_handle = (uv_idle_t *) malloc (sizeof(uv_idle_t));
+    priv->uv_close_async = (uv_async_t *) malloc (sizeof(uv_async_t));
+
+    g_mutex_init (&priv->update_lock);
+    g_cond_init (&priv->update_cond);
+    g_rec_mutex_init (&priv->hook_lock);
+    g_mutex_init (&priv->delta_lock);
+    g_mutex_init (&priv->snapshot_lock);
+    g_mutex_init (&priv->buffer_lock);
+    g_mutex_init (&priv->version_lock);
+    g_mutex_init (&priv->cache_lock);
+    g_hook_list_init (&(priv->update_callbacks), sizeof (GHook));
+    priv->seen_region = -1;
+    priv->latest_buffer = -1;
+    priv->cache_region = -1;
+    g_queue_init (&priv->cache_lru);
 
     priv->uv_event_loop = uv_default_loop();
     priv->uv_event_loop->data = (void *)priv; // Not required currently. For future purposes maybe 
@@ -128,8 +308,21 @@ static void
 kiro_client_finalize (GObject *object)
 {
     g_return_if_fail (object != NULL);
-    if (KIRO_IS_CLIENT (object))
+    if (KIRO_IS_CLIENT (object)) {
         kiro_client_disconnect ((KiroClient *)object);
+        KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (object);
+        g_mutex_clear (&priv->update_lock);
+        g_cond_clear (&priv->update_cond);
+        g_rec_mutex_lock (&priv->hook_lock);
+        g_hook_list_clear (&(priv->update_callbacks));
+        g_rec_mutex_unlock (&priv->hook_lock);
+        g_rec_mutex_clear (&priv->hook_lock);
+        g_mutex_clear (&priv->delta_lock);
+        g_mutex_clear (&priv->snapshot_lock);
+        g_mutex_clear (&priv->buffer_lock);
+        g_mutex_clear (&priv->version_lock);
+        g_mutex_clear (&priv->cache_lock);
+    }
     G_OBJECT_CLASS (kiro_client_parent_class)->finalize (object);
 }
 
@@ -173,369 +366,2336 @@ client_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
 }
 
 
-static gboolean
-process_rdma_event (GIOChannel *source, GIOCondition condition, gpointer data)
-{
-    // Right now, we don't need 'source' and 'condition'
-    // Tell the compiler to ignore them by (void)-ing them
-    (void) source;
-    //(void) condition;
-    g_debug ("Message condidition: %i", condition);
+static int wait_read_completion (KiroClientPrivate *priv);
 
-    KiroClientPrivate *priv = (KiroClientPrivate *)data;
-    struct ibv_wc wc;
 
-    if (ibv_poll_cq (priv->conn->recv_cq, 1, &wc) < 0) {
-        g_critical ("Failure getting receive completion event from the queue: %s", strerror (errno));
-        return FALSE;
+static struct kiro_lazy_mirror *
+lazy_mirror_new (size_t size)
+{
+    void *mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        g_warning ("Failed to reserve %zu bytes for the lazy mirror: %s", size, strerror (errno));
+        return NULL;
     }
-    void *cq_ctx;
-    struct ibv_cq *cq;
-    int err = ibv_get_cq_event (priv->conn->recv_cq_channel, &cq, &cq_ctx);
-    if (!err)
-        ibv_ack_cq_events (cq, 1);
 
-    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
-    guint type = ((struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem)->msg_type;
-    g_debug ("Received a message from the Server of type: %u", type);
+    struct kiro_lazy_mirror *lazy = g_new0 (struct kiro_lazy_mirror, 1);
+    lazy->mem = mem;
+    lazy->size = size;
+    lazy->num_chunks = (size + KIRO_CLIENT_CHUNK_SIZE - 1) / KIRO_CLIENT_CHUNK_SIZE;
+    lazy->chunks = g_new0 (struct ibv_mr *, lazy->num_chunks);
+    lazy->last_use = g_new0 (uint64_t, lazy->num_chunks);
+    return lazy;
+}
 
-    if (type == KIRO_ACK_RDMA) {
-        g_debug ("Got RDMI Access information from Server");
-        if (ctx->rdma_mr) {
-            g_debug ("But memory is already allocated. Ignoring");
-        }
-        else {
-            ctx->peer_mr = (((struct kiro_ctrl_msg *) (ctx->cf_mr_recv->mem))->peer_mri);
-            g_debug ("Expected Memory Size is: %zu", ctx->peer_mr.length);
-            ctx->rdma_mr = kiro_create_rdma_memory (priv->conn->pd, ctx->peer_mr.length, IBV_ACCESS_LOCAL_WRITE);
 
-            if (!ctx->rdma_mr) {
-                //FIXME: Connection teardown in an event handler routine? Not a good
-                //idea...
-                g_critical ("Failed to allocate memory for receive buffer (Out of memory?)");
-                rdma_disconnect (priv->conn);
-                kiro_destroy_connection_context (&ctx);
-                rdma_destroy_ep (priv->conn);
-                return TRUE;
-            }
-        }
-    }
-    if (type == KIRO_PONG) {
-        G_LOCK (ping_time);
-        struct timeval local_time;
-        gettimeofday (&local_time, NULL);
+static void
+lazy_mirror_evict_chunk (struct kiro_lazy_mirror *lazy, guint chunk)
+{
+    if (!lazy->chunks[chunk])
+        return;
 
-        if (ping_time.tv_sec == 0 && ping_time.tv_usec == 0) {
-            g_debug ("Received PONG message from server");
-            ping_time.tv_sec = local_time.tv_sec;
-            ping_time.tv_usec = local_time.tv_usec;
-        }
-        else {
-            g_debug ("Received unexpected PONG message from server");
-        }
+    lazy->resident -= lazy->chunks[chunk]->length;
+    ibv_dereg_mr (lazy->chunks[chunk]);
+    lazy->chunks[chunk] = NULL;
 
-        G_UNLOCK (ping_time);
-    }
-    if (type == KIRO_REALLOC) {
-        g_debug ("Got reallocation request from server.");
-        struct kiro_ctrl_msg *msg = ((struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem);
+    // Give the pages back. They read as zero from now on.
+    gulong offset = (gulong)chunk * KIRO_CLIENT_CHUNK_SIZE;
+    madvise (lazy->mem + offset, MIN (KIRO_CLIENT_CHUNK_SIZE, lazy->size - offset), MADV_DONTNEED);
+}
 
-        G_LOCK (sync_lock);
-        g_debug ("Rallocating memory...");
-        kiro_destroy_rdma_memory (ctx->rdma_mr);
-        ctx->peer_mr = msg->peer_mri;
-        g_debug ("New size is: %zu", ctx->peer_mr.length);
-        ctx->rdma_mr = kiro_create_rdma_memory (priv->conn->pd, ctx->peer_mr.length, IBV_ACCESS_LOCAL_WRITE);
-        G_UNLOCK (sync_lock);
 
-        if (!ctx->rdma_mr) {
-            //FIXME: Connection teardown in an event handler routine? Not a good
-            //idea...
-            g_critical ("Failed to allocate memory for receive buffer (Out of memory?)");
-            rdma_disconnect (priv->conn);
-            kiro_destroy_connection_context (&ctx);
-            rdma_destroy_ep (priv->conn);
-        }
+static void
+lazy_mirror_free (struct kiro_lazy_mirror *lazy)
+{
+    if (!lazy)
+        return;
 
-        msg = ((struct kiro_ctrl_msg *)ctx->cf_mr_send->mem);
-        msg->msg_type = KIRO_ACK_RDMA;
-        if (!send_msg (priv->conn, ctx->cf_mr_send)) {
-            g_warning ("Failure while trying to post SEND for reallocation ACK: %s", strerror (errno));
-        }
-        else {
-            g_debug ("Sent ACK to server");
-        }
+    for (guint i = 0; i < lazy->num_chunks; i++) {
+        if (lazy->chunks[i])
+            ibv_dereg_mr (lazy->chunks[i]);
     }
+    munmap (lazy->mem, lazy->size);
+    g_free (lazy->chunks);
+    g_free (lazy->last_use);
+    g_free (lazy);
+}
 
-    //Post a generic receive in order to stay responsive to any messages from
-    //the server
-    if (rdma_post_recv (priv->conn, priv->conn, ctx->cf_mr_recv->mem, ctx->cf_mr_recv->size, ctx->cf_mr_recv->mr)) {
-        //FIXME: Connection teardown in an event handler routine? Not a good
-        //idea...
-        g_critical ("Posting generic receive for connection failed: %s", strerror (errno));
-        kiro_destroy_connection_context (&ctx);
-        rdma_destroy_ep (priv->conn);
-        return FALSE;
-    }
 
-    // make sure the next incoming work completion causes an event on the
-    // receive completion channel. We will poll() the channels file descriptor
-    // for this in the kiro client main loop.
-    ibv_req_notify_cq (priv->conn->recv_cq, 0);
+/*
+ * Creates the local mirror of the server memory. In lazy mode, the returned
+ * kiro_rdma_mem has no registration of its own and the lazy mirror that backs
+ * it is returned in *lazy.
+ */
+static struct kiro_rdma_mem *
+create_mirror (KiroClientPrivate *priv, size_t size, struct kiro_lazy_mirror **lazy)
+{
+    *lazy = NULL;
+    if (!priv->lazy_enabled)
+        return kiro_create_rdma_memory (priv->conn->pd, size, IBV_ACCESS_LOCAL_WRITE);
 
-    g_debug ("Finished RDMA event handling");
-    return TRUE;
-}
+    *lazy = lazy_mirror_new (size);
+    if (!*lazy)
+        return NULL;
 
-/** acc to definition of uv_poll_cb **/
-void
-client_process_rdma_event (uv_poll_t *handle, int status __attribute__ ((unused)), int events __attribute__ ((unused)))
-{
-    KiroClientPrivate *priv = (KiroClientPrivate *)handle->data;
+    struct kiro_rdma_mem *mirror = (struct kiro_rdma_mem *)calloc (1, sizeof (struct kiro_rdma_mem));
+    mirror->mem = (*lazy)->mem;
+    mirror->size = size;
+    return mirror;
+}
 
-    struct ibv_wc wc;
 
-    if (ibv_poll_cq (priv->conn->recv_cq, 1, &wc) < 0) {
-        g_critical ("Failure getting receive completion event from the queue: %s", strerror (errno));
-        return;
+static void
+drop_retired_mirror (KiroClientPrivate *priv)
+{
+    if (priv->retired_lazy) {
+        // The memory belongs to the lazy mirror
+        free (priv->retired_mr);
+        lazy_mirror_free (priv->retired_lazy);
     }
-    void *cq_ctx;
-    struct ibv_cq *cq;
-    int err = ibv_get_cq_event (priv->conn->recv_cq_channel, &cq, &cq_ctx);
-    if (!err)
-        ibv_ack_cq_events (cq, 1);
+    else {
+        kiro_destroy_rdma_memory (priv->retired_mr);
+    }
+    priv->retired_mr = NULL;
+    priv->retired_lazy = NULL;
+}
 
-    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
-    guint type = ((struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem)->msg_type;
-    g_debug ("Received a message from the Server of type: %u", type);
 
-    if (type == KIRO_ACK_RDMA) {
-        g_debug ("Got RDMI Access information from Server");
-        if (ctx->rdma_mr) {
-            g_debug ("But memory is already allocated. Ignoring");
+/*
+ * Reads the given ranges of the remote memory into a lazy mirror. The ranges
+ * are split at chunk boundaries, since every chunk has its own registration.
+ * Chunks that are not resident yet are registered first. Afterwards, the
+ * least recently used chunks are evicted until the mirror fits into the
+ * limit again. Must be called with sync_lock held.
+ */
+static int
+lazy_mirror_read (KiroClientPrivate *priv, struct kiro_lazy_mirror *lazy, struct ibv_mr *peer_mr,
+                  struct KiroSyncRange *ranges, guint count)
+{
+    struct ibv_sge sge[KIRO_CLIENT_MAX_CHAIN];
+    struct ibv_send_wr wr[KIRO_CLIENT_MAX_CHAIN], *bad;
+    uint64_t first_tick = lazy->tick + 1;
+    guint n = 0;
+
+    for (guint r = 0; r < count; r++) {
+        gulong done = 0;
+        while (done < ranges[r].size) {
+            gulong local = ranges[r].local_offset + done;
+            guint chunk = local / KIRO_CLIENT_CHUNK_SIZE;
+            gulong chunk_start = (gulong)chunk * KIRO_CLIENT_CHUNK_SIZE;
+            gulong chunk_size = MIN (KIRO_CLIENT_CHUNK_SIZE, lazy->size - chunk_start);
+            gulong piece = MIN (ranges[r].size - done, chunk_start + chunk_size - local);
+
+            if (!lazy->chunks[chunk]) {
+                lazy->chunks[chunk] = ibv_reg_mr (priv->conn->pd, lazy->mem + chunk_start, chunk_size,
+                                                  IBV_ACCESS_LOCAL_WRITE);
+                if (!lazy->chunks[chunk]) {
+                    g_warning ("Failed to register chunk %u of the lazy mirror: %s", chunk, strerror (errno));
+                    return -1;
+                }
+                lazy->resident += chunk_size;
+            }
+            lazy->last_use[chunk] = ++lazy->tick;
+
+            // A piece never exceeds one chunk, so its length always fits
+            sge[n].addr = (uint64_t) (uintptr_t) (lazy->mem + local);
+            sge[n].length = (uint32_t) piece;
+            sge[n].lkey = lazy->chunks[chunk]->lkey;
+
+            memset (&wr[n], 0, sizeof (struct ibv_send_wr));
+            wr[n].wr_id = (uintptr_t) priv->conn;
+            wr[n].sg_list = &sge[n];
+            wr[n].num_sge = 1;
+            wr[n].opcode = IBV_WR_RDMA_READ;
+            wr[n].wr.rdma.remote_addr = (uint64_t)peer_mr->addr + ranges[r].remote_offset + done;
+            wr[n].wr.rdma.rkey = peer_mr->rkey;
+            n++;
+            done += piece;
+
+            gboolean last = (r + 1 == count && done == ranges[r].size);
+            if (n == KIRO_CLIENT_MAX_CHAIN || last) {
+                for (guint i = 0; i + 1 < n; i++)
+                    wr[i].next = &wr[i + 1];
+                wr[n - 1].send_flags = IBV_SEND_SIGNALED;
+
+                if (ibv_post_send (priv->conn->qp, wr, &bad)) {
+                    g_critical ("Failed to post RDMA_READ chain to server: %s", strerror (errno));
+                    return -1;
+                }
+                if (wait_read_completion (priv))
+                    return -1;
+                n = 0;
+            }
         }
-        else {
-            ctx->peer_mr = (((struct kiro_ctrl_msg *) (ctx->cf_mr_recv->mem))->peer_mri);
-            g_debug ("Expected Memory Size is: %zu", ctx->peer_mr.length);
-            ctx->rdma_mr = kiro_create_rdma_memory (priv->conn->pd, ctx->peer_mr.length, IBV_ACCESS_LOCAL_WRITE);
+    }
 
-            if (!ctx->rdma_mr) {
-                //FIXME: Connection teardown in an event handler routine? Not a good
-                //idea...
-                g_critical ("Failed to allocate memory for receive buffer (Out of memory?)");
-                rdma_disconnect (priv->conn);
-                kiro_destroy_connection_context (&ctx);
-                rdma_destroy_ep (priv->conn);
-                return;
-            }
+    // Chunks that were just read stay, even if they exceed the limit on
+    // their own
+    while (priv->lazy_limit && lazy->resident > priv->lazy_limit) {
+        gint oldest = -1;
+        for (guint i = 0; i < lazy->num_chunks; i++) {
+            if (lazy->chunks[i] && lazy->last_use[i] < first_tick
+                && (oldest < 0 || lazy->last_use[i] < lazy->last_use[oldest]))
+                oldest = i;
         }
+        if (oldest < 0)
+            break;
+        lazy_mirror_evict_chunk (lazy, oldest);
     }
-    if (type == KIRO_PONG) {
-        G_LOCK (ping_time);
-        struct timeval local_time;
-        gettimeofday (&local_time, NULL);
 
-        if (ping_time.tv_sec == 0 && ping_time.tv_usec == 0) {
-            g_debug ("Received PONG message from server");
-            ping_time.tv_sec = local_time.tv_sec;
-            ping_time.tv_usec = local_time.tv_usec;
+    return 0;
+}
+
+/*
+ * Reads the given ranges into registered local memory. The ranges are posted
+ * as chains of RDMA_READs, and several chains are kept in flight, so a large
+ * batch costs little more than a single round trip. Ranges larger than
+ * KIRO_RDMA_MAX_TRANSFER are split into several READs. Must be called with
+ * sync_lock held.
+ */
+static int
+read_chains (KiroClientPrivate *priv, struct ibv_mr *peer_mr, struct kiro_rdma_mem *local,
+             struct KiroSyncRange *ranges, guint count)
+{
+    struct ibv_sge sge[KIRO_CLIENT_CHAINS_IN_FLIGHT][KIRO_CLIENT_MAX_CHAIN];
+    struct ibv_send_wr wr[KIRO_CLIENT_CHAINS_IN_FLIGHT][KIRO_CLIENT_MAX_CHAIN], *bad;
+    guint in_flight = 0;
+    guint chain = 0;
+    guint n = 0;
+    guint r = 0;
+    gulong done = 0;
+
+    while (r < count) {
+        // The chain that used these work requests before must be done
+        if (n == 0 && in_flight == KIRO_CLIENT_CHAINS_IN_FLIGHT) {
+            if (wait_read_completion (priv))
+                return -1;
+            in_flight--;
         }
-        else {
-            g_debug ("Received unexpected PONG message from server");
+
+        struct KiroSyncRange *range = &ranges[r];
+        gulong piece = MIN (range->size - done, KIRO_RDMA_MAX_TRANSFER);
+
+        sge[chain][n].addr = (uint64_t) (uintptr_t) (local->mem + range->local_offset + done);
+        sge[chain][n].length = (uint32_t) piece;
+        sge[chain][n].lkey = local->mr->lkey;
+
+        memset (&wr[chain][n], 0, sizeof (struct ibv_send_wr));
+        wr[chain][n].wr_id = (uintptr_t) priv->conn;
+        wr[chain][n].sg_list = &sge[chain][n];
+        wr[chain][n].num_sge = 1;
+        wr[chain][n].opcode = IBV_WR_RDMA_READ;
+        wr[chain][n].wr.rdma.remote_addr = (uint64_t)peer_mr->addr + range->remote_offset + done;
+        wr[chain][n].wr.rdma.rkey = peer_mr->rkey;
+        n++;
+
+        done += piece;
+        if (done == range->size) {
+            r++;
+            done = 0;
         }
 
-        G_UNLOCK (ping_time);
-    }
-    if (type == KIRO_REALLOC) {
-        g_debug ("Got reallocation request from server.");
-        struct kiro_ctrl_msg *msg = ((struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem);
+        if (n < KIRO_CLIENT_MAX_CHAIN && r < count)
+            continue;
 
-        G_LOCK (sync_lock);
-        g_debug ("Rallocating memory...");
-        kiro_destroy_rdma_memory (ctx->rdma_mr);
-        ctx->peer_mr = msg->peer_mri;
-        g_debug ("New size is: %zu", ctx->peer_mr.length);
-        ctx->rdma_mr = kiro_create_rdma_memory (priv->conn->pd, ctx->peer_mr.length, IBV_ACCESS_LOCAL_WRITE);
-        G_UNLOCK (sync_lock);
+        for (guint i = 0; i + 1 < n; i++)
+            wr[chain][i].next = &wr[chain][i + 1];
+        wr[chain][n - 1].send_flags = IBV_SEND_SIGNALED;
 
-        if (!ctx->rdma_mr) {
-            //FIXME: Connection teardown in an event handler routine? Not a good
-            //idea...
-            g_critical ("Failed to allocate memory for receive buffer (Out of memory?)");
-            rdma_disconnect (priv->conn);
-            kiro_destroy_connection_context (&ctx);
-            rdma_destroy_ep (priv->conn);
+        if (ibv_post_send (priv->conn->qp, wr[chain], &bad)) {
+            g_critical ("Failed to post RDMA_READ chain to server: %s", strerror (errno));
+            return -1;
         }
+        in_flight++;
+        chain = (chain + 1) % KIRO_CLIENT_CHAINS_IN_FLIGHT;
+        n = 0;
+    }
+
+    // The READs of a chain are executed in order, and so are the chains. The
+    // completion of a chain means all chains before it are done, too.
+    while (in_flight--) {
+        if (wait_read_completion (priv))
+            return -1;
+    }
+
+    return 0;
+}
 
-        msg = ((struct kiro_ctrl_msg *)ctx->cf_mr_send->mem);
-        msg->msg_type = KIRO_ACK_RDMA;
-        if (!send_msg (priv->conn, ctx->cf_mr_send)) {
-            g_warning ("Failure while trying to post SEND for reallocation ACK: %s", strerror (errno));
+
+/*
+ * Reads count fields of field_size bytes that are stride bytes apart in the
+ * remote memory straight into the memory of dst_mr, one after the other. As
+ * many READs as the send queue holds are posted as one list, and only the
+ * last of them asks for a completion. Must be called with sync_lock held.
+ */
+static int
+read_fields (KiroClientPrivate *priv, struct ibv_mr *peer_mr, gulong remote_base, gulong stride,
+             gulong field_size, gulong count, struct ibv_mr *dst_mr)
+{
+    struct ibv_sge sge[KIRO_CLIENT_CHAINS_IN_FLIGHT * KIRO_CLIENT_MAX_CHAIN];
+    struct ibv_send_wr wr[KIRO_CLIENT_CHAINS_IN_FLIGHT * KIRO_CLIENT_MAX_CHAIN], *bad;
+    gulong i = 0;
+
+    while (i < count) {
+        guint n = 0;
+        for (; n < G_N_ELEMENTS (wr) && i < count; n++, i++) {
+            sge[n].addr = (uint64_t) (uintptr_t) ((char *)dst_mr->addr + i * field_size);
+            sge[n].length = (uint32_t) field_size;
+            sge[n].lkey = dst_mr->lkey;
+
+            memset (&wr[n], 0, sizeof (struct ibv_send_wr));
+            wr[n].wr_id = (uintptr_t) priv->conn;
+            wr[n].sg_list = &sge[n];
+            wr[n].num_sge = 1;
+            wr[n].opcode = IBV_WR_RDMA_READ;
+            wr[n].wr.rdma.remote_addr = (uint64_t)peer_mr->addr + remote_base + i * stride;
+            wr[n].wr.rdma.rkey = peer_mr->rkey;
+            if (n > 0)
+                wr[n - 1].next = &wr[n];
         }
-        else {
-            g_debug ("Sent ACK to server");
+        wr[n - 1].send_flags = IBV_SEND_SIGNALED;
+
+        if (ibv_post_send (priv->conn->qp, wr, &bad)) {
+            g_critical ("Failed to post RDMA_READs to server: %s", strerror (errno));
+            return -1;
         }
-    }
 
-    //Post a generic receive in order to stay responsive to any messages from
-    //the server
-    if (rdma_post_recv (priv->conn, priv->conn, ctx->cf_mr_recv->mem, ctx->cf_mr_recv->size, ctx->cf_mr_recv->mr)) {
-        //FIXME: Connection teardown in an event handler routine? Not a good
-        //idea...
-        g_critical ("Posting generic receive for connection failed: %s", strerror (errno));
-        kiro_destroy_connection_context (&ctx);
-        rdma_destroy_ep (priv->conn);
-        return;
+        // The READs are executed in order, so the last one completes last
+        if (wait_read_completion (priv))
+            return -1;
     }
 
-    // make sure the next incoming work completion causes an event on the
-    // receive completion channel. We will poll() the channels file descriptor
-    // for this in the kiro client main loop.
-    ibv_req_notify_cq (priv->conn->recv_cq, 0);
+    return 0;
+}
 
-    g_debug ("Finished RDMA event handling");
-    return;
+
+static void
+rail_down (struct kiro_client_rail *rail)
+{
+    if (rail->mr)
+        ibv_dereg_mr (rail->mr);
+    rail->mr = NULL;
+    kiro_destroy_connection (&(rail->conn));
 }
 
 
-gpointer
-start_client_event_loop (gpointer data)
+static void
+free_rail (struct kiro_client_rail *rail)
 {
-    uv_loop_t * default_event_loop= (uv_loop_t *) data;
-    uv_run (default_event_loop, UV_RUN_DEFAULT);
-    return NULL;
+    rail_down (rail);
+    g_free (rail->local_address);
+    g_free (rail->address);
+    g_free (rail->port);
+    g_free (rail);
 }
 
 
-void
-client_eventloop_idle_callback (uv_idle_t *handle)
+static void
+free_rails (KiroClientPrivate *priv)
 {
-    KiroClientPrivate *priv = (KiroClientPrivate *)handle->data;
+    g_list_free_full (priv->rails, (GDestroyNotify)free_rail);
+    priv->rails = NULL;
+    priv->rails_stale = FALSE;
+}
 
-    if (priv->close_signal) {
-        uv_poll_stop(priv->uv_recv_cq_fd_poll);
-        uv_poll_stop(priv->uv_ec_fd_poll);
-        uv_idle_stop(priv->uv_idle_handle);
 
-        uv_stop(priv->uv_event_loop);
-        g_debug ("libuv event handling stopped");
-    }
+/*
+ * Returns the latest sequence number the server reported, either by an
+ * update or by a push.
+ */
+static uint64_t
+known_sequence (KiroClientPrivate *priv)
+{
+    g_mutex_lock (&priv->update_lock);
+    uint64_t sequence = MAX (priv->update_sequence, priv->push_sequence);
+    g_mutex_unlock (&priv->update_lock);
+    return sequence;
 }
 
 
-int
-kiro_client_connect (KiroClient *self, const char *address, const char *port)
+/*
+ * Reads the given ranges of the remote memory into a new mirror. sync_lock
+ * is only held for one slice at a time, so syncs into the current mirror
+ * are not held off for the whole read.
+ */
+static gboolean
+fill_mirror (KiroClientPrivate *priv, struct kiro_rdma_mem *next_mr, struct kiro_lazy_mirror *next_lazy,
+             struct ibv_mr *peer_mr, struct KiroSyncRange *ranges, guint count)
 {
-    g_return_val_if_fail (self != NULL, -1);
-    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+    guint r = 0;
+    gulong done = 0;
+
+    while (r < count) {
+        struct KiroSyncRange slice[KIRO_CLIENT_MAX_CHAIN];
+        guint n = 0;
+        gulong size = 0;
+
+        while (r < count && n < KIRO_CLIENT_MAX_CHAIN && size < KIRO_CLIENT_HANDOFF_SLICE) {
+            gulong piece = MIN (ranges[r].size - done, KIRO_CLIENT_HANDOFF_SLICE - size);
+            slice[n].remote_offset = ranges[r].remote_offset + done;
+            slice[n].local_offset = ranges[r].local_offset + done;
+            slice[n].size = piece;
+            n++;
+            size += piece;
+            done += piece;
+            if (done == ranges[r].size) {
+                r++;
+                done = 0;
+            }
+        }
 
-    if (priv->conn) {
-        g_warning ("Already connected to server");
-        return -1;
+        G_LOCK (sync_lock);
+        int rv = next_lazy ? lazy_mirror_read (priv, next_lazy, peer_mr, slice, n)
+                           : read_chains (priv, peer_mr, next_mr, slice, n);
+        G_UNLOCK (sync_lock);
+
+        if (rv)
+            return FALSE;
     }
 
+    return TRUE;
+}
+
+
+/*
+ * NOTE:
+ * The server keeps its old memory registered until we ACK the REALLOC. So we
+ * allocate the new mirror first and fill it from the new remote memory,
+ * while kiro_client_sync still reads from the old memory. This happens on a
+ * thread of its own, so the event loop keeps handling receives meanwhile.
+ * If the server reports an update during the fill, the new mirror is filled
+ * again. Only then is the new mirror swapped in, in between two syncs. The
+ * ACK is sent afterwards, since no read may reach the old remote memory once
+ * the server has released it.
+ *
+ * The old mirror is kept alive until the next realloc (or disconnect), so
+ * pointers that were obtained by kiro_client_get_memory before the switch
+ * remain valid for a while.
+ */
+static gboolean
+handoff_memory (KiroClientPrivate *priv, struct kiro_connection_context *ctx, struct ibv_mr *peer_mri)
+{
+    struct ibv_mr peer_mr = *peer_mri;
+    g_debug ("Reallocating memory. New size is: %zu", peer_mr.length);
+
+    struct kiro_lazy_mirror *next_lazy;
+    struct kiro_rdma_mem *next_mr = create_mirror (priv, peer_mr.length, &next_lazy);
+    if (!next_mr) {
+        g_critical ("Failed to allocate memory for receive buffer (Out of memory?)");
+        return FALSE;
+    }
+
+    struct KiroSyncRange *ranges;
+    guint count = 0;
+    if (next_lazy) {
+        // Only what was resident before is read again
+        G_LOCK (sync_lock);
+        ranges = g_new (struct KiroSyncRange, MAX (priv->lazy->num_chunks, 1));
+        for (guint i = 0; i < priv->lazy->num_chunks; i++) {
+            gulong offset = (gulong)i * KIRO_CLIENT_CHUNK_SIZE;
+            if (!priv->lazy->chunks[i] || offset >= peer_mr.length)
+                continue;
+            ranges[count].remote_offset = ranges[count].local_offset = offset;
+            ranges[count].size = MIN (KIRO_CLIENT_CHUNK_SIZE, peer_mr.length - offset);
+            count++;
+        }
+        G_UNLOCK (sync_lock);
+    }
+    else {
+        ranges = g_new (struct KiroSyncRange, 1);
+        ranges[0].remote_offset = ranges[0].local_offset = 0;
+        ranges[0].size = peer_mr.length;
+        count = 1;
+    }
+
+    gboolean filled = FALSE;
+    for (guint tries = 0; !filled && tries < KIRO_CLIENT_MAX_HANDOFF_TRIES; tries++) {
+        uint64_t sequence = known_sequence (priv);
+        if (!fill_mirror (priv, next_mr, next_lazy, &peer_mr, ranges, count))
+            break;
+
+        G_LOCK (sync_lock);
+        // The last try is taken as it is. Syncs catch up with it.
+        filled = (known_sequence (priv) == sequence || tries + 1 == KIRO_CLIENT_MAX_HANDOFF_TRIES);
+        if (filled) {
+            drop_retired_mirror (priv);
+            priv->retired_mr = ctx->rdma_mr;
+            priv->retired_lazy = priv->lazy;
+            ctx->rdma_mr = next_mr;
+            priv->lazy = next_lazy;
+            ctx->peer_mr = peer_mr;
+            // The server drops our rails for the realloc, and they are
+            // registered with the old memory
+            for (GList *current = priv->rails; current; current = g_list_next (current))
+                rail_down ((struct kiro_client_rail *)current->data);
+            priv->rails_stale = TRUE;
+        }
+        G_UNLOCK (sync_lock);
+    }
+    g_free (ranges);
+
+    if (!filled) {
+        g_critical ("Failed to fill the new receive buffer from the server");
+        if (next_lazy) {
+            free (next_mr);
+            lazy_mirror_free (next_lazy);
+        }
+        else {
+            kiro_destroy_rdma_memory (next_mr);
+        }
+        return FALSE;
+    }
+
+    g_debug ("Switched to the new memory");
+    return TRUE;
+}
+
+
+/*
+ * Posts the receives that pushes from the server consume. A control message
+ * may land in any of them as well, so each one gets a buffer of its own.
+ */
+static gboolean
+post_push_receives (KiroClientPrivate *priv)
+{
+    size_t size = KIRO_CLIENT_PUSH_RECEIVES * sizeof (struct kiro_ctrl_msg);
+    struct kiro_rdma_mem *recv = kiro_create_rdma_memory (priv->conn->pd, size, IBV_ACCESS_LOCAL_WRITE);
+    if (!recv) {
+        g_warning ("Failed to allocate receive buffers for pushes");
+        return FALSE;
+    }
+
+    // Completions for these buffers are only told apart once this is set
+    priv->push_recv = recv;
+
+    for (guint i = 0; i < KIRO_CLIENT_PUSH_RECEIVES; i++) {
+        struct kiro_ctrl_msg *buffer = (struct kiro_ctrl_msg *)recv->mem + i;
+        if (rdma_post_recv (priv->conn, buffer, buffer, sizeof (struct kiro_ctrl_msg), recv->mr)) {
+            // The receives that were posted stay valid until disconnect
+            g_warning ("Failed to post receive for pushes: %s", strerror (errno));
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+
+static gboolean
+send_subscription (KiroClientPrivate *priv)
+{
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+
+    if (priv->lazy) {
+        g_warning ("A lazy mirror can't be subscribed, since the server would populate all of it");
+        return FALSE;
+    }
+
+    G_LOCK (sync_lock);
+    if (priv->push_mr && priv->push_mr->addr == ctx->rdma_mr->mem) {
+        // The server already knows this memory
+        G_UNLOCK (sync_lock);
+        return TRUE;
+    }
+
+    struct ibv_mr *push_mr = ibv_reg_mr (priv->conn->pd, ctx->rdma_mr->mem, ctx->rdma_mr->size,
+                                         IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE);
+    if (!push_mr) {
+        G_UNLOCK (sync_lock);
+        g_warning ("Failed to register memory for pushes: %s", strerror (errno));
+        return FALSE;
+    }
+    struct ibv_mr *old_mr = priv->push_mr;
+    priv->push_mr = push_mr;
+    G_UNLOCK (sync_lock);
+
+    if (!priv->push_recv && !post_push_receives (priv))
+        return FALSE;
+
+    struct kiro_ctrl_msg msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_type = KIRO_SUBSCRIBE;
+    msg.peer_mri = *push_mr;
+    gboolean sent = send_msg (priv->conn, &msg);
+    if (!sent)
+        g_warning ("Failure while trying to post SEND for subscription: %s", strerror (errno));
+
+    // The old memory belongs to a realloc. The server stops pushing to a
+    // client once it has asked for the realloc, so nothing is written to the
+    // old memory any more.
+    if (old_mr)
+        ibv_dereg_mr (old_mr);
+    return sent;
+}
+
+
+static void
+receive_push (KiroClientPrivate *priv, uint32_t sequence)
+{
+    // Only the lower 32 bits of the sequence number fit into the immediate
+    // data. Pushes arrive in order, so the difference to the last one is all
+    // we need.
+    g_mutex_lock (&priv->update_lock);
+    priv->push_sequence += (uint32_t) (sequence - (uint32_t) priv->push_sequence);
+    g_cond_broadcast (&priv->update_cond);
+    g_mutex_unlock (&priv->update_lock);
+}
+
+
+/*
+ * Asks the server for a KIRO_UPDATE once its memory moves past the latest
+ * known sequence number, unless a request is already outstanding.
+ */
+static void
+request_update (KiroClientPrivate *priv)
+{
+    g_mutex_lock (&priv->update_lock);
+    if (priv->update_requested) {
+        g_mutex_unlock (&priv->update_lock);
+        return;
+    }
+    priv->update_requested = TRUE;
+    uint64_t known = priv->update_sequence;
+    g_mutex_unlock (&priv->update_lock);
+
+    struct kiro_ctrl_msg msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_type = KIRO_REQ_UPDATE;
+    msg.sequence = known;
+
+    if (!send_msg (priv->conn, &msg)) {
+        g_warning ("Failure while trying to post SEND for update request: %s", strerror (errno));
+        g_mutex_lock (&priv->update_lock);
+        priv->update_requested = FALSE;
+        g_mutex_unlock (&priv->update_lock);
+    }
+}
+
+
+struct update_args {
+    uint64_t    sequence;
+    gulong      offset;
+    gulong      size;
+};
+
+
+static gboolean
+update_marshaller (GHook *hook, gpointer data)
+{
+    struct update_args *args = (struct update_args *)data;
+    return ((KiroClientUpdateCallbackFunc)hook->func) (args->sequence, args->offset, args->size, hook->data);
+}
+
+
+static void
+receive_update (KiroClientPrivate *priv, struct kiro_ctrl_msg *msg)
+{
+    struct update_args args;
+
+    g_mutex_lock (&priv->update_lock);
+    if (msg->sequence > priv->update_sequence) {
+        priv->update_sequence = msg->sequence;
+        priv->update_offset = msg->offset;
+        priv->update_size = msg->size;
+    }
+    priv->update_requested = FALSE;
+    args.sequence = priv->update_sequence;
+    args.offset = priv->update_offset;
+    args.size = priv->update_size;
+    g_cond_broadcast (&priv->update_cond);
+    g_mutex_unlock (&priv->update_lock);
+
+    // The server answers a request only once. As long as there are
+    // callbacks, the next request is sent right away, so no update is lost.
+    g_rec_mutex_lock (&priv->hook_lock);
+    g_hook_list_marshal_check (&(priv->update_callbacks), FALSE, update_marshaller, &args);
+    gboolean listening = (g_hook_first_valid (&(priv->update_callbacks), TRUE) != NULL);
+    g_rec_mutex_unlock (&priv->hook_lock);
+
+    if (listening)
+        request_update (priv);
+}
+
+
+/*
+ * Thread function that switches to the new memory of a realloc and ACKs it.
+ */
+static gpointer
+handoff_func (KiroClientPrivate *priv)
+{
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+
+    // Without an ACK, the server will disconnect us once the realloc
+    // times out. The old memory stays usable until then.
+    if (!handoff_memory (priv, ctx, &priv->handoff_peer_mr))
+        return NULL;
+
+    // The server only pushes into the new memory once it knows about it
+    if (priv->subscribed)
+        send_subscription (priv);
+
+    struct kiro_ctrl_msg ack;
+    memset (&ack, 0, sizeof (ack));
+    ack.msg_type = KIRO_ACK_RDMA;
+    if (!send_msg (priv->conn, &ack)) {
+        g_warning ("Failure while trying to post SEND for reallocation ACK: %s", strerror (errno));
+    }
+    else {
+        g_debug ("Sent ACK to server");
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns the control message buffer a receive completion belongs to. Apart
+ * from the generic receive, the extra receives that are posted while
+ * subscribed carry their own buffer as work request ID.
+ */
+static struct kiro_ctrl_msg *
+completed_buffer (KiroClientPrivate *priv, struct ibv_wc *wc)
+{
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+
+    if (priv->push_recv) {
+        void *mem = (void *)(uintptr_t)wc->wr_id;
+        if (mem >= priv->push_recv->mem && mem < priv->push_recv->mem + priv->push_recv->size)
+            return (struct kiro_ctrl_msg *)mem;
+    }
+    return (struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem;
+}
+
+
+/*
+ * Handles one receive completion and posts its buffer again. Returns FALSE if
+ * the connection can't be used any more.
+ */
+static gboolean
+handle_completion (KiroClientPrivate *priv, struct ibv_wc *wc)
+{
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+    struct kiro_ctrl_msg *msg_in = completed_buffer (priv, wc);
+
+    guint type = msg_in->msg_type;
+    if (wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+        // A push from the server. It consumes a receive, but leaves the
+        // receive buffer untouched.
+        receive_push (priv, ntohl (wc->imm_data));
+        type = KIRO_MSG_STUB;
+    }
+    g_debug ("Received a message from the Server of type: %u", type);
+
+    if (type == KIRO_ACK_RDMA) {
+        g_debug ("Got RDMI Access information from Server");
+        if (ctx->rdma_mr) {
+            g_debug ("But memory is already allocated. Ignoring");
+        }
+        else {
+            ctx->peer_mr = msg_in->peer_mri;
+            g_debug ("Expected Memory Size is: %zu", ctx->peer_mr.length);
+            priv->dir_peer_mr = msg_in->dir_mri;
+            g_atomic_int_set (&priv->regions_stale, 1);
+            ctx->rdma_mr = create_mirror (priv, ctx->peer_mr.length, &priv->lazy);
+
+            if (!ctx->rdma_mr) {
+                //FIXME: Connection teardown in an event handler routine? Not a good
+                //idea...
+                g_critical ("Failed to allocate memory for receive buffer (Out of memory?)");
+                rdma_disconnect (priv->conn);
+                kiro_destroy_connection_context (&ctx);
+                rdma_destroy_ep (priv->conn);
+                return FALSE;
+            }
+        }
+    }
+    if (type == KIRO_PONG) {
+        G_LOCK (ping_time);
+        struct timeval local_time;
+        gettimeofday (&local_time, NULL);
+
+        if (ping_time.tv_sec == 0 && ping_time.tv_usec == 0) {
+            g_debug ("Received PONG message from server");
+            ping_time.tv_sec = local_time.tv_sec;
+            ping_time.tv_usec = local_time.tv_usec;
+        }
+        else {
+            g_debug ("Received unexpected PONG message from server");
+        }
+
+        G_UNLOCK (ping_time);
+    }
+    if (type == KIRO_UPDATE) {
+        g_debug ("Server reported update %" G_GUINT64_FORMAT, msg_in->sequence);
+        receive_update (priv, msg_in);
+    }
+    if (type == KIRO_REGIONS) {
+        g_debug ("Server has changed its regions");
+        g_atomic_int_set (&priv->regions_stale, 1);
+    }
+    if (type == KIRO_REALLOC) {
+        g_debug ("Got reallocation request from server.");
+
+        // The server sends no other realloc before it got the ACK for the
+        // previous one, which is the last thing its handoff does
+        if (priv->handoff_thread)
+            g_thread_join (priv->handoff_thread);
+        priv->handoff_peer_mr = msg_in->peer_mri;
+        priv->handoff_thread = g_thread_new ("KIRO client handoff", (GThreadFunc)handoff_func, priv);
+    }
+
+    //Post the receive again in order to stay responsive to any messages from
+    //the server
+    int rv;
+    if ((void *)msg_in == ctx->cf_mr_recv->mem)
+        rv = rdma_post_recv (priv->conn, priv->conn, ctx->cf_mr_recv->mem, ctx->cf_mr_recv->size, ctx->cf_mr_recv->mr);
+    else
+        rv = rdma_post_recv (priv->conn, msg_in, msg_in, sizeof (struct kiro_ctrl_msg), priv->push_recv->mr);
+
+    if (rv) {
+        //FIXME: Connection teardown in an event handler routine? Not a good
+        //idea...
+        g_critical ("Posting generic receive for connection failed: %s", strerror (errno));
+        kiro_destroy_connection_context (&ctx);
+        rdma_destroy_ep (priv->conn);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+static gboolean
+process_rdma_event (GIOChannel *source, GIOCondition condition, gpointer data)
+{
+    // Right now, we don't need 'source' and 'condition'
+    // Tell the compiler to ignore them by (void)-ing them
+    (void) source;
+    //(void) condition;
+    g_debug ("Message condidition: %i", condition);
+
+    KiroClientPrivate *priv = (KiroClientPrivate *)data;
+    struct ibv_wc wc;
+
+    if (ibv_poll_cq (priv->conn->recv_cq, 1, &wc) < 0) {
+        g_critical ("Failure getting receive completion event from the queue: %s", strerror (errno));
+        return FALSE;
+    }
+    void *cq_ctx;
+    struct ibv_cq *cq;
+    int err = ibv_get_cq_event (priv->conn->recv_cq_channel, &cq, &cq_ctx);
+    if (!err)
+        ibv_ack_cq_events (cq, 1);
+
+    if (!handle_completion (priv, &wc))
+        return FALSE;
+
+    // make sure the next incoming work completion causes an event on the
+    // receive completion channel. We will poll() the channels file descriptor
+    // for this in the kiro client main loop.
+    ibv_req_notify_cq (priv->conn->recv_cq, 0);
+
+    g_debug ("Finished RDMA event handling");
+    return TRUE;
+}
+
+/** acc to definition of uv_poll_cb **/
+void
+client_process_rdma_event (uv_poll_t *handle, int status __attribute__ ((unused)), int events __attribute__ ((unused)))
+{
+    KiroClientPrivate *priv = (KiroClientPrivate *)handle->data;
+
+    struct ibv_wc wc;
+
+    if (ibv_poll_cq (priv->conn->recv_cq, 1, &wc) < 0) {
+        g_critical ("Failure getting receive completion event from the queue: %s", strerror (errno));
+        return;
+    }
+    void *cq_ctx;
+    struct ibv_cq *cq;
+    int err = ibv_get_cq_event (priv->conn->recv_cq_channel, &cq, &cq_ctx);
+    if (!err)
+        ibv_ack_cq_events (cq, 1);
+
+    if (!handle_completion (priv, &wc))
+        return;
+
+    // make sure the next incoming work completion causes an event on the
+    // receive completion channel. We will poll() the channels file descriptor
+    // for this in the kiro client main loop.
+    ibv_req_notify_cq (priv->conn->recv_cq, 0);
+
+    // With several receives posted, more completions may have arrived in the
+    // meantime. They don't raise another event.
+    while (ibv_poll_cq (priv->conn->recv_cq, 1, &wc) > 0) {
+        if (!handle_completion (priv, &wc))
+            return;
+    }
+
+    g_debug ("Finished RDMA event handling");
+    return;
+}
+
+
+gpointer
+start_client_event_loop (gpointer data)
+{
+    uv_loop_t * default_event_loop= (uv_loop_t *) data;
+    uv_run (default_event_loop, UV_RUN_DEFAULT);
+    return NULL;
+}
+
+
+void
+client_eventloop_close_callback (uv_async_t *handle)
+{
+    KiroClientPrivate *priv = (KiroClientPrivate *)handle->data;
+
+    if (priv->close_signal) {
+        uv_poll_stop(priv->uv_recv_cq_fd_poll);
+        uv_poll_stop(priv->uv_ec_fd_poll);
+        uv_unref((uv_handle_t *)priv->uv_close_async);
+
+        uv_stop(priv->uv_event_loop);
+        g_debug ("libuv event handling stopped");
+    }
+}
+
+
+int
+kiro_client_connect (KiroClient *self, const char *address, const char *port)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (priv->conn) {
+        g_warning ("Already connected to server");
+        return -1;
+    }
+
+    // Rails of a connection that failed belong to the old memory
+    G_LOCK (sync_lock);
+    free_rails (priv);
+    G_UNLOCK (sync_lock);
+
     struct rdma_addrinfo hints, *res_addrinfo;
 
-    memset (&hints, 0, sizeof (hints));
-    hints.ai_port_space = RDMA_PS_IB;
+    memset (&hints, 0, sizeof (hints));
+    hints.ai_port_space = RDMA_PS_IB;
+
+    char *addr_c = g_strdup (address);
+    char *port_c = g_strdup (port);
+    int rtn = rdma_getaddrinfo (addr_c, port_c, &hints, &res_addrinfo);
+    g_free (addr_c);
+    g_free (port_c);
+
+    if (rtn) {
+        g_critical ("Failed to get address information for %s:%s : %s", address, port, strerror (errno));
+        return -1;
+    }
+
+    g_debug ("Address information created");
+    struct ibv_qp_init_attr qp_attr;
+    memset (&qp_attr, 0, sizeof (qp_attr));
+    qp_attr.cap.max_send_wr = KIRO_CLIENT_CHAINS_IN_FLIGHT * KIRO_CLIENT_MAX_CHAIN;
+    qp_attr.cap.max_recv_wr = 1 + KIRO_CLIENT_PUSH_RECEIVES;
+    qp_attr.cap.max_send_sge = 1;
+    qp_attr.cap.max_recv_sge = 1;
+    qp_attr.qp_context = priv->conn;
+    // Work requests need to ask for a completion explicitly, so chains of
+    // RDMA_READs only generate one for their last element
+    qp_attr.sq_sig_all = 0;
+
+    if (rdma_create_ep (& (priv->conn), res_addrinfo, NULL, &qp_attr)) {
+        g_critical ("Endpoint creation failed: %s", strerror (errno));
+        return -1;
+    }
+
+    g_debug ("Route to server resolved");
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)g_try_malloc0 (sizeof (struct kiro_connection_context));
+
+    if (!ctx) {
+        g_critical ("Failed to create connection context (Out of memory?)");
+        rdma_destroy_ep (priv->conn);
+        return -1;
+    }
+
+    ctx->cf_mr_recv = kiro_create_rdma_memory (priv->conn->pd, sizeof (struct kiro_ctrl_msg), IBV_ACCESS_LOCAL_WRITE);
+    ctx->cf_mr_send = kiro_create_rdma_memory (priv->conn->pd, sizeof (struct kiro_ctrl_msg), IBV_ACCESS_LOCAL_WRITE);
+
+    if (!ctx->cf_mr_recv || !ctx->cf_mr_send) {
+        g_critical ("Failed to register control message memory (Out of memory?)");
+        goto fail;
+    }
+
+    ctx->cf_mr_recv->size = ctx->cf_mr_send->size = sizeof (struct kiro_ctrl_msg);
+    priv->conn->context = ctx;
+
+    //Post an preemtive receive for the servers welcome message
+    if (rdma_post_recv (priv->conn, priv->conn, ctx->cf_mr_recv->mem, ctx->cf_mr_recv->size, ctx->cf_mr_recv->mr)) {
+        g_critical ("Posting preemtive receive for connection failed: %s", strerror (errno));
+        goto fail;
+    }
+
+    if (rdma_connect (priv->conn, NULL)) {
+        g_critical ("Failed to establish connection to the server: %s", strerror (errno));
+        goto fail;
+    }
+
+    g_message ("Connection to server established. Waiting for response.");
+    ibv_req_notify_cq (priv->conn->recv_cq, 0); // Make the respective Queue push events onto the channel
+    if (!process_rdma_event (NULL, 0, (gpointer)priv)) {
+        g_critical ("No RDMA access information received from the server. Failed to connect.");
+        goto fail;
+    }
+
+    g_message ("Connected to %s:%s", address, port);
+
+    priv->ec = priv->conn->channel; //For easy access
+
+    // The close handle is triggered by kiro_client_disconnect. The callback
+    // checks for the close flag and stops polls and the event loop. (An idle
+    // handle would keep the loop from ever blocking and burn a whole core)
+    uv_async_init(priv->uv_event_loop, priv->uv_close_async, client_eventloop_close_callback);
+    priv->uv_close_async->data = (void *) priv;
+
+    priv->uv_recv_cq_fd_poll->data = (void *) priv;
+    uv_poll_init (priv->uv_event_loop, priv->uv_recv_cq_fd_poll, priv->conn->recv_cq_channel->fd);
+    uv_poll_start(priv->uv_recv_cq_fd_poll, UV_READABLE, client_process_rdma_event);
+
+    priv->uv_ec_fd_poll->data = (void *) priv;
+    uv_poll_init (priv->uv_event_loop, priv->uv_ec_fd_poll, priv->ec->fd);
+    uv_poll_start(priv->uv_ec_fd_poll, UV_READABLE, client_process_cm_event);
+
+    priv->main_thread = g_thread_new ("KIRO client uvel", start_client_event_loop, (gpointer) priv->uv_event_loop);
+
+    // Callbacks survive a reconnect
+    g_rec_mutex_lock (&priv->hook_lock);
+    gboolean listening = (g_hook_first_valid (&(priv->update_callbacks), TRUE) != NULL);
+    g_rec_mutex_unlock (&priv->hook_lock);
+    if (listening)
+        request_update (priv);
+
+    return 0;
+
+fail:
+    kiro_destroy_connection_context (&ctx);
+    rdma_destroy_ep (priv->conn);
+    priv->conn = NULL;
+    return -1;
+}
+
+
+static int
+wait_completion (struct rdma_cm_id *conn)
+{
+    struct ibv_wc wc;
+
+    if (rdma_get_send_comp (conn, &wc) < 0) {
+        g_critical ("No send completion for RDMA_READ received: %s", strerror (errno));
+        return -1;
+    }
+
+    switch (wc.status) {
+        case IBV_WC_SUCCESS:
+            return 0;
+        case IBV_WC_RETRY_EXC_ERR:
+            g_critical ("Server no longer responding");
+            break;
+        case IBV_WC_REM_ACCESS_ERR:
+            g_critical ("Server has revoked access right to read data");
+            break;
+        default:
+            g_critical ("Could not get data from server. Status %u", wc.status);
+    }
+
+    return -1;
+}
+
+
+static int
+wait_read_completion (KiroClientPrivate *priv)
+{
+    return wait_completion (priv->conn);
+}
+
+
+/*
+ * Connects a rail to the server and registers the local mirror with it. Only
+ * the rail itself is changed, so this can be done without sync_lock, as long
+ * as the rail is not in priv->rails yet.
+ */
+static int
+rail_up (KiroClientPrivate *priv, struct kiro_client_rail *rail, struct kiro_rdma_mem *local, struct ibv_mr *peer_mr)
+{
+    struct rdma_addrinfo hints, *res_addrinfo, *src_addrinfo = NULL;
+
+    memset (&hints, 0, sizeof (hints));
+    hints.ai_port_space = RDMA_PS_IB;
+
+    if (rail->local_address) {
+        // The local address selects the device and port of the rail
+        struct rdma_addrinfo src_hints;
+        memset (&src_hints, 0, sizeof (src_hints));
+        src_hints.ai_flags = RAI_PASSIVE;
+        src_hints.ai_port_space = RDMA_PS_IB;
+        if (rdma_getaddrinfo (rail->local_address, NULL, &src_hints, &src_addrinfo)) {
+            g_critical ("Failed to get address information for %s : %s", rail->local_address, strerror (errno));
+            return -1;
+        }
+        hints.ai_src_addr = src_addrinfo->ai_src_addr;
+        hints.ai_src_len = src_addrinfo->ai_src_len;
+    }
+
+    int rtn = rdma_getaddrinfo (rail->address, rail->port, &hints, &res_addrinfo);
+    if (src_addrinfo)
+        rdma_freeaddrinfo (src_addrinfo);
+
+    if (rtn) {
+        g_critical ("Failed to get address information for %s:%s : %s", rail->address, rail->port, strerror (errno));
+        return -1;
+    }
+
+    struct ibv_qp_init_attr qp_attr;
+    memset (&qp_attr, 0, sizeof (qp_attr));
+    qp_attr.cap.max_send_wr = 1;
+    qp_attr.cap.max_recv_wr = 1;
+    qp_attr.cap.max_send_sge = 1;
+    qp_attr.cap.max_recv_sge = 1;
+    qp_attr.sq_sig_all = 0;
+
+    rtn = rdma_create_ep (&(rail->conn), res_addrinfo, NULL, &qp_attr);
+    rdma_freeaddrinfo (res_addrinfo);
+    if (rtn) {
+        g_critical ("Endpoint creation for rail %u failed: %s", rail->number, strerror (errno));
+        rail->conn = NULL;
+        return -1;
+    }
+
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)g_try_malloc0 (sizeof (struct kiro_connection_context));
+    if (!ctx) {
+        g_critical ("Failed to create connection context (Out of memory?)");
+        rdma_destroy_ep (rail->conn);
+        rail->conn = NULL;
+        return -1;
+    }
+    rail->conn->context = ctx;
+
+    ctx->cf_mr_recv = kiro_create_rdma_memory (rail->conn->pd, sizeof (struct kiro_ctrl_msg), IBV_ACCESS_LOCAL_WRITE);
+    ctx->cf_mr_send = kiro_create_rdma_memory (rail->conn->pd, sizeof (struct kiro_ctrl_msg), IBV_ACCESS_LOCAL_WRITE);
+    if (!ctx->cf_mr_recv || !ctx->cf_mr_send) {
+        g_critical ("Failed to register control message memory (Out of memory?)");
+        goto fail;
+    }
+    ctx->cf_mr_recv->size = ctx->cf_mr_send->size = sizeof (struct kiro_ctrl_msg);
+
+    // The server welcomes the rail like any other client
+    if (rdma_post_recv (rail->conn, rail->conn, ctx->cf_mr_recv->mem, ctx->cf_mr_recv->size, ctx->cf_mr_recv->mr)) {
+        g_critical ("Posting preemtive receive for rail %u failed: %s", rail->number, strerror (errno));
+        goto fail;
+    }
+
+    struct ibv_device_attr dev_attr;
+    if (ibv_query_device (rail->conn->verbs, &dev_attr)) {
+        g_critical ("Failed to query the device of rail %u: %s", rail->number, strerror (errno));
+        goto fail;
+    }
+
+    struct kiro_rail_info info = { priv->rail_group, rail->number };
+    struct rdma_conn_param param;
+    memset (&param, 0, sizeof (param));
+    param.private_data = &info;
+    param.private_data_len = sizeof (info);
+    param.initiator_depth = MIN (dev_attr.max_qp_init_rd_atom, 255);
+    param.responder_resources = MIN (dev_attr.max_qp_rd_atom, 255);
+    param.retry_count = 7;
+    param.rnr_retry_count = 7;
+
+    if (rdma_connect (rail->conn, &param)) {
+        g_critical ("Failed to connect rail %u to the server: %s", rail->number, strerror (errno));
+        goto fail;
+    }
+
+    struct ibv_wc wc;
+    if (rdma_get_recv_comp (rail->conn, &wc) < 0 || wc.status != IBV_WC_SUCCESS) {
+        g_critical ("No RDMA access information received for rail %u", rail->number);
+        goto fail;
+    }
+
+    struct kiro_ctrl_msg *msg = (struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem;
+    if (msg->msg_type != KIRO_ACK_RDMA || msg->peer_mri.length != peer_mr->length) {
+        // The server is in the middle of a realloc. Try again later.
+        g_warning ("Rail %u got different memory than the main connection", rail->number);
+        goto fail;
+    }
+    rail->peer_mr = msg->peer_mri;
+
+    rail->mr = ibv_reg_mr (rail->conn->pd, local->mem, local->size, IBV_ACCESS_LOCAL_WRITE);
+    if (!rail->mr) {
+        g_critical ("Failed to register the local memory with rail %u: %s", rail->number, strerror (errno));
+        goto fail;
+    }
+
+    g_debug ("Rail %u connected to %s:%s", rail->number, rail->address, rail->port);
+    return 0;
+
+fail:
+    kiro_destroy_connection (&(rail->conn));
+    return -1;
+}
+
+
+/*
+ * Dials the rails that went down again. Resolving and connecting may block
+ * for a while, so this is done on copies of the rails without sync_lock.
+ * The new connections are only taken over if the memory has not changed in
+ * the meantime.
+ */
+static void
+redial_rails (KiroClientPrivate *priv)
+{
+    // A lazy mirror is never synced through the rails
+    G_LOCK (sync_lock);
+    if (!priv->rails_stale || priv->rails_dialing || !priv->conn || priv->lazy) {
+        G_UNLOCK (sync_lock);
+        return;
+    }
+
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+    struct kiro_rdma_mem *local = ctx->rdma_mr;
+    struct ibv_mr peer_mr = ctx->peer_mr;
+    GList *dial = NULL;
+
+    for (GList *current = priv->rails; current; current = g_list_next (current)) {
+        struct kiro_client_rail *rail = (struct kiro_client_rail *)current->data;
+        if (rail->conn)
+            continue;
+
+        struct kiro_client_rail *copy = g_new0 (struct kiro_client_rail, 1);
+        copy->local_address = g_strdup (rail->local_address);
+        copy->address = g_strdup (rail->address);
+        copy->port = g_strdup (rail->port);
+        copy->number = rail->number;
+        dial = g_list_prepend (dial, copy);
+    }
+    priv->rails_stale = FALSE;
+    priv->rails_dialing = TRUE;
+    G_UNLOCK (sync_lock);
+
+    // Rails that went down are dialed again once
+    for (GList *current = dial; current; current = g_list_next (current)) {
+        struct kiro_client_rail *copy = (struct kiro_client_rail *)current->data;
+        if (rail_up (priv, copy, local, &peer_mr))
+            g_warning ("Failed to dial rail %u again. Syncing without it.", copy->number);
+    }
+
+    G_LOCK (sync_lock);
+    priv->rails_dialing = FALSE;
+    gboolean current_mem = (priv->conn && priv->conn->context == ctx && ctx->rdma_mr == local);
+    if (!current_mem)
+        priv->rails_stale = TRUE;
+
+    for (GList *current = priv->rails; current_mem && current; current = g_list_next (current)) {
+        struct kiro_client_rail *rail = (struct kiro_client_rail *)current->data;
+        if (rail->conn)
+            continue;
+
+        for (GList *other = dial; other; other = g_list_next (other)) {
+            struct kiro_client_rail *copy = (struct kiro_client_rail *)other->data;
+            if (copy->number != rail->number || !copy->conn)
+                continue;
+
+            rail->conn = copy->conn;
+            rail->mr = copy->mr;
+            rail->peer_mr = copy->peer_mr;
+            copy->conn = NULL;
+            copy->mr = NULL;
+        }
+    }
+    G_UNLOCK (sync_lock);
+
+    // Connections that were not taken over belong to memory that is gone
+    g_list_free_full (dial, (GDestroyNotify)free_rail);
+}
+
+
+/*
+ * Reads one range of the main memory, spread across the main connection and
+ * all rails. Rails that fail are dropped and their part is read through the
+ * main connection. Must be called with sync_lock held. Returns -1 only if the
+ * main connection failed.
+ */
+static int
+read_striped (KiroClientPrivate *priv, struct ibv_mr *peer_mr, struct kiro_rdma_mem *local,
+              gulong remote_offset, gulong size, gulong local_offset)
+{
+    guint up = 0;
+    for (GList *current = priv->rails; current; current = g_list_next (current))
+        up += (((struct kiro_client_rail *)current->data)->conn != NULL);
+
+    // A single READ can't carry more than KIRO_RDMA_MAX_TRANSFER
+    guint lanes = MAX (MIN (up + 1, size / KIRO_CLIENT_MIN_STRIPE), 1);
+    gulong stripe = lanes > 1 ? ((size / lanes) + 4095) & ~4095UL : size;
+    stripe = MIN (stripe, KIRO_RDMA_MAX_TRANSFER);
+
+    struct kiro_client_rail **used = g_new0 (struct kiro_client_rail *, lanes);
+    gulong *starts = g_new0 (gulong, lanes);
+    gulong offset = stripe;
+
+    // Lane 0 is the main connection. The others go to the rails.
+    guint lane = 1;
+    for (GList *current = priv->rails; current && lane < lanes && offset < size; current = g_list_next (current)) {
+        struct kiro_client_rail *rail = (struct kiro_client_rail *)current->data;
+        if (!rail->conn)
+            continue;
+
+        gulong length = MIN (stripe, size - offset);
+        if (rdma_post_read (rail->conn, rail->conn, local->mem + local_offset + offset, length, rail->mr, IBV_SEND_SIGNALED,
+                            (uint64_t)rail->peer_mr.addr + remote_offset + offset, rail->peer_mr.rkey)) {
+            g_warning ("Failed to RDMA_READ through rail %u: %s", rail->number, strerror (errno));
+            rail_down (rail);
+            priv->rails_stale = TRUE;
+            continue;
+        }
+        used[lane] = rail;
+        starts[lane++] = offset;
+        offset += length;
+    }
+
+    gboolean main_ok = !rdma_post_read (priv->conn, priv->conn, local->mem + local_offset, MIN (stripe, size), local->mr,
+                                        IBV_SEND_SIGNALED, (uint64_t)peer_mr->addr + remote_offset, peer_mr->rkey);
+    if (!main_ok)
+        g_critical ("Failed to RDMA_READ from server: %s", strerror (errno));
+
+    // Every posted READ has to complete before the memory may be used again.
+    // The stripes of failed rails, and whatever was left over because no
+    // rail could take it, are read through the main connection afterwards.
+    struct KiroSyncRange *redo = g_new (struct KiroSyncRange, lane);
+    guint count = 0;
+
+    for (guint i = 1; i < lane; i++) {
+        if (wait_completion (used[i]->conn)) {
+            g_warning ("Rail %u failed. Syncing its stripe through the main connection.", used[i]->number);
+            rail_down (used[i]);
+            priv->rails_stale = TRUE;
+
+            redo[count].remote_offset = remote_offset + starts[i];
+            redo[count].local_offset = local_offset + starts[i];
+            redo[count].size = MIN (stripe, size - starts[i]);
+            count++;
+        }
+    }
+    if (offset < size) {
+        redo[count].remote_offset = remote_offset + offset;
+        redo[count].local_offset = local_offset + offset;
+        redo[count].size = size - offset;
+        count++;
+    }
+    g_free (starts);
+    g_free (used);
+
+    int rv = 0;
+    if (!main_ok || wait_read_completion (priv))
+        rv = -1;
+    else if (count)
+        rv = read_chains (priv, peer_mr, local, redo, count);
+
+    g_free (redo);
+    return rv;
+}
+
+
+static void
+drop_region (struct kiro_client_region *region)
+{
+    kiro_destroy_rdma_memory (region->local);
+    g_free (region);
+}
+
+
+static struct kiro_client_region *
+find_region (KiroClientPrivate *priv, guint id)
+{
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_client_region *region = (struct kiro_client_region *)current->data;
+        if (region->id == id)
+            return region;
+    }
+    return NULL;
+}
+
+
+/*
+ * RDMA_READs the first @size bytes of the region directory of the server
+ * into @local, which must be part of priv->directory.
+ */
+static int
+read_directory (KiroClientPrivate *priv, void *local, size_t size)
+{
+    if (rdma_post_read (priv->conn, priv->conn, local, size, priv->directory->mr,
+                        IBV_SEND_SIGNALED, (uint64_t)priv->dir_peer_mr.addr, priv->dir_peer_mr.rkey)) {
+        g_critical ("Failed to RDMA_READ the region directory from server: %s", strerror (errno));
+        return -1;
+    }
+    return wait_read_completion (priv);
+}
+
+
+/*
+ * Reads the region directory of the server again, if it has changed since the
+ * last time. Must be called with sync_lock held. Returns -1 only if reading
+ * from the server failed.
+ */
+static int
+refresh_regions (KiroClientPrivate *priv)
+{
+    if (!g_atomic_int_get (&priv->regions_stale))
+        return 0;
+
+    if (priv->dir_peer_mr.length < sizeof (struct kiro_region_directory)) {
+        // The server has no directory for us
+        g_atomic_int_set (&priv->regions_stale, 0);
+        return 0;
+    }
+
+    // The directory is followed by room for a second copy of its generation
+    if (!priv->directory) {
+        priv->directory = kiro_create_rdma_memory (priv->conn->pd, sizeof (struct kiro_region_directory) + sizeof (uint64_t), IBV_ACCESS_LOCAL_WRITE);
+        if (!priv->directory) {
+            g_warning ("Failed to allocate memory for the region directory");
+            return 0;
+        }
+    }
+
+    // A notification that arrives while we read marks the directory as stale
+    // again
+    g_atomic_int_set (&priv->regions_stale, 0);
+
+    struct kiro_region_directory *dir = (struct kiro_region_directory *)priv->directory->mem;
+    uint64_t *generation = (uint64_t *)(dir + 1);
+    gboolean consistent = FALSE;
+
+    // The order in which a single RDMA_READ fetches the directory is not
+    // defined, so the generation is read on its own before and after it. The
+    // entries are only consistent if it was even and did not change.
+    for (guint tries = 0; !consistent && tries < 16; tries++) {
+        if (read_directory (priv, generation, sizeof (uint64_t)))
+            return -1;
+        if (*generation & 1)
+            continue;
+
+        uint64_t before = *generation;
+        if (read_directory (priv, dir, sizeof (struct kiro_region_directory))
+            || read_directory (priv, generation, sizeof (uint64_t)))
+            return -1;
+
+        consistent = (*generation == before);
+    }
+
+    if (!consistent) {
+        // The server is still busy changing it. Keep what we know and try
+        // again next time.
+        g_atomic_int_set (&priv->regions_stale, 1);
+        return 0;
+    }
+
+    GList *regions = NULL;
+    for (guint i = 0; i < KIRO_MAX_REGIONS; i++) {
+        struct kiro_region_entry *entry = &dir->entries[i];
+        if (!entry->id)
+            continue;
+
+        // Regions are never resized, so the local memory of a known region
+        // stays valid
+        struct kiro_client_region *region = find_region (priv, entry->id);
+        if (region)
+            priv->regions = g_list_remove (priv->regions, region);
+        else
+            region = g_new0 (struct kiro_client_region, 1);
+
+        region->id = entry->id;
+        g_strlcpy (region->name, entry->name, KIRO_REGION_NAME_LENGTH);
+        region->peer_mr.addr = (void *) (uintptr_t) entry->addr;
+        region->peer_mr.length = entry->length;
+        region->peer_mr.rkey = entry->rkey;
+        regions = g_list_append (regions, region);
+    }
+
+    // Whatever is left was removed by the server
+    g_list_free_full (priv->regions, (GDestroyNotify)drop_region);
+    priv->regions = regions;
+    g_debug ("Server provides %u regions", g_list_length (regions));
+    return 0;
+}
+
+
+/*
+ * Resolves a region ID to the remote and local memory. Must be called with
+ * sync_lock held.
+ */
+static gboolean
+get_region (KiroClientPrivate *priv, guint id, struct ibv_mr **peer_mr, struct kiro_rdma_mem **local)
+{
+    if (id == 0) {
+        struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+        *peer_mr = &ctx->peer_mr;
+        *local = ctx->rdma_mr;
+        return (*local != NULL);
+    }
+
+    struct kiro_client_region *region = find_region (priv, id);
+    if (!region)
+        return FALSE;
+
+    if (!region->local) {
+        region->local = kiro_create_rdma_memory (priv->conn->pd, region->peer_mr.length, IBV_ACCESS_LOCAL_WRITE);
+        if (!region->local) {
+            g_warning ("Failed to allocate memory for region %u (Out of memory?)", id);
+            return FALSE;
+        }
+    }
+
+    *peer_mr = &region->peer_mr;
+    *local = region->local;
+    return TRUE;
+}
+
+
+int
+kiro_client_sync_partial (KiroClient *self, gulong remote_offset, gulong size, gulong local_offset)
+{
+    return kiro_client_sync_region_partial (self, 0, remote_offset, size, local_offset);
+}
+
+
+int
+kiro_client_sync_region_partial (KiroClient *self, guint region, gulong remote_offset, gulong size, gulong local_offset)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    struct ibv_mr *peer_mr;
+    struct kiro_rdma_mem *local;
+
+    if (region == 0)
+        redial_rails (priv);
+
+    G_LOCK (sync_lock);
+    if (region && 0 > refresh_regions (priv))
+        goto fail;
+
+    if (!get_region (priv, region, &peer_mr, &local)) {
+        G_UNLOCK (sync_lock);
+        g_warning ("kiro_client_sync_partial: Region %u is not available! Won't sync.", region);
+        return -1;
+    }
+
+    if (remote_offset > peer_mr->length) {
+        G_UNLOCK (sync_lock);
+        g_warning ("kiro_client_sync_partial: remote_offset too large! Won't sync.");
+        return -1;
+    }
+
+    gulong read_size = peer_mr->length;
+    if (size > 0)
+        read_size = size;
+    else if (remote_offset > 0)
+        read_size -= remote_offset;  //read to the end of the memory, starting at offset
+
+    if ((remote_offset + read_size) > peer_mr->length) {
+        G_UNLOCK (sync_lock);
+        g_warning ("kiro_client_sync_partial: remote_offset + read_size would exceed remote memory boundary! Won't sync.");
+        return -1;
+    }
+
+    if ((local_offset + read_size) > local->size) {
+        G_UNLOCK (sync_lock);
+        g_warning ("kiro_client_sync_partial: local_offset + read_size would exceed local memory boundary! Won't sync.");
+        return -1;
+    }
+
+    if (!local->mr) {
+        // A lazy mirror has a registration per chunk
+        struct KiroSyncRange range = { remote_offset, read_size, local_offset };
+        if (lazy_mirror_read (priv, priv->lazy, peer_mr, &range, 1))
+            goto fail;
+    }
+    else if (region == 0 && priv->rails) {
+        if (read_striped (priv, peer_mr, local, remote_offset, read_size, local_offset))
+            goto fail;
+    }
+    else {
+        struct KiroSyncRange range = { remote_offset, read_size, local_offset };
+        if (read_chains (priv, peer_mr, local, &range, 1))
+            goto fail;
+    }
+
+    G_UNLOCK (sync_lock);
+    return 0;
+
+fail:
+    kiro_destroy_connection (&(priv->conn));
+    G_UNLOCK (sync_lock);
+    return -1;
+}
+
+
+int
+kiro_client_sync_batch (KiroClient *self, struct KiroSyncRange *ranges, guint count)
+{
+    return kiro_client_sync_region_batch (self, 0, ranges, count);
+}
+
+
+/*
+ * Reads the given ranges of a region into its local memory.
+ * Must be called with sync_lock held.
+ */
+static int
+sync_ranges (KiroClientPrivate *priv, guint region, struct KiroSyncRange *ranges, guint count)
+{
+    struct ibv_mr *peer_mr;
+    struct kiro_rdma_mem *local;
+
+    if (region && 0 > refresh_regions (priv))
+        goto fail;
+
+    if (!get_region (priv, region, &peer_mr, &local)) {
+        g_warning ("kiro_client_sync_batch: Region %u is not available! Won't sync.", region);
+        return -1;
+    }
+
+    for (guint i = 0; i < count; i++) {
+        if (ranges[i].size == 0
+            || (ranges[i].remote_offset + ranges[i].size) > peer_mr->length
+            || (ranges[i].local_offset + ranges[i].size) > local->size) {
+            g_warning ("kiro_client_sync_batch: range %u exceeds the remote or local memory boundary! Won't sync.", i);
+            return -1;
+        }
+    }
+
+    if (!local->mr) {
+        if (count && lazy_mirror_read (priv, priv->lazy, peer_mr, ranges, count))
+            goto fail;
+        return 0;
+    }
+
+    if (read_chains (priv, peer_mr, local, ranges, count))
+        goto fail;
+
+    return 0;
+
+fail:
+    kiro_destroy_connection (&(priv->conn));
+    return -1;
+}
+
+
+int
+kiro_client_sync_region_batch (KiroClient *self, guint region, struct KiroSyncRange *ranges, guint count)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (ranges != NULL || count == 0, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    G_LOCK (sync_lock);
+    int retval = sync_ranges (priv, region, ranges, count);
+    G_UNLOCK (sync_lock);
+    return retval;
+}
+
+
+int
+kiro_client_sync_strided (KiroClient *self, gulong remote_base, gulong stride, gulong field_size,
+                          gulong count, void *local_dst)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (field_size == 0 || count == 0 || (count > 1 && field_size > stride)) {
+        g_warning ("kiro_client_sync_strided: Fields are empty or overlap! Won't sync.");
+        return -1;
+    }
+
+    // One range per field, unless the fields are contiguous anyway
+    gboolean packed = (count == 1 || field_size == stride);
+    if (!packed && count > G_MAXUINT) {
+        g_warning ("kiro_client_sync_strided: Too many fields! Won't sync.");
+        return -1;
+    }
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    guint num_ranges = packed ? 1 : count;
+    struct KiroSyncRange *ranges = g_new (struct KiroSyncRange, num_ranges);
+
+    for (guint i = 0; i < num_ranges; i++) {
+        ranges[i].remote_offset = ranges[i].local_offset = remote_base + i * stride;
+        ranges[i].size = packed ? count * field_size : field_size;
+    }
+
+    // The fields are copied before a realloc can swap the memory
+    G_LOCK (sync_lock);
+    int retval = sync_ranges (priv, 0, ranges, num_ranges);
+    if (retval == 0 && local_dst) {
+        struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+        char *mem = ctx->rdma_mr->mem;
+        for (gulong i = 0; i < count; i++)
+            memcpy ((char *)local_dst + i * field_size, mem + remote_base + i * stride, field_size);
+    }
+    G_UNLOCK (sync_lock);
+
+    g_free (ranges);
+    return retval;
+}
+
+
+int
+kiro_client_sync_roi (KiroClient *self, gulong x, gulong y, gulong width, gulong height,
+                      gulong row_stride, gulong elem_size, void *local_dst)
+{
+    g_return_val_if_fail (self != NULL, -1);
+
+    gulong row_size = width * elem_size;
+    if (row_size == 0 || height == 0 || x * elem_size + row_size > row_stride) {
+        g_warning ("kiro_client_sync_roi: The ROI does not fit into a row! Won't sync.");
+        return -1;
+    }
+
+    // Every row of the ROI is one field. Without a destination, or with rows
+    // that don't fit into a single READ, the rows go to the mirror.
+    gulong base = y * row_stride + x * elem_size;
+    if (!local_dst || row_size > KIRO_RDMA_MAX_TRANSFER)
+        return kiro_client_sync_strided (self, base, row_stride, row_size, height, local_dst);
+
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    G_LOCK (sync_lock);
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+    if (base + (height - 1) * row_stride + row_size > ctx->peer_mr.length) {
+        G_UNLOCK (sync_lock);
+        g_warning ("kiro_client_sync_roi: The ROI exceeds the remote memory boundary! Won't sync.");
+        return -1;
+    }
+
+    struct ibv_mr *dst_mr = ibv_reg_mr (priv->conn->pd, local_dst, height * row_size, IBV_ACCESS_LOCAL_WRITE);
+    if (!dst_mr) {
+        G_UNLOCK (sync_lock);
+        g_warning ("Failed to register the destination of kiro_client_sync_roi: %s", strerror (errno));
+        return -1;
+    }
+
+    int retval = 0;
+    int rv = read_fields (priv, &ctx->peer_mr, base, row_stride, row_size, height, dst_mr);
+    ibv_dereg_mr (dst_mr);
+    if (rv) {
+        kiro_destroy_connection (&(priv->conn));
+        retval = -1;
+    }
+
+    G_UNLOCK (sync_lock);
+    return retval;
+}
+
+
+int
+kiro_client_sync (KiroClient *self)
+{
+    return kiro_client_sync_partial (self, 0, 0, 0);
+}
+
+
+int
+kiro_client_sync_region (KiroClient *self, guint region)
+{
+    return kiro_client_sync_region_partial (self, region, 0, 0, 0);
+}
+
+
+int
+kiro_client_add_rail (KiroClient *self, const char *local_address, const char *address, const char *port)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (address != NULL && port != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    G_LOCK (sync_lock);
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+    if (priv->lazy) {
+        G_UNLOCK (sync_lock);
+        g_warning ("A lazy mirror is not synced through rails");
+        return -1;
+    }
+
+    while (!priv->rail_group)
+        priv->rail_group = ((uint64_t)g_random_int () << 32) | g_random_int ();
+
+    struct kiro_client_rail *rail = g_new0 (struct kiro_client_rail, 1);
+    rail->local_address = g_strdup (local_address);
+    rail->address = g_strdup (address);
+    rail->port = g_strdup (port);
+    rail->number = g_list_length (priv->rails) + 1;
+
+    if (rail_up (priv, rail, ctx->rdma_mr, &ctx->peer_mr)) {
+        G_UNLOCK (sync_lock);
+        free_rail (rail);
+        return -1;
+    }
+
+    priv->rails = g_list_append (priv->rails, rail);
+    G_UNLOCK (sync_lock);
+
+    g_message ("Rail %u connected to %s:%s", rail->number, address, port);
+    return 0;
+}
 
-    char *addr_c = g_strdup (address);
-    char *port_c = g_strdup (port);
-    int rtn = rdma_getaddrinfo (addr_c, port_c, &hints, &res_addrinfo);
-    g_free (addr_c);
-    g_free (port_c);
 
-    if (rtn) {
-        g_critical ("Failed to get address information for %s:%s : %s", address, port, strerror (errno));
+guint
+kiro_client_get_rail_count (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    guint count = 0;
+    G_LOCK (sync_lock);
+    for (GList *current = priv->rails; current; current = g_list_next (current))
+        count += (((struct kiro_client_rail *)current->data)->conn != NULL);
+    G_UNLOCK (sync_lock);
+
+    return count;
+}
+
+
+static void
+forget_versions (KiroClientPrivate *priv)
+{
+    g_free (priv->seen_versions);
+    priv->seen_versions = NULL;
+    priv->seen_blocks = 0;
+    priv->seen_region = -1;
+}
+
+
+int
+kiro_client_sync_delta (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
         return -1;
     }
 
-    g_debug ("Address information created");
-    struct ibv_qp_init_attr qp_attr;
-    memset (&qp_attr, 0, sizeof (qp_attr));
-    qp_attr.cap.max_send_wr = 10;
-    qp_attr.cap.max_recv_wr = 10;
-    qp_attr.cap.max_send_sge = 1;
-    qp_attr.cap.max_recv_sge = 1;
-    qp_attr.qp_context = priv->conn;
-    qp_attr.sq_sig_all = 1;
+    int retval = -1;
+    g_mutex_lock (&priv->delta_lock);
 
-    if (rdma_create_ep (& (priv->conn), res_addrinfo, NULL, &qp_attr)) {
-        g_critical ("Endpoint creation failed: %s", strerror (errno));
+    // Without a version table, there is no way to tell what has changed
+    gint id = kiro_client_lookup_region (self, KIRO_VERSION_REGION);
+    if (id < 0) {
+        forget_versions (priv);
+        retval = kiro_client_sync (self);
+        goto done;
+    }
+
+    // The versions are read before the data. A block that changes in between
+    // is read again by the next delta sync. The local copy of the table is
+    // shared with kiro_client_read, so the versions are copied out right away.
+    g_mutex_lock (&priv->version_lock);
+    if (0 > kiro_client_sync_region (self, id)) {
+        g_mutex_unlock (&priv->version_lock);
+        goto done;
+    }
+
+    struct kiro_version_table *table = (struct kiro_version_table *)kiro_client_get_region_memory (self, id);
+    size_t table_size = kiro_client_get_region_size (self, id);
+    size_t mem_size = kiro_client_get_memory_size (self);
+    if (!table || table_size < sizeof (struct kiro_version_table)
+        || table->num_blocks > (table_size - sizeof (struct kiro_version_table)) / sizeof (uint64_t)
+        || table->mem_size != mem_size || table->block_size == 0) {
+        // The server is reallocating. Its table does not describe our memory.
+        g_mutex_unlock (&priv->version_lock);
+        forget_versions (priv);
+        retval = kiro_client_sync (self);
+        goto done;
+    }
+
+    uint64_t num_blocks = table->num_blocks;
+    uint64_t block_size = table->block_size;
+    uint64_t *versions = g_new (uint64_t, num_blocks);
+    memcpy (versions, table->versions, num_blocks * sizeof (uint64_t));
+    g_mutex_unlock (&priv->version_lock);
+
+    if (id != priv->seen_region || num_blocks != priv->seen_blocks) {
+        // Nothing to compare against yet
+        retval = kiro_client_sync (self);
+    }
+    else {
+        struct KiroSyncRange *ranges = g_new (struct KiroSyncRange, (num_blocks + 1) / 2);
+        guint count = 0;
+        gulong bytes = 0;
+
+        for (uint64_t block = 0; block < num_blocks; block++) {
+            if (versions[block] == priv->seen_versions[block])
+                continue;
+
+            gulong offset = block * block_size;
+            gulong size = MIN (block_size, mem_size - offset);
+
+            // Neighbouring blocks are read as one range
+            if (count > 0 && ranges[count - 1].remote_offset + ranges[count - 1].size == offset) {
+                ranges[count - 1].size += size;
+            }
+            else {
+                ranges[count].remote_offset = ranges[count].local_offset = offset;
+                ranges[count].size = size;
+                count++;
+            }
+            bytes += size;
+        }
+
+        retval = count ? kiro_client_sync_batch (self, ranges, count) : 0;
+        g_debug ("Delta sync read %lu bytes in %u ranges", bytes, count);
+        g_free (ranges);
+    }
+
+    if (retval == 0) {
+        g_free (priv->seen_versions);
+        priv->seen_versions = versions;
+        priv->seen_blocks = num_blocks;
+        priv->seen_region = id;
+    }
+    else {
+        g_free (versions);
+    }
+
+done:
+    g_mutex_unlock (&priv->delta_lock);
+    return retval;
+}
+
+
+int
+kiro_client_sync_consistent (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
         return -1;
     }
 
-    g_debug ("Route to server resolved");
-    struct kiro_connection_context *ctx = (struct kiro_connection_context *)g_try_malloc0 (sizeof (struct kiro_connection_context));
+    // Without a sequence counter, the server does not bracket its writes
+    gint id = kiro_client_lookup_region (self, KIRO_SEQLOCK_REGION);
+    if (id < 0)
+        return kiro_client_sync (self);
 
-    if (!ctx) {
-        g_critical ("Failed to create connection context (Out of memory?)");
-        rdma_destroy_ep (priv->conn);
+    int retval = 1;
+    g_mutex_lock (&priv->snapshot_lock);
+    volatile uint64_t *counter = (volatile uint64_t *)kiro_client_get_region_memory (self, id);
+    if (!counter) {
+        retval = -1;
+        goto done;
+    }
+
+    for (guint tries = 0; tries < KIRO_CLIENT_MAX_SNAPSHOT_TRIES; tries++) {
+        if (0 > kiro_client_sync_region (self, id)) {
+            retval = -1;
+            break;
+        }
+
+        uint64_t before = *counter;
+        if (before & 1) {
+            // A write is in progress. Reading now would be wasted.
+            g_thread_yield ();
+            continue;
+        }
+
+        if (0 > kiro_client_sync (self) || 0 > kiro_client_sync_region (self, id)) {
+            retval = -1;
+            break;
+        }
+
+        if (*counter == before) {
+            retval = 0;
+            break;
+        }
+        g_debug ("Memory changed during sync. Reading it again.");
+    }
+
+done:
+    g_mutex_unlock (&priv->snapshot_lock);
+    return retval;
+}
+
+
+int
+kiro_client_set_lazy_mirror (KiroClient *self, gboolean lazy, gulong max_resident)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (priv->conn) {
+        g_warning ("The mirror mode can only be changed while the client is not connected");
         return -1;
     }
 
-    ctx->cf_mr_recv = kiro_create_rdma_memory (priv->conn->pd, sizeof (struct kiro_ctrl_msg), IBV_ACCESS_LOCAL_WRITE);
-    ctx->cf_mr_send = kiro_create_rdma_memory (priv->conn->pd, sizeof (struct kiro_ctrl_msg), IBV_ACCESS_LOCAL_WRITE);
+    priv->lazy_enabled = lazy;
+    priv->lazy_limit = max_resident;
+    return 0;
+}
 
-    if (!ctx->cf_mr_recv || !ctx->cf_mr_send) {
-        g_critical ("Failed to register control message memory (Out of memory?)");
-        goto fail;
+
+int
+kiro_client_evict (KiroClient *self, gulong offset, gulong size)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn)
+        return -1;
+
+    G_LOCK (sync_lock);
+    struct kiro_lazy_mirror *lazy = priv->lazy;
+    if (!lazy) {
+        G_UNLOCK (sync_lock);
+        g_warning ("Only a lazy mirror can be evicted");
+        return -1;
     }
 
-    ctx->cf_mr_recv->size = ctx->cf_mr_send->size = sizeof (struct kiro_ctrl_msg);
-    priv->conn->context = ctx;
+    // Only chunks that lie completely within the range are evicted
+    gulong end = (size && offset + size < lazy->size) ? offset + size : lazy->size;
+    for (guint i = (offset + KIRO_CLIENT_CHUNK_SIZE - 1) / KIRO_CLIENT_CHUNK_SIZE; i < lazy->num_chunks; i++) {
+        gulong chunk_end = MIN ((gulong)(i + 1) * KIRO_CLIENT_CHUNK_SIZE, lazy->size);
+        if (chunk_end > end)
+            break;
+        lazy_mirror_evict_chunk (lazy, i);
+    }
+    G_UNLOCK (sync_lock);
+    return 0;
+}
 
-    //Post an preemtive receive for the servers welcome message
-    if (rdma_post_recv (priv->conn, priv->conn, ctx->cf_mr_recv->mem, ctx->cf_mr_recv->size, ctx->cf_mr_recv->mr)) {
-        g_critical ("Posting preemtive receive for connection failed: %s", strerror (errno));
-        goto fail;
+
+gulong
+kiro_client_get_resident_size (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn)
+        return 0;
+
+    G_LOCK (sync_lock);
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+    gulong resident = priv->lazy ? priv->lazy->resident : (ctx->rdma_mr ? ctx->rdma_mr->size : 0);
+    G_UNLOCK (sync_lock);
+    return resident;
+}
+
+
+// Must be called with buffer_lock held
+static void
+free_buffers (KiroClientPrivate *priv)
+{
+    for (guint i = 0; priv->buffers && i < priv->num_buffers; i++)
+        kiro_destroy_rdma_memory (priv->buffers[i].mem);
+    g_free (priv->buffers);
+    priv->buffers = NULL;
+    priv->latest_buffer = -1;
+}
+
+
+int
+kiro_client_set_buffers (KiroClient *self, guint count)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->buffer_lock);
+    for (guint i = 0; priv->buffers && i < priv->num_buffers; i++) {
+        if (priv->buffers[i].refs || priv->buffers[i].filling) {
+            g_mutex_unlock (&priv->buffer_lock);
+            g_warning ("Can't change the number of buffers while snapshots are in use");
+            return -1;
+        }
     }
 
-    if (rdma_connect (priv->conn, NULL)) {
-        g_critical ("Failed to establish connection to the server: %s", strerror (errno));
-        goto fail;
+    free_buffers (priv);
+    priv->num_buffers = count;
+    g_mutex_unlock (&priv->buffer_lock);
+    return 0;
+}
+
+
+gint
+kiro_client_sync_snapshot (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    g_mutex_lock (&priv->buffer_lock);
+    if (!priv->num_buffers) {
+        g_mutex_unlock (&priv->buffer_lock);
+        g_warning ("No buffers set up. Use kiro_client_set_buffers first.");
+        return -1;
+    }
+
+    if (!priv->buffers)
+        priv->buffers = g_new0 (struct kiro_client_buffer, priv->num_buffers);
+
+    // Overwrite the oldest snapshot nobody holds. The newest one is only
+    // overwritten if there is no other choice.
+    gint pick = -1;
+    for (guint i = 0; i < priv->num_buffers; i++) {
+        struct kiro_client_buffer *b = &priv->buffers[i];
+        if (b->refs || b->filling)
+            continue;
+        if (pick < 0 || pick == priv->latest_buffer
+            || ((gint)i != priv->latest_buffer && b->number < priv->buffers[pick].number))
+            pick = i;
+    }
+
+    if (pick < 0) {
+        g_mutex_unlock (&priv->buffer_lock);
+        g_debug ("All buffers are in use");
+        return -1;
+    }
+
+    struct kiro_client_buffer *buffer = &priv->buffers[pick];
+    buffer->filling = TRUE;
+    if (pick == priv->latest_buffer)
+        priv->latest_buffer = -1;
+    g_mutex_unlock (&priv->buffer_lock);
+
+    // Nobody else touches the buffer while it is filling
+    G_LOCK (sync_lock);
+    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+    if (!buffer->mem || buffer->mem->size != ctx->peer_mr.length) {
+        // First use, or the server has reallocated its memory
+        kiro_destroy_rdma_memory (buffer->mem);
+        buffer->mem = kiro_create_rdma_memory (priv->conn->pd, ctx->peer_mr.length, IBV_ACCESS_LOCAL_WRITE);
     }
 
-    g_message ("Connection to server established. Waiting for response.");
-    ibv_req_notify_cq (priv->conn->recv_cq, 0); // Make the respective Queue push events onto the channel
-    if (!process_rdma_event (NULL, 0, (gpointer)priv)) {
-        g_critical ("No RDMA access information received from the server. Failed to connect.");
-        goto fail;
+    gboolean success = FALSE;
+    struct KiroSyncRange range = { 0, ctx->peer_mr.length, 0 };
+    if (!buffer->mem) {
+        g_warning ("Failed to allocate memory for snapshot buffer (Out of memory?)");
+    }
+    else if (read_chains (priv, &ctx->peer_mr, buffer->mem, &range, 1)) {
+        kiro_destroy_connection (&(priv->conn));
+    }
+    else {
+        success = TRUE;
+    }
+    G_UNLOCK (sync_lock);
+
+    g_mutex_lock (&priv->buffer_lock);
+    buffer->filling = FALSE;
+    if (success) {
+        buffer->number = ++priv->buffer_count;
+        buffer->refs = 1;
+        priv->latest_buffer = pick;
+    }
+    else {
+        buffer->number = 0;
+    }
+    g_mutex_unlock (&priv->buffer_lock);
+
+    return success ? pick : -1;
+}
+
+
+gint
+kiro_client_acquire_snapshot (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->buffer_lock);
+    gint handle = priv->latest_buffer;
+    if (handle >= 0)
+        priv->buffers[handle].refs++;
+    g_mutex_unlock (&priv->buffer_lock);
+    return handle;
+}
+
+
+void
+kiro_client_release_snapshot (KiroClient *self, gint handle)
+{
+    g_return_if_fail (self != NULL);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->buffer_lock);
+    if (priv->buffers && handle >= 0 && (guint)handle < priv->num_buffers && priv->buffers[handle].refs)
+        priv->buffers[handle].refs--;
+    else
+        g_warning ("Snapshot %i is not acquired", handle);
+    g_mutex_unlock (&priv->buffer_lock);
+}
+
+
+// Must be called with buffer_lock held
+static struct kiro_client_buffer *
+get_acquired_buffer (KiroClientPrivate *priv, gint handle)
+{
+    if (!priv->buffers || handle < 0 || (guint)handle >= priv->num_buffers || !priv->buffers[handle].refs)
+        return NULL;
+    return &priv->buffers[handle];
+}
+
+
+void *
+kiro_client_get_snapshot_memory (KiroClient *self, gint handle)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->buffer_lock);
+    struct kiro_client_buffer *buffer = get_acquired_buffer (priv, handle);
+    void *mem = buffer ? buffer->mem->mem : NULL;
+    g_mutex_unlock (&priv->buffer_lock);
+    return mem;
+}
+
+
+size_t
+kiro_client_get_snapshot_size (KiroClient *self, gint handle)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->buffer_lock);
+    struct kiro_client_buffer *buffer = get_acquired_buffer (priv, handle);
+    size_t size = buffer ? buffer->mem->size : 0;
+    g_mutex_unlock (&priv->buffer_lock);
+    return size;
+}
+
+
+// Must be called with cache_lock held
+static void
+free_cache (KiroClientPrivate *priv)
+{
+    kiro_destroy_rdma_memory (priv->cache_mem);
+    priv->cache_mem = NULL;
+    g_free (priv->cache_slots);
+    priv->cache_slots = NULL;
+    if (priv->cache_map)
+        g_hash_table_destroy (priv->cache_map);
+    priv->cache_map = NULL;
+    g_queue_init (&priv->cache_lru);
+    priv->cache_used = 0;
+    priv->cache_region = -1;
+}
+
+
+// Must be called with cache_lock held
+static void
+invalidate_cache (KiroClientPrivate *priv)
+{
+    for (guint i = 0; i < priv->cache_used; i++)
+        priv->cache_slots[i].link.prev = priv->cache_slots[i].link.next = NULL;
+    g_queue_init (&priv->cache_lru);
+    priv->cache_used = 0;
+    if (priv->cache_map)
+        g_hash_table_remove_all (priv->cache_map);
+}
+
+
+int
+kiro_client_set_cache (KiroClient *self, guint num_pages, gulong page_size)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    // A page must not span two blocks of the version table
+    if (num_pages && (page_size == 0 || page_size > KIRO_DIRTY_BLOCK_SIZE || KIRO_DIRTY_BLOCK_SIZE % page_size)) {
+        g_warning ("The page size must divide %i", KIRO_DIRTY_BLOCK_SIZE);
+        return -1;
     }
 
-    g_message ("Connected to %s:%s", address, port);
+    g_mutex_lock (&priv->cache_lock);
+    free_cache (priv);
+    priv->cache_pages = num_pages;
+    priv->cache_page_size = page_size;
+    priv->cache_hits = priv->cache_misses = 0;
+    g_mutex_unlock (&priv->cache_lock);
+    return 0;
+}
 
-    priv->ec = priv->conn->channel; //For easy access
 
-    // Idle handler is executed for every loop iteration. The callback checks for close flag and stops polls and the event loop
-    uv_idle_init(priv->uv_event_loop, priv->uv_idle_handle);
-    priv->uv_idle_handle->data = (void *) priv;
-    uv_idle_start(priv->uv_idle_handle, client_eventloop_idle_callback);
+/*
+ * Reads the versions of the given blocks into the local copy of the version
+ * table. Returns the table if it describes the memory of size mem_size and
+ * holds the blocks, NULL otherwise.
+ */
+static struct kiro_version_table *
+read_versions (KiroClient *self, gint id, uint64_t first, uint64_t last, gulong mem_size)
+{
+    size_t table_size = kiro_client_get_region_size (self, id);
+    size_t entries = offsetof (struct kiro_version_table, versions);
+    if (table_size < entries + (last + 1) * sizeof (uint64_t))
+        return NULL;
 
-    priv->uv_recv_cq_fd_poll->data = (void *) priv;
-    uv_poll_init (priv->uv_event_loop, priv->uv_recv_cq_fd_poll, priv->conn->recv_cq_channel->fd);
-    uv_poll_start(priv->uv_recv_cq_fd_poll, UV_READABLE, client_process_rdma_event);
+    struct KiroSyncRange ranges[2] = {
+        { 0, entries, 0 },
+        { entries + first * sizeof (uint64_t), (last - first + 1) * sizeof (uint64_t), entries + first * sizeof (uint64_t) },
+    };
+    if (0 > kiro_client_sync_region_batch (self, id, ranges, 2))
+        return NULL;
 
-    priv->uv_ec_fd_poll->data = (void *) priv;
-    uv_poll_init (priv->uv_event_loop, priv->uv_ec_fd_poll, priv->ec->fd);
-    uv_poll_start(priv->uv_ec_fd_poll, UV_READABLE, client_process_cm_event);
+    struct kiro_version_table *table = (struct kiro_version_table *)kiro_client_get_region_memory (self, id);
+    if (!table || table->mem_size != mem_size || table->block_size != KIRO_DIRTY_BLOCK_SIZE || last >= table->num_blocks)
+        return NULL;
+    return table;
+}
 
-    priv->main_thread = g_thread_new ("KIRO client uvel", start_client_event_loop, (gpointer) priv->uv_event_loop);
 
+/*
+ * Reads a range that bypasses the read cache through the mirror.
+ */
+static int
+read_through_mirror (KiroClient *self, gulong offset, gulong size, void *dest)
+{
+    if (0 > kiro_client_sync_partial (self, offset, size, offset))
+        return -1;
+    memcpy (dest, kiro_client_get_memory (self) + offset, size);
     return 0;
-
-fail:
-    kiro_destroy_connection_context (&ctx);
-    rdma_destroy_ep (priv->conn);
-    priv->conn = NULL;
-    return -1;
 }
 
 
 int
-kiro_client_sync_partial (KiroClient *self, gulong remote_offset, gulong size, gulong local_offset)
+kiro_client_read (KiroClient *self, gulong offset, gulong size, void *dest)
 {
     g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (dest != NULL || size == 0, -1);
     KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
 
     if (!priv->conn) {
@@ -543,67 +2703,177 @@ kiro_client_sync_partial (KiroClient *self, gulong remote_offset, gulong size, g
         return -1;
     }
 
-    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
-
-    if (remote_offset > ctx->peer_mr.length) {
-        g_warning ("kiro_client_sync_partial: remote_offset too large! Won't sync.");
+    gulong mem_size = kiro_client_get_memory_size (self);
+    if (offset > mem_size || size > mem_size - offset) {
+        g_warning ("kiro_client_read: Range exceeds the remote memory boundary");
         return -1;
     }
 
-    gulong read_size = ctx->peer_mr.length;
-    if (size > 0)
-        read_size = size;
-    else if (remote_offset > 0)
-        read_size -= remote_offset;  //read to the end of the memory, starting at offset
+    if (size == 0)
+        return 0;
 
-    if ((remote_offset + read_size) > ctx->peer_mr.length) {
-        g_warning ("kiro_client_sync_partial: remote_offset + read_size would exceed remote memory boundary! Won't sync.");
-        return -1;
+    g_mutex_lock (&priv->cache_lock);
+    gulong page_size = priv->cache_page_size;
+    if (!priv->cache_pages || !page_size) {
+        g_mutex_unlock (&priv->cache_lock);
+        return read_through_mirror (self, offset, size, dest);
     }
 
-    if ((local_offset + read_size) > ctx->rdma_mr->size) {
-        g_warning ("kiro_client_sync_partial: local_offset + read_size would exceed local memory boundary! Won't sync.");
-        return -1;
+    uint64_t first = offset / page_size;
+    uint64_t last = (offset + size - 1) / page_size;
+
+    if (last - first + 1 > priv->cache_pages) {
+        // The range does not fit into the cache
+        g_mutex_unlock (&priv->cache_lock);
+        return read_through_mirror (self, offset, size, dest);
     }
 
-    G_LOCK (sync_lock);
-    if (rdma_post_read (priv->conn, priv->conn, ctx->rdma_mr->mem + local_offset, read_size, ctx->rdma_mr->mr, 0, (uint64_t)ctx->peer_mr.addr + remote_offset, ctx->peer_mr.rkey)) {
-        g_critical ("Failed to RDMA_READ from server: %s", strerror (errno));
-        goto fail;
+    if (!priv->cache_mem) {
+        priv->cache_mem = kiro_create_rdma_memory (priv->conn->pd, (size_t)priv->cache_pages * page_size, IBV_ACCESS_LOCAL_WRITE);
+        if (!priv->cache_mem) {
+            g_mutex_unlock (&priv->cache_lock);
+            g_warning ("Failed to allocate memory for the read cache (Out of memory?)");
+            return -1;
+        }
+        priv->cache_slots = g_new0 (struct kiro_cache_slot, priv->cache_pages);
+        priv->cache_map = g_hash_table_new (g_int64_hash, g_int64_equal);
+        for (guint i = 0; i < priv->cache_pages; i++)
+            priv->cache_slots[i].link.data = &priv->cache_slots[i];
     }
 
-    struct ibv_wc wc;
+    // The versions are read before the data, so a page that changes while it
+    // is fetched is fetched again next time. Without a version table,
+    // nothing can be validated and every page is fetched.
+    // The local copy of the version table is shared with delta syncs, so it
+    // is held until the versions of all pages have been taken
+    struct kiro_version_table *table = NULL;
+    g_mutex_lock (&priv->version_lock);
+    gint id = kiro_client_lookup_region (self, KIRO_VERSION_REGION);
+    if (id >= 0) {
+        if (id != priv->cache_region) {
+            // A new table starts counting from the beginning
+            invalidate_cache (priv);
+            priv->cache_region = id;
+        }
+        table = read_versions (self, id, first * page_size / KIRO_DIRTY_BLOCK_SIZE,
+                               last * page_size / KIRO_DIRTY_BLOCK_SIZE, mem_size);
+    }
 
-    if (rdma_get_send_comp (priv->conn, &wc) < 0) {
-        g_critical ("No send completion for RDMA_READ received: %s", strerror (errno));
-        goto fail;
+    struct KiroSyncRange *misses = g_new (struct KiroSyncRange, last - first + 1);
+    guint count = 0;
+
+    for (uint64_t page = first; page <= last; page++) {
+        uint64_t version = table ? table->versions[page * page_size / KIRO_DIRTY_BLOCK_SIZE] : 0;
+        struct kiro_cache_slot *slot = g_hash_table_lookup (priv->cache_map, &page);
+
+        if (slot) {
+            g_queue_unlink (&priv->cache_lru, &slot->link);
+            if (table && slot->version == version) {
+                g_queue_push_head_link (&priv->cache_lru, &slot->link);
+                priv->cache_hits++;
+                continue;
+            }
+        }
+        else {
+            // Take an unused slot, or the least recently used one. The pages
+            // of this read are all at the head, so they are never taken.
+            if (priv->cache_used < priv->cache_pages) {
+                slot = &priv->cache_slots[priv->cache_used++];
+            }
+            else {
+                GList *tail = g_queue_peek_tail_link (&priv->cache_lru);
+                slot = (struct kiro_cache_slot *)tail->data;
+                g_queue_unlink (&priv->cache_lru, tail);
+                g_hash_table_remove (priv->cache_map, &slot->page);
+            }
+            slot->page = page;
+            g_hash_table_insert (priv->cache_map, &slot->page, slot);
+        }
+
+        g_queue_push_head_link (&priv->cache_lru, &slot->link);
+        slot->version = version;
+        priv->cache_misses++;
+
+        misses[count].remote_offset = page * page_size;
+        misses[count].size = MIN (page_size, mem_size - page * page_size);
+        misses[count].local_offset = (slot - priv->cache_slots) * page_size;
+        count++;
     }
+    g_mutex_unlock (&priv->version_lock);
 
-    switch (wc.status) {
-        case IBV_WC_SUCCESS:
-            G_UNLOCK (sync_lock);
-            return 0;
-        case IBV_WC_RETRY_EXC_ERR:
-            g_critical ("Server no longer responding");
-            break;
-        case IBV_WC_REM_ACCESS_ERR:
-            g_critical ("Server has revoked access right to read data");
-            break;
-        default:
-            g_critical ("Could not get data from server. Status %u", wc.status);
+    int retval = 0;
+    if (count) {
+        G_LOCK (sync_lock);
+        struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+        if (read_chains (priv, &ctx->peer_mr, priv->cache_mem, misses, count)) {
+            kiro_destroy_connection (&(priv->conn));
+            retval = -1;
+        }
+        G_UNLOCK (sync_lock);
+    }
+    g_free (misses);
+
+    if (retval == 0) {
+        for (uint64_t page = first; page <= last; page++) {
+            struct kiro_cache_slot *slot = g_hash_table_lookup (priv->cache_map, &page);
+            gulong start = MAX (offset, page * page_size);
+            gulong end = MIN (offset + size, (page + 1) * page_size);
+            memcpy (dest + (start - offset),
+                    priv->cache_mem->mem + (slot - priv->cache_slots) * page_size + (start - page * page_size),
+                    end - start);
+        }
+    }
+    else {
+        invalidate_cache (priv);
     }
 
-fail:
-    kiro_destroy_connection (&(priv->conn));
-    G_UNLOCK (sync_lock);
-    return -1;
+    g_mutex_unlock (&priv->cache_lock);
+    return retval;
 }
 
 
-int
-kiro_client_sync (KiroClient *self)
+void
+kiro_client_get_cache_stats (KiroClient *self, guint64 *hits, guint64 *misses)
 {
-    return kiro_client_sync_partial (self, 0, 0, 0);
+    g_return_if_fail (self != NULL);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->cache_lock);
+    if (hits)
+        *hits = priv->cache_hits;
+    if (misses)
+        *misses = priv->cache_misses;
+    g_mutex_unlock (&priv->cache_lock);
+}
+
+
+gint
+kiro_client_lookup_region (KiroClient *self, const gchar *name)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (name != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn)
+        return -1;
+
+    gint id = -1;
+    G_LOCK (sync_lock);
+    if (0 > refresh_regions (priv)) {
+        kiro_destroy_connection (&(priv->conn));
+        G_UNLOCK (sync_lock);
+        return -1;
+    }
+
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_client_region *region = (struct kiro_client_region *)current->data;
+        if (!g_strcmp0 (region->name, name)) {
+            id = region->id;
+            break;
+        }
+    }
+    G_UNLOCK (sync_lock);
+    return id;
 }
 
 
@@ -646,10 +2916,9 @@ kiro_client_ping_server (KiroClient *self)
         return -1;
     }
 
-    struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
-
-    struct kiro_ctrl_msg *msg = (struct kiro_ctrl_msg *)(ctx->cf_mr_send->mem);
-    msg->msg_type = KIRO_PING;
+    struct kiro_ctrl_msg msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_type = KIRO_PING;
 
     G_LOCK (ping_time);
     ping_time.tv_sec = 0;
@@ -657,7 +2926,7 @@ kiro_client_ping_server (KiroClient *self)
     struct timeval local_time;
     gettimeofday (&local_time, NULL);
 
-    if (!send_msg (priv->conn, ctx->cf_mr_send)) {
+    if (!send_msg (priv->conn, &msg)) {
         g_warning ("Failure while trying to post SEND for PING: %s", strerror (errno));
         t_usec = -1;
         G_UNLOCK (ping_time);
@@ -714,6 +2983,189 @@ end:
 }
 
 
+int
+kiro_client_wait_update (KiroClient *self, uint64_t known, gint timeout_ms)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    gint64 end_time = g_get_monotonic_time () + (timeout_ms * G_TIME_SPAN_MILLISECOND);
+    int retval = 0;
+
+    g_mutex_lock (&priv->update_lock);
+    while (priv->update_sequence <= known) {
+        if (!priv->update_requested) {
+            // Only one request is outstanding at any time. The server answers
+            // it exactly once, so it can never flood our single receive.
+            priv->update_requested = TRUE;
+            g_mutex_unlock (&priv->update_lock);
+
+            struct kiro_ctrl_msg msg;
+            memset (&msg, 0, sizeof (msg));
+            msg.msg_type = KIRO_REQ_UPDATE;
+            msg.sequence = known;
+            gboolean sent = send_msg (priv->conn, &msg);
+
+            g_mutex_lock (&priv->update_lock);
+            if (!sent) {
+                g_warning ("Failure while trying to post SEND for update request: %s", strerror (errno));
+                priv->update_requested = FALSE;
+                retval = -1;
+                break;
+            }
+            continue;
+        }
+
+        if (!g_cond_wait_until (&priv->update_cond, &priv->update_lock, end_time))
+            break;
+
+        if (!priv->conn) {
+            retval = -1;
+            break;
+        }
+    }
+
+    if (retval == 0 && priv->update_sequence > known)
+        retval = 1;
+    g_mutex_unlock (&priv->update_lock);
+
+    return retval;
+}
+
+
+int
+kiro_client_subscribe (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn) {
+        g_warning ("Client not connected");
+        return -1;
+    }
+
+    if (!send_subscription (priv))
+        return -1;
+
+    priv->subscribed = TRUE;
+    return 0;
+}
+
+
+int
+kiro_client_wait_push (KiroClient *self, uint64_t known, gint timeout_ms)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn || !priv->subscribed) {
+        g_warning ("Client not connected or not subscribed");
+        return -1;
+    }
+
+    gint64 end_time = g_get_monotonic_time () + (timeout_ms * G_TIME_SPAN_MILLISECOND);
+    int retval = 0;
+
+    g_mutex_lock (&priv->update_lock);
+    while (priv->push_sequence <= known) {
+        if (!g_cond_wait_until (&priv->update_cond, &priv->update_lock, end_time))
+            break;
+
+        if (!priv->conn) {
+            retval = -1;
+            break;
+        }
+    }
+
+    if (retval == 0 && priv->push_sequence > known)
+        retval = 1;
+    g_mutex_unlock (&priv->update_lock);
+
+    return retval;
+}
+
+
+uint64_t
+kiro_client_get_push_sequence (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->update_lock);
+    uint64_t sequence = priv->push_sequence;
+    g_mutex_unlock (&priv->update_lock);
+    return sequence;
+}
+
+
+void
+kiro_client_get_update_range (KiroClient *self, gulong *offset, gulong *size)
+{
+    g_return_if_fail (self != NULL);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->update_lock);
+    if (offset)
+        *offset = priv->update_offset;
+    if (size)
+        *size = priv->update_size;
+    g_mutex_unlock (&priv->update_lock);
+}
+
+
+gulong
+kiro_client_add_update_callback (KiroClient *self, KiroClientUpdateCallbackFunc func, void *user_data)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (func != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_rec_mutex_lock (&priv->hook_lock);
+    GHook *new_hook = g_hook_alloc (&(priv->update_callbacks));
+    new_hook->data = user_data;
+    new_hook->func = (gpointer)func;
+    g_hook_append (&(priv->update_callbacks), new_hook);
+    gulong hook_id = new_hook->hook_id;
+    g_rec_mutex_unlock (&priv->hook_lock);
+
+    if (priv->conn)
+        request_update (priv);
+
+    return hook_id;
+}
+
+
+gboolean
+kiro_client_remove_update_callback (KiroClient *self, gulong hook_id)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_rec_mutex_lock (&priv->hook_lock);
+    gboolean removed = g_hook_destroy (&(priv->update_callbacks), hook_id);
+    g_rec_mutex_unlock (&priv->hook_lock);
+    return removed;
+}
+
+
+uint64_t
+kiro_client_get_update_sequence (KiroClient *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->update_lock);
+    uint64_t sequence = priv->update_sequence;
+    g_mutex_unlock (&priv->update_lock);
+    return sequence;
+}
+
+
 void *
 kiro_client_get_memory (KiroClient *self)
 {
@@ -750,6 +3202,49 @@ kiro_client_get_memory_size (KiroClient *self)
 }
 
 
+void *
+kiro_client_get_region_memory (KiroClient *self, guint region)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn)
+        return NULL;
+
+    struct ibv_mr *peer_mr;
+    struct kiro_rdma_mem *local;
+
+    G_LOCK (sync_lock);
+    gboolean found = get_region (priv, region, &peer_mr, &local);
+    G_UNLOCK (sync_lock);
+    return found ? local->mem : NULL;
+}
+
+
+size_t
+kiro_client_get_region_size (KiroClient *self, guint region)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
+
+    if (!priv->conn)
+        return 0;
+
+    size_t size = 0;
+    G_LOCK (sync_lock);
+    if (region == 0) {
+        struct kiro_connection_context *ctx = (struct kiro_connection_context *)priv->conn->context;
+        size = ctx->rdma_mr ? ctx->rdma_mr->size : 0;
+    }
+    else {
+        struct kiro_client_region *r = find_region (priv, region);
+        size = r ? r->peer_mr.length : 0;
+    }
+    G_UNLOCK (sync_lock);
+    return size;
+}
+
+
 void
 kiro_client_disconnect (KiroClient *self)
 {
@@ -757,17 +3252,22 @@ kiro_client_disconnect (KiroClient *self)
 
     KiroClientPrivate *priv = KIRO_CLIENT_GET_PRIVATE (self);
 
+    // Rails may outlive a main connection that failed during a sync
+    G_LOCK (sync_lock);
+    free_rails (priv);
+    G_UNLOCK (sync_lock);
+
     if (!priv->conn)
         return;
 
     //Shut down event listening
     priv->close_signal = TRUE;
+    uv_async_send(priv->uv_close_async);
     
     // Wait for the libuv event loop to stop running and unref all allocated memories for libuv
     while (uv_loop_alive(priv->uv_event_loop)) {};
     uv_unref((uv_handle_t *)priv->uv_recv_cq_fd_poll);
     uv_unref((uv_handle_t *)priv->uv_ec_fd_poll);
-    uv_unref((uv_handle_t *)priv->uv_idle_handle);
 
     // Ask the main thread to join (It probably already has, but we do it
     // anyways. Just in case!)
@@ -775,17 +3275,68 @@ kiro_client_disconnect (KiroClient *self)
     g_thread_unref (priv->main_thread);
     priv->main_thread = NULL;
 
+    // A handoff still uses the connection
+    if (priv->handoff_thread) {
+        g_thread_join (priv->handoff_thread);
+        priv->handoff_thread = NULL;
+    }
+
     priv->close_signal = FALSE;
 
     //kiro_destroy_connection does not free RDMA memory. Therefore, we need to
     //cache the memory pointer and free the memory afterwards manually
+    // The retired memory is registered with the protection domain of the
+    // connection. Release it while that is still around.
+    drop_retired_mirror (priv);
+    if (priv->push_mr)
+        ibv_dereg_mr (priv->push_mr);
+    priv->push_mr = NULL;
+    kiro_destroy_rdma_memory (priv->push_recv);
+    priv->push_recv = NULL;
+    priv->subscribed = FALSE;
+    g_list_free_full (priv->regions, (GDestroyNotify)drop_region);
+    priv->regions = NULL;
+    kiro_destroy_rdma_memory (priv->directory);
+    priv->directory = NULL;
+    memset (&priv->dir_peer_mr, 0, sizeof (struct ibv_mr));
+    g_atomic_int_set (&priv->regions_stale, 0);
+
+    g_mutex_lock (&priv->delta_lock);
+    forget_versions (priv);
+    g_mutex_unlock (&priv->delta_lock);
+
+    // The buffers are registered with the protection domain of the
+    // connection. Snapshots that are still acquired become invalid.
+    g_mutex_lock (&priv->buffer_lock);
+    free_buffers (priv);
+    g_mutex_unlock (&priv->buffer_lock);
+
+    g_mutex_lock (&priv->cache_lock);
+    free_cache (priv);
+    g_mutex_unlock (&priv->cache_lock);
+
     struct kiro_connection_context *ctx = (struct kiro_connection_context *) (priv->conn->context);
     void *rdma_mem = ctx->rdma_mr->mem;
+    if (priv->lazy) {
+        // The chunks are registered with the protection domain of the
+        // connection
+        lazy_mirror_free (priv->lazy);
+        priv->lazy = NULL;
+        rdma_mem = NULL;
+    }
     kiro_destroy_connection (&(priv->conn));
     free (rdma_mem);
 
     // priv->ec is just an easy-access pointer. Don't free it. Just NULL it
     priv->ec = NULL;
+
+    // Wake up anyone still waiting for an update. They will notice the
+    // missing connection.
+    g_mutex_lock (&priv->update_lock);
+    priv->update_sequence = 0;
+    priv->update_requested = FALSE;
+    g_cond_broadcast (&priv->update_cond);
+    g_mutex_unlock (&priv->update_lock);
     g_message ("Client disconnected from server");
 }
 
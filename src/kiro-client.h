@@ -61,6 +61,25 @@ struct _KiroClientClass {
 };
 
 
+/**
+ * KiroSyncRange:
+ * @remote_offset: remote read offset in bytes
+ * @size: ammount of bytes to read
+ * @local_offset: offset for the storage in the local buffer
+ *
+ * Describes one memory range for kiro_client_sync_batch.
+ */
+struct KiroSyncRange {
+    gulong remote_offset;
+    gulong size;
+    gulong local_offset;
+};
+
+
+typedef gboolean KiroContinueFlag;
+#define KIRO_CALLBACK_CONTINUE TRUE
+#define KIRO_CALLBACK_REMOVE FALSE
+
 
 /* GObject and GType functions */
 GType       kiro_client_get_type            (void);
@@ -97,6 +116,56 @@ void        kiro_client_free                (KiroClient *client);
 
 /* client functions */
 
+/**
+ * kiro_client_set_lazy_mirror:
+ * @client: (transfer none): The #KiroClient to configure
+ * @lazy: Whether the local mirror of the server memory should be lazy
+ * @max_resident: Maximum size in bytes of the populated part of a lazy
+ *   mirror, or 0 for no limit
+ *
+ *   A lazy mirror only reserves address space for the server memory when
+ *   connecting. Memory is populated and registered in chunks of 4 MiB when
+ *   a sync first reads into them. Once more than @max_resident bytes are
+ *   populated, the least recently read chunks are evicted again. Attaching to
+ *   a huge server memory therefore costs only as much RAM as is actually read.
+ *
+ * Returns:
+ *   0 if successful, -1 if the @client is connected
+ * Note:
+ *   Parts of the mirror that were never read, or that were evicted, read as
+ *   zero. A lazy mirror can't be subscribed with kiro_client_subscribe.
+ * See also:
+ *   kiro_client_evict, kiro_client_get_resident_size
+ */
+int         kiro_client_set_lazy_mirror     (KiroClient *client, gboolean lazy, gulong max_resident);
+
+/**
+ * kiro_client_evict:
+ * @client: (transfer none): The #KiroClient with a lazy mirror
+ * @offset: Offset in bytes of the range to evict
+ * @size: Size in bytes of the range to evict. 0 for 'until end'
+ *
+ *   Gives the memory of all chunks of the lazy mirror that lie completely
+ *   within the range back to the system.
+ *
+ * Returns:
+ *   0 if successful, -1 if the @client has no lazy mirror
+ * See also:
+ *   kiro_client_set_lazy_mirror
+ */
+int         kiro_client_evict               (KiroClient *client, gulong offset, gulong size);
+
+/**
+ * kiro_client_get_resident_size:
+ * @client: (transfer none): The #KiroClient to query
+ *
+ * Returns: The size in bytes of the populated part of the local mirror. This
+ *   is the full memory size unless the mirror is lazy.
+ * See also:
+ *   kiro_client_set_lazy_mirror
+ */
+gulong      kiro_client_get_resident_size   (KiroClient *client);
+
 /**
  * kiro_client_connect:
  * @client: (transfer none): The #KiroClient to connect
@@ -178,6 +247,396 @@ int         kiro_client_sync                (KiroClient *client);
  */
 int         kiro_client_sync_partial        (KiroClient *client, gulong remote_offset, gulong size, gulong local_offset);
 
+/**
+ * kiro_client_sync_batch:
+ * @client: (transfer none): The #KiroClient to use sync on
+ * @ranges: (array length=count): The memory ranges to read
+ * @count: Number of elements in @ranges
+ *
+ *   Like kiro_client_sync_partial, but reads any number of memory ranges at
+ *   once. The ranges are posted as chains of RDMA_READs of which only the
+ *   last one is signaled. Several chains are kept in flight, so even large
+ *   batches cost little more than a single round trip.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * Note:
+ *   The ranges are read in the order they are given. Memory that is changed
+ *   by the server while the batch is in flight may therefore be observed in
+ *   different states by different ranges. Reading a version or sequence
+ *   number last allows to detect this.
+ *   If any of the ranges exceeds the remote or local memory boundaries, no
+ *   range is read at all.
+ *See also:
+ *    kiro_client_sync_partial, kiro_client_get_memory
+ */
+int         kiro_client_sync_batch          (KiroClient *client, struct KiroSyncRange *ranges, guint count);
+
+/**
+ * kiro_client_sync_strided:
+ * @client: (transfer none): The #KiroClient to use sync on
+ * @remote_base: Remote offset of the first field in bytes
+ * @stride: Distance between two consecutive fields in bytes
+ * @field_size: Size of one field in bytes
+ * @count: Number of fields to read
+ * @local_dst: (allow-none): Memory to copy the fields to, or %NULL
+ *
+ *   Reads @count fields of @field_size bytes that are @stride bytes apart,
+ *   e.g. the header of every element of a remote #KiroTrb. All fields are
+ *   read with a single kiro_client_sync_batch, so scanning the fields of a
+ *   whole ring buffer costs about one round trip and transfers only the
+ *   fields themselves.
+ *   The fields are stored at their original offsets in the local memory. If
+ *   @local_dst is given, they are additionally copied there as a compact
+ *   array of @count * @field_size bytes.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * Note:
+ *   @local_dst does not need to be registered with the device. The data is
+ *   read into the (registered) client memory first and copied afterwards.
+ *   Unless the fields are contiguous, @count must not exceed %G_MAXUINT.
+ *See also:
+ *    kiro_client_sync_batch, kiro_client_sync_roi
+ */
+int         kiro_client_sync_strided        (KiroClient *client, gulong remote_base, gulong stride, gulong field_size,
+                                             gulong count, void *local_dst);
+
+/**
+ * kiro_client_sync_roi:
+ * @client: (transfer none): The #KiroClient to use sync on
+ * @x: First column of the region of interest
+ * @y: First row of the region of interest
+ * @width: Number of columns in the region of interest
+ * @height: Number of rows in the region of interest
+ * @row_stride: Size of one row of the remote image in bytes
+ * @elem_size: Size of one element (pixel) in bytes
+ * @local_dst: (allow-none): Memory to copy the region of interest to, or %NULL
+ *
+ *   Reads a rectangular region of interest out of a row-major image that is
+ *   stored at the beginning of the server memory. Every row of the rectangle
+ *   is read on its own, so only the rectangle is transferred and the whole
+ *   region costs about one round trip.
+ *   If @local_dst is given, the rows are read straight into it, packed to
+ *   @width * @elem_size bytes per row, and the local memory is left as it
+ *   is. Otherwise, the rows are stored at their original offsets in the
+ *   local memory, as with kiro_client_sync_strided.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * Note:
+ *   @local_dst does not need to be registered with the device. It is
+ *   registered for the duration of the call, which pins its pages. Rows that
+ *   are larger than a single RDMA_READ can transfer go through the local
+ *   memory instead.
+ *See also:
+ *    kiro_client_sync_strided, kiro_client_get_memory
+ */
+int         kiro_client_sync_roi            (KiroClient *client, gulong x, gulong y, gulong width, gulong height,
+                                             gulong row_stride, gulong elem_size, void *local_dst);
+
+/**
+ * kiro_client_add_rail:
+ * @client: (transfer none): The #KiroClient to add the rail to
+ * @local_address: (allow-none): Local address to connect from, or %NULL
+ * @address: The address of the server, as reachable through this rail
+ * @port: The port of the server
+ *
+ *   Opens an additional connection ('rail') to the server the client is
+ *   connected to. Using a different @local_address per rail puts the rails on
+ *   different ports or devices of the local host. Syncs of the main memory
+ *   that are larger than two megabytes are then split into stripes, which are
+ *   read through the main connection and all rails in parallel. The sync
+ *   completes once all stripes have been read.
+ *
+ * Returns:
+ *   0 if successful, -1 if the rail could not be connected or the client
+ *   uses a lazy mirror
+ * Note:
+ *   Only kiro_client_sync and kiro_client_sync_partial are striped. Rails
+ *   are dropped by the server when it reallocates its memory, and are dialed
+ *   again before the next sync of the main memory. Syncs of other threads
+ *   are not held off while the rails are dialed. If a rail fails, its stripe
+ *   is read through the main connection instead. All rails are closed by
+ *   kiro_client_disconnect.
+ *   Rails are refused for a lazy mirror (see kiro_client_set_lazy_mirror),
+ *   since they would register the whole mirror and thereby populate it.
+ *See also:
+ *    kiro_client_get_rail_count, kiro_client_sync
+ */
+int         kiro_client_add_rail            (KiroClient *client, const char *local_address, const char *address,
+                                             const char *port);
+
+/**
+ * kiro_client_get_rail_count:
+ * @client: (transfer none): The #KiroClient to query
+ *
+ * Returns:
+ *   The number of rails that are currently connected, not counting the main
+ *   connection
+ *See also:
+ *    kiro_client_add_rail
+ */
+guint       kiro_client_get_rail_count      (KiroClient *client);
+
+/**
+ * kiro_client_sync_delta:
+ * @client: (transfer none): The #KiroClient to use sync on
+ *
+ *   Like kiro_client_sync, but only reads the parts of the server memory that
+ *   have changed since the last delta sync. The server reports changes with
+ *   kiro_server_mark_dirty. The @client first reads the block versions of
+ *   the server and then fetches all changed blocks in one batch.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * Note:
+ *   The first delta sync reads the whole memory, and so does every delta sync
+ *   after the server has reallocated its memory. If the server never marked
+ *   anything dirty, every delta sync is a full kiro_client_sync.
+ *   Changes that are not reported with kiro_server_mark_dirty are missed.
+ *See also:
+ *    kiro_server_mark_dirty, kiro_client_sync_batch
+ */
+int         kiro_client_sync_delta          (KiroClient *client);
+
+/**
+ * kiro_client_sync_consistent:
+ * @client: (transfer none): The #KiroClient to use sync on
+ *
+ *   Like kiro_client_sync, but makes sure that the local memory holds a
+ *   consistent snapshot of the server memory. The @client reads the sequence
+ *   counter of the server, the memory and then the counter again. If the
+ *   counter changed in between, a write overlapped the read and the memory
+ *   is read again.
+ *
+ * Returns:
+ *   0 if a consistent snapshot was read, 1 if the server kept writing and
+ *   no consistent snapshot could be read after several tries, -1 in case of
+ *   synchronisation error
+ * Note:
+ *   The server must bracket its writes with kiro_server_write_begin and
+ *   kiro_server_write_end. If it never did, this is a plain kiro_client_sync
+ *   without any guarantee. After a return value of 1, the local memory may
+ *   hold a torn snapshot.
+ *See also:
+ *    kiro_server_write_begin, kiro_client_sync
+ */
+int         kiro_client_sync_consistent     (KiroClient *client);
+
+/**
+ * kiro_client_set_buffers:
+ * @client: (transfer none): The #KiroClient to configure
+ * @count: Number of mirror buffers. 0 to disable them
+ *
+ *   Sets up @count additional mirror buffers for kiro_client_sync_snapshot.
+ *   Each snapshot lands in a buffer of its own, so one snapshot can be
+ *   processed while the next one is transferred. The buffers are allocated
+ *   on first use.
+ *
+ * Returns:
+ *   0 if successful, -1 if snapshots are still in use
+ * Note:
+ *   With N buffers, at most N-1 snapshots should be held at the same time,
+ *   so there is always a buffer left for the next sync. The buffers are
+ *   freed when the @client disconnects, but their number is kept.
+ *See also:
+ *    kiro_client_sync_snapshot, kiro_client_acquire_snapshot
+ */
+int         kiro_client_set_buffers         (KiroClient *client, guint count);
+
+/**
+ * kiro_client_sync_snapshot:
+ * @client: (transfer none): The #KiroClient to use sync on
+ *
+ *   Reads the whole server memory into the oldest mirror buffer that nobody
+ *   holds and makes it the newest snapshot. The snapshot is acquired for the
+ *   caller, who must hand it back with kiro_client_release_snapshot.
+ *
+ * Returns:
+ *   The handle of the new snapshot, or -1 if all buffers are in use or in
+ *   case of synchronisation error
+ * Note:
+ *   The memory returned by kiro_client_get_memory is not touched.
+ *   Several threads may sync snapshots at the same time.
+ *See also:
+ *    kiro_client_set_buffers, kiro_client_get_snapshot_memory
+ */
+gint        kiro_client_sync_snapshot       (KiroClient *client);
+
+/**
+ * kiro_client_acquire_snapshot:
+ * @client: (transfer none): The #KiroClient to query
+ *
+ *   Acquires the newest complete snapshot. It is not overwritten until it is
+ *   released again.
+ *
+ * Returns:
+ *   The handle of the snapshot, or -1 if there is none
+ *See also:
+ *    kiro_client_release_snapshot, kiro_client_sync_snapshot
+ */
+gint        kiro_client_acquire_snapshot    (KiroClient *client);
+
+/**
+ * kiro_client_release_snapshot:
+ * @client: (transfer none): The #KiroClient the snapshot belongs to
+ * @handle: Handle of an acquired snapshot
+ *
+ *   Hands the snapshot back. Its buffer is reused once nobody holds it any
+ *   more.
+ *
+ *See also:
+ *    kiro_client_acquire_snapshot, kiro_client_sync_snapshot
+ */
+void        kiro_client_release_snapshot    (KiroClient *client, gint handle);
+
+/**
+ * kiro_client_get_snapshot_memory:
+ * @client: (transfer none): The #KiroClient the snapshot belongs to
+ * @handle: Handle of an acquired snapshot
+ *
+ * Returns: (transfer none): A pointer to the memory of the snapshot, or %NULL
+ *   if @handle is not acquired
+ *See also:
+ *    kiro_client_get_snapshot_size
+ */
+void*       kiro_client_get_snapshot_memory (KiroClient *client, gint handle);
+
+/**
+ * kiro_client_get_snapshot_size:
+ * @client: (transfer none): The #KiroClient the snapshot belongs to
+ * @handle: Handle of an acquired snapshot
+ *
+ * Returns: The size in bytes of the snapshot, or 0 if @handle is not
+ *   acquired. Snapshots taken before the server reallocated its memory keep
+ *   their old size.
+ *See also:
+ *    kiro_client_get_snapshot_memory
+ */
+size_t      kiro_client_get_snapshot_size   (KiroClient *client, gint handle);
+
+/**
+ * kiro_client_set_cache:
+ * @client: (transfer none): The #KiroClient to configure
+ * @num_pages: Capacity of the cache in pages. 0 to disable the cache
+ * @page_size: Size in bytes of a page. Must divide 64 KiB
+ *
+ *   Sets up a cache for kiro_client_read that keeps the @num_pages most
+ *   recently read pages of the server memory. Everything that was cached
+ *   before is dropped.
+ *
+ * Returns:
+ *   0 if successful, -1 if @page_size is not supported
+ *See also:
+ *    kiro_client_read, kiro_client_get_cache_stats
+ */
+int         kiro_client_set_cache           (KiroClient *client, guint num_pages, gulong page_size);
+
+/**
+ * kiro_client_read:
+ * @client: (transfer none): The #KiroClient to read from
+ * @offset: Offset in bytes of the range within the server memory
+ * @size: Size in bytes of the range
+ * @dest: (transfer none): Memory of at least @size bytes to copy the range to
+ *
+ *   Copies a range of the server memory to @dest. Pages that are cached and
+ *   unchanged are copied from the cache. All other pages of the range are
+ *   fetched in one batch and cached. Whether a page has changed is decided
+ *   by the block versions the server keeps with kiro_server_mark_dirty, which
+ *   costs one small read per call.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * Note:
+ *   If the server does not keep block versions, every page is fetched. A
+ *   range that is larger than the cache is read through the memory of
+ *   kiro_client_get_memory instead.
+ *See also:
+ *    kiro_client_set_cache, kiro_server_mark_dirty
+ */
+int         kiro_client_read                (KiroClient *client, gulong offset, gulong size, void *dest);
+
+/**
+ * kiro_client_get_cache_stats:
+ * @client: (transfer none): The #KiroClient to query
+ * @hits: (out) (allow-none): Number of pages that were served from the cache
+ * @misses: (out) (allow-none): Number of pages that had to be fetched
+ *
+ *   Returns the statistics of the cache since it was set up.
+ *
+ *See also:
+ *    kiro_client_set_cache
+ */
+void        kiro_client_get_cache_stats     (KiroClient *client, guint64 *hits, guint64 *misses);
+
+/**
+ * kiro_client_lookup_region:
+ * @client: (transfer none): The #KiroClient to perform the operation on
+ * @name: (transfer none): Name of the region
+ *
+ *   Looks up a region that the server has added by kiro_server_add_region.
+ *   The region directory of the server is read again if the server has
+ *   reported a change since the last lookup.
+ *
+ * Returns:
+ *   The ID of the region, or -1 if the server provides no such region
+ * See also:
+ *   kiro_client_sync_region, kiro_client_get_region_memory
+ */
+gint        kiro_client_lookup_region       (KiroClient *client, const gchar *name);
+
+/**
+ * kiro_client_sync_region:
+ * @client: (transfer none): The #KiroClient to use sync on
+ * @region: ID of the region to read
+ *
+ *   Like kiro_client_sync, but reads the region with the given ID. Region 0 is
+ *   the main memory of the server.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * See also:
+ *   kiro_client_lookup_region, kiro_client_sync_region_partial
+ */
+int         kiro_client_sync_region         (KiroClient *client, guint region);
+
+/**
+ * kiro_client_sync_region_partial:
+ * @client: (transfer none): The #KiroClient to use sync on
+ * @region: ID of the region to read
+ * @remote_offset: remote read offset in bytes
+ * @size: ammount of bytes to read. 0 for 'until end'
+ * @local_offset: offset for the storage in the local buffer of the region
+ *
+ *   Like kiro_client_sync_partial, but reads from the region with the given
+ *   ID.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * Note:
+ *   If the server has removed the region, -1 is returned without reading.
+ * See also:
+ *   kiro_client_lookup_region, kiro_client_get_region_memory
+ */
+int         kiro_client_sync_region_partial (KiroClient *client, guint region, gulong remote_offset, gulong size, gulong local_offset);
+
+/**
+ * kiro_client_sync_region_batch:
+ * @client: (transfer none): The #KiroClient to use sync on
+ * @region: ID of the region to read
+ * @ranges: (array length=count): The memory ranges to read
+ * @count: Number of elements in @ranges
+ *
+ *   Like kiro_client_sync_batch, but reads from the region with the given ID.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of synchronisation error
+ * See also:
+ *   kiro_client_sync_batch, kiro_client_lookup_region
+ */
+int         kiro_client_sync_region_batch   (KiroClient *client, guint region, struct KiroSyncRange *ranges, guint count);
+
 /**
  * kiro_client_ping_server:
  * @client: (transfer none): The #KiroServer to send the PING from
@@ -192,6 +651,162 @@ int         kiro_client_sync_partial        (KiroClient *client, gulong remote_o
  */
 gint        kiro_client_ping_server         (KiroClient *client);
 
+/**
+ * kiro_client_wait_update:
+ * @client: (transfer none): The #KiroClient to wait on
+ * @known: The latest sequence number of the server memory the caller knows of
+ * @timeout_ms: Maximum time to wait in milliseconds
+ *
+ *   Blocks until the connected #KiroServer reports an update of its memory
+ *   with a sequence number larger than @known, or until @timeout_ms have
+ *   passed. The server reports updates when kiro_server_notify_update is
+ *   called on it.
+ *
+ * Returns:
+ *   1 if an update was reported, 0 if the timeout expired and -1 in case of
+ *   error
+ * Note:
+ *   The notification is requested from the server only once per update, so
+ *   waiting does not cause any network traffic while the server memory does
+ *   not change. If the server does not report updates at all, this function
+ *   will always time out. Callers should therefore still synchronize after a
+ *   timeout.
+ * See also:
+ *   kiro_server_notify_update, kiro_client_sync_partial
+ */
+int         kiro_client_wait_update         (KiroClient *client, uint64_t known, gint timeout_ms);
+
+/**
+ * kiro_client_get_update_sequence:
+ * @client: (transfer none): The #KiroClient to query
+ *
+ *   Returns the latest sequence number the connected #KiroServer reported
+ *   with an update notification.
+ *
+ * Returns:
+ *   The latest reported sequence number, or 0 if no update was reported yet
+ * See also:
+ *   kiro_client_wait_update, kiro_server_notify_update
+ */
+uint64_t    kiro_client_get_update_sequence (KiroClient *client);
+
+/**
+ * kiro_client_get_update_range:
+ * @client: (transfer none): The #KiroClient to query
+ * @offset: (out) (allow-none): Offset in bytes of the changed range
+ * @size: (out) (allow-none): Size in bytes of the changed range
+ *
+ *   Returns the range of the server memory that changed with the latest
+ *   update the connected #KiroServer reported.
+ *
+ * Note:
+ *   The range covers the whole memory if the server did not give one (see
+ *   kiro_server_notify_update_range) or if the @client missed updates.
+ * See also:
+ *   kiro_client_get_update_sequence, kiro_client_sync_partial
+ */
+void        kiro_client_get_update_range    (KiroClient *client, gulong *offset, gulong *size);
+
+/**
+ * KiroClientUpdateCallbackFunc:
+ * @sequence: Sequence number of the update
+ * @offset: Offset in bytes of the changed range of the server memory
+ * @size: Size in bytes of the changed range
+ * @user_data: (transfer none): The #user_data which was provided during
+ *   registration of this callback
+ *
+ *   Defines the type of a callback function which will be invoked every time
+ *   the connected #KiroServer reports an update of its memory.
+ *
+ * Returns: A #KiroContinueFlag deciding whether to keep this callback alive or not
+ * See also:
+ *   kiro_client_add_update_callback, kiro_client_remove_update_callback
+ */
+typedef KiroContinueFlag (*KiroClientUpdateCallbackFunc) (uint64_t sequence, gulong offset, gulong size, void *user_data);
+
+/**
+ * kiro_client_add_update_callback:
+ * @client: (transfer none): The #KiroClient to register this callback to
+ * @callback: (transfer none) (scope call): A function pointer to the callback function
+ * @user_data: (transfer none): Data handed to every invocation of @callback
+ *
+ *   Adds a #KiroClientUpdateCallbackFunc to this #KiroClient.
+ *
+ * Returns: The internal id of the registerd callback, or 0 in case of error
+ * Note:
+ *   The callbacks run on the event loop of the @client and should return
+ *   quickly. While there is at least one callback, the @client asks the
+ *   server for the next update as soon as it gets one, so no polling or
+ *   kiro_client_wait_update is needed. Updates that happen in quick
+ *   succession may be reported as one.
+ * See also:
+ *   kiro_client_remove_update_callback, kiro_server_notify_update_range
+ */
+gulong      kiro_client_add_update_callback (KiroClient *client, KiroClientUpdateCallbackFunc callback, void *user_data);
+
+/**
+ * kiro_client_remove_update_callback:
+ * @client: (transfer none): The #KiroClient to remove the callback from
+ * @id: The id of the callback to be removed
+ *
+ * Returns: A #gboolean. %TRUE if the callback was found and removed. %FALSE
+ *   otherwise
+ * See also:
+ *   kiro_client_add_update_callback
+ */
+gboolean    kiro_client_remove_update_callback (KiroClient *client, gulong id);
+
+/**
+ * kiro_client_subscribe:
+ * @client: (transfer none): The #KiroClient to subscribe
+ *
+ *   Switches the @client to push mode. The server is given write access to
+ *   the memory of the @client, and every kiro_server_publish on the server
+ *   writes the published range directly into it. No sync is needed to see
+ *   the published data.
+ *
+ * Returns:
+ *   0 if successful, -1 in case of error
+ * Note:
+ *   The subscription stays in place until the @client disconnects. It is
+ *   renewed automatically when the server reallocates its memory.
+ * See also:
+ *   kiro_client_wait_push, kiro_server_publish
+ */
+int         kiro_client_subscribe           (KiroClient *client);
+
+/**
+ * kiro_client_wait_push:
+ * @client: (transfer none): The subscribed #KiroClient to wait on
+ * @known: The latest push sequence number the caller knows of
+ * @timeout_ms: Maximum time to wait in milliseconds
+ *
+ *   Blocks until the server has pushed data with a sequence number larger
+ *   than @known, or until @timeout_ms have passed. Once this returns 1, the
+ *   pushed data is already in the memory of the @client.
+ *
+ * Returns:
+ *   1 if a push has arrived, 0 if the timeout expired and -1 in case of error
+ * See also:
+ *   kiro_client_subscribe, kiro_client_get_push_sequence
+ */
+int         kiro_client_wait_push           (KiroClient *client, uint64_t known, gint timeout_ms);
+
+/**
+ * kiro_client_get_push_sequence:
+ * @client: (transfer none): The #KiroClient to query
+ *
+ *   Every kiro_server_publish increments the push sequence number of the
+ *   server by one.
+ *
+ * Returns:
+ *   The sequence number of the last push that has arrived, or 0 if there was
+ *   none yet
+ * See also:
+ *   kiro_client_wait_push
+ */
+uint64_t    kiro_client_get_push_sequence   (KiroClient *client);
+
 /**
  * kiro_client_get_memory:
  * @client: (transfer none): The #KiroClient to get the memory from
@@ -200,12 +815,14 @@ gint        kiro_client_ping_server         (KiroClient *client);
  *    from the server.
  *
  * Note:
- *    The server can instruct the client to reallocate memory on the next
- *    occurrence of kiro_client_sync(), freeing the old memory. Also, calling
- *    kiro_client_free() will free the client memory as well. If you need to
- *    make sure that the memory from the @client remains accessible after
- *    calling sync and/or free, you need to memcpy() the memory using the
- *    information from kiro_client_get_memory() and
+ *    The server can instruct the client to reallocate its memory. The
+ *    client then switches to a new memory block in between two syncs, which
+ *    already holds the content of the new server memory. The old block stays
+ *    valid until the next reallocation, so call kiro_client_get_memory()
+ *    again after every sync. Calling kiro_client_free() will free the client
+ *    memory as well. If you need to make sure that the memory from the
+ *    @client remains accessible after calling free, you need to memcpy() the
+ *    memory using the information from kiro_client_get_memory() and
  *    kiro_client_get_memory_size() first.
  *    The returned memory might under NO circumstances be freed by the user!
  * Returns: (transfer none):
@@ -232,6 +849,38 @@ void*       kiro_client_get_memory          (KiroClient *client);
  */
 size_t      kiro_client_get_memory_size     (KiroClient *client);
 
+/**
+ * kiro_client_get_region_memory:
+ * @client: (transfer none): The #KiroClient to get the memory from
+ * @region: ID of the region
+ *
+ *    Provides a pointer to the local memory of the given region. The memory
+ *    is allocated on first use, and filled by kiro_client_sync_region.
+ *
+ * Returns: (transfer none):
+ *    A pointer to the local memory of the region, or %NULL if the region is
+ *    not known
+ * Note:
+ *    The memory is freed once the server removes the region and the client
+ *    notices this during a lookup or sync. Region 0 is the same memory as
+ *    returned by kiro_client_get_memory.
+ * See also:
+ *    kiro_client_get_region_size, kiro_client_lookup_region
+ */
+void*       kiro_client_get_region_memory   (KiroClient *client, guint region);
+
+/**
+ * kiro_client_get_region_size:
+ * @client: (transfer none): The #KiroClient to get the memory size of
+ * @region: ID of the region
+ *
+ * Returns:
+ *    The size of the given region in bytes, or 0 if the region is not known
+ * See also:
+ *    kiro_client_get_region_memory
+ */
+size_t      kiro_client_get_region_size     (KiroClient *client, guint region);
+
 G_END_DECLS
 
 #endif //__KIRO_CLIENT_H
@@ -0,0 +1,684 @@
+/* Copyright (C) 2014-2015 Timo Dritschler <timo.dritschler@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "kiro-msb.h"
+#include "kiro-trb.h"
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+
+/*
+ * Definition of 'private' structures and members and macro to access them
+ */
+
+#define KIRO_MSB_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), KIRO_TYPE_MSB, KiroMsbPrivate))
+
+// Bounds for the fallback polling interval of a cloning KiroMsb (in ms)
+#define KIRO_MSB_POLL_MIN 1
+#define KIRO_MSB_POLL_MAX 100
+
+// Alignment of the ring buffers within the memory region
+#define KIRO_MSB_ALIGNMENT 64
+
+struct msb_channel {
+    gchar       name[KIRO_MSB_NAME_LENGTH];
+    gulong      element_size;   // Only used until the KiroMsb is served
+    guint       depth;          // Only used until the KiroMsb is served
+    uint64_t    offset;         // Offset of the ring buffer within the region
+    KiroTrb     *trb;           // Ring buffer on top of the region
+    gboolean    subscribed;     // Kept up to date by a 'cloning' KiroMsb
+    uint64_t    known;          // Local offset before the current sync cycle
+    uint64_t    fetching;       // Sequence number of the element in flight
+    gboolean    pending;        // An element is fetched in the current cycle
+};
+
+struct _KiroMsbPrivate {
+
+    /* Properties */
+    // PLACEHOLDER //
+
+    /* 'Real' private structures */
+    /* (Not accessible by properties) */
+    int         initialized;    // 0 if uninitialized, 1 if server, 2 if client
+    KiroServer* server;         // KIRO Server component to serve
+    KiroClient* client;         // KIRO Client component to clone
+    GArray      *channels;      // Array of struct msb_channel
+    void        *mem;           // Memory region of a 'serving' KiroMsb
+    gulong      mem_size;       // Size in bytes of the memory region
+
+    GMutex      push_lock;      // Keeps the update sequence numbers in order
+    uint64_t    pushes;         // Number of pushes to any of the channels
+
+    GThread     *main_thread;   // Main thread for the main_loop
+    GMainLoop   *main_loop;     // main_loop *duh*
+    guint       close_signal;   // Used to signal shutdown of the main_loop
+    gint        poll_timeout;   // Current fallback polling interval in ms
+    struct KiroSyncRange *ranges; // Scratch space for the batched reads
+
+    GHookList   callbacks;      // List of registerd callbacks
+};
+
+
+G_DEFINE_TYPE (KiroMsb, kiro_msb, G_TYPE_OBJECT);
+
+
+KiroMsb *
+kiro_msb_new (void)
+{
+    return g_object_new (KIRO_TYPE_MSB, NULL);
+}
+
+
+void
+kiro_msb_free (KiroMsb *msb)
+{
+    g_return_if_fail (msb != NULL);
+    if (KIRO_IS_MSB (msb))
+        g_object_unref (msb);
+    else
+        g_warning ("Trying to use kiro_msb_free on an object which is not a KIRO MSB. Ignoring...");
+}
+
+
+static void
+kiro_msb_init (KiroMsb *self)
+{
+    g_return_if_fail (self != NULL);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+    priv->initialized = 0;
+    priv->server = NULL;
+    priv->client = NULL;
+    priv->channels = g_array_new (FALSE, TRUE, sizeof (struct msb_channel));
+    priv->mem = NULL;
+    priv->mem_size = 0;
+    priv->pushes = 0;
+    priv->ranges = NULL;
+    priv->poll_timeout = KIRO_MSB_POLL_MIN;
+    g_mutex_init (&priv->push_lock);
+    g_hook_list_init (&(priv->callbacks), sizeof (GHook));
+}
+
+
+static void
+kiro_msb_finalize (GObject *object)
+{
+    g_return_if_fail (object != NULL);
+    KiroMsb *self = KIRO_MSB (object);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    kiro_msb_stop (self);
+    g_array_free (priv->channels, TRUE);
+    g_mutex_clear (&priv->push_lock);
+
+    G_OBJECT_CLASS (kiro_msb_parent_class)->finalize (object);
+}
+
+
+static void
+kiro_msb_class_init (KiroMsbClass *klass)
+{
+    g_return_if_fail (klass != NULL);
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = kiro_msb_finalize;
+    g_type_class_add_private (klass, sizeof (KiroMsbPrivate));
+}
+
+
+static struct msb_channel *
+get_channel (KiroMsbPrivate *priv, guint channel)
+{
+    if (channel >= priv->channels->len)
+        return NULL;
+    return &g_array_index (priv->channels, struct msb_channel, channel);
+}
+
+
+static void
+free_channels (KiroMsbPrivate *priv)
+{
+    for (guint i = 0; i < priv->channels->len; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        if (ch->trb) {
+            // The memory belongs to the whole region
+            kiro_trb_purge (ch->trb, FALSE);
+            kiro_trb_free (ch->trb);
+        }
+    }
+    g_array_set_size (priv->channels, 0);
+}
+
+
+void
+kiro_msb_stop (KiroMsb *self)
+{
+    g_return_if_fail (self != NULL);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    if (priv->initialized == 1) {
+        kiro_server_free (priv->server);
+        free_channels (priv);
+        g_free (priv->mem);
+    }
+
+    if (priv->initialized == 2) {
+        priv->close_signal = TRUE;
+        g_thread_join (priv->main_thread);
+        g_thread_unref (priv->main_thread);
+        priv->main_thread = NULL;
+
+        kiro_client_free (priv->client);
+        free_channels (priv);
+        g_free (priv->ranges);
+    }
+
+    // Channels that were added, but never served, are dropped as well
+    g_array_set_size (priv->channels, 0);
+    g_hook_list_clear (&(priv->callbacks));
+
+    priv->server = NULL;
+    priv->client = NULL;
+    priv->mem = NULL;
+    priv->mem_size = 0;
+    priv->ranges = NULL;
+    priv->pushes = 0;
+    priv->initialized = 0;
+}
+
+
+gint
+kiro_msb_add_channel (KiroMsb *self, const gchar *name, gulong element_size, guint depth)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (name != NULL, -1);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 0, -1);
+
+    if (element_size < 1 || depth < 1) {
+        g_warning ("Channel '%s' needs a non-zero element size and depth", name);
+        return -1;
+    }
+
+    if (strlen (name) >= KIRO_MSB_NAME_LENGTH) {
+        g_warning ("Channel name '%s' is too long", name);
+        return -1;
+    }
+
+    if (kiro_msb_lookup (self, name) >= 0) {
+        g_warning ("Channel '%s' already exists", name);
+        return -1;
+    }
+
+    struct msb_channel ch;
+    memset (&ch, 0, sizeof (struct msb_channel));
+    g_strlcpy (ch.name, name, KIRO_MSB_NAME_LENGTH);
+    ch.element_size = element_size;
+    ch.depth = depth;
+    g_array_append_val (priv->channels, ch);
+
+    return priv->channels->len - 1;
+}
+
+
+gboolean
+kiro_msb_serve (KiroMsb *self, const gchar *addr, const gchar *port)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 0, FALSE);
+
+    guint num = priv->channels->len;
+    if (num == 0) {
+        g_warning ("Can't serve a KiroMsb without channels");
+        return FALSE;
+    }
+
+    // Lay out the directory and the ring buffers
+    uint64_t dir_size = sizeof (struct KiroMsbDirectory) + (num * sizeof (struct KiroMsbChannelInfo));
+    uint64_t offset = dir_size;
+    for (guint i = 0; i < num; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        offset = (offset + KIRO_MSB_ALIGNMENT - 1) & ~((uint64_t)KIRO_MSB_ALIGNMENT - 1);
+        ch->offset = offset;
+        offset += sizeof (struct KiroTrbInfo) + ((uint64_t)ch->element_size * ch->depth);
+    }
+
+    priv->mem_size = offset;
+    priv->mem = g_try_malloc0 (priv->mem_size);
+    if (!priv->mem) {
+        g_critical ("Failed to allocate %lu bytes for the KiroMsb", priv->mem_size);
+        return FALSE;
+    }
+
+    struct KiroMsbDirectory *dir = (struct KiroMsbDirectory *)priv->mem;
+    struct KiroMsbChannelInfo *info = (struct KiroMsbChannelInfo *)(dir + 1);
+    dir->num_channels = num;
+    dir->size = dir_size;
+
+    for (guint i = 0; i < num; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        struct KiroTrbInfo *header = (struct KiroTrbInfo *)(priv->mem + ch->offset);
+        header->buffer_size_bytes = sizeof (struct KiroTrbInfo) + ((uint64_t)ch->element_size * ch->depth);
+        header->element_size = ch->element_size;
+        header->offset = 0;
+        header->meta_size = 0;
+        header->version = KIRO_TRB_VERSION;
+
+        g_strlcpy (info[i].name, ch->name, KIRO_MSB_NAME_LENGTH);
+        info[i].offset = ch->offset;
+        info[i].size = header->buffer_size_bytes;
+
+        ch->trb = kiro_trb_new ();
+        kiro_trb_adopt (ch->trb, header);
+    }
+
+    const gchar *port_internal = port ? port : "60010";
+
+    priv->server = kiro_server_new ();
+    if (0 > kiro_server_start (priv->server, addr, port_internal, priv->mem, priv->mem_size)) {
+        g_debug ("Failed to start KIRO Server");
+        kiro_server_free (priv->server);
+        priv->server = NULL;
+        for (guint i = 0; i < num; i++) {
+            struct msb_channel *ch = get_channel (priv, i);
+            kiro_trb_purge (ch->trb, FALSE);
+            kiro_trb_free (ch->trb);
+            ch->trb = NULL;
+        }
+        g_free (priv->mem);
+        priv->mem = NULL;
+        return FALSE;
+    }
+
+    priv->initialized = 1;
+    g_message ("Multi SyncBuffer with %u channels ready", num);
+    return TRUE;
+}
+
+
+static gpointer
+start_main_loop (GMainLoop *loop)
+{
+    g_main_loop_run (loop);
+    g_main_loop_unref (loop);
+    return NULL;
+}
+
+
+static gboolean
+invoke_marshaller (GHook *hook, gpointer data)
+{
+    return ((KiroMsbCallbackFunc)hook->func) (GPOINTER_TO_UINT (data), hook->data);
+}
+
+
+/*
+ * One sync cycle of a 'cloning' KiroMsb: Read the headers of all subscribed
+ * channels in one batch, then fetch the newest element of every changed
+ * channel in a second batch. The headers of the changed channels are read
+ * again at the end of the second batch, so elements that were overwritten
+ * while they were fetched can be told apart. These are fetched again in the
+ * next cycle.
+ */
+static gboolean
+idle_func (KiroMsbPrivate *priv)
+{
+    if (priv->close_signal) {
+        g_main_loop_quit (priv->main_loop);
+        priv->main_loop = NULL;
+        g_debug ("Main loop quit");
+        return G_SOURCE_REMOVE;
+    }
+
+    void *mem = kiro_client_get_memory (priv->client);
+    if (!mem) {
+        // Connection to the server was lost
+        g_usleep (KIRO_MSB_POLL_MAX * 1000);
+        return G_SOURCE_CONTINUE;
+    }
+
+    // Anything the server reports after this point will wake us up again
+    uint64_t seen = kiro_client_get_update_sequence (priv->client);
+
+    guint num = 0;
+    for (guint i = 0; i < priv->channels->len; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        if (!ch->subscribed)
+            continue;
+        // The offset of a TRB is kept in its header, which is overwritten by
+        // the read below
+        ch->known = kiro_trb_get_offset (ch->trb);
+        priv->ranges[num].remote_offset = priv->ranges[num].local_offset = ch->offset;
+        priv->ranges[num++].size = sizeof (struct KiroTrbInfo);
+    }
+
+    if (0 > kiro_client_sync_batch (priv->client, priv->ranges, num)) {
+        g_usleep (KIRO_MSB_POLL_MAX * 1000);
+        return G_SOURCE_CONTINUE;
+    }
+
+    // Queue the newest element of every changed channel
+    guint changed = 0;
+    num = 0;
+    for (guint i = 0; i < priv->channels->len; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        ch->pending = FALSE;
+        if (!ch->subscribed)
+            continue;
+
+        struct KiroTrbInfo *header = (struct KiroTrbInfo *)(mem + ch->offset);
+        uint64_t target = header->offset;
+        uint64_t known = ch->known;
+        if (target == known)
+            continue;
+
+        if (target == 0) {
+            // The channel was flushed
+            kiro_trb_refresh (ch->trb);
+            continue;
+        }
+
+        header->offset = known;
+        ch->fetching = target - 1;
+        ch->pending = TRUE;
+        changed++;
+
+        void *element = kiro_trb_get_element (ch->trb, (glong)(ch->fetching - known));
+        priv->ranges[num].remote_offset = priv->ranges[num].local_offset = element - mem;
+        priv->ranges[num++].size = ch->element_size;
+    }
+
+    if (changed == 0) {
+        // Nothing new. Sleep until the server notifies us about the next push.
+        // In case the notification gets lost, poll again after a timeout that
+        // grows while nothing happens.
+        int rv = kiro_client_wait_update (priv->client, seen, priv->poll_timeout);
+        if (rv > 0)
+            priv->poll_timeout = KIRO_MSB_POLL_MIN;
+        else if (rv == 0)
+            priv->poll_timeout = MIN (priv->poll_timeout * 2, KIRO_MSB_POLL_MAX);
+        else
+            g_usleep (KIRO_MSB_POLL_MAX * 1000);
+        return G_SOURCE_CONTINUE;
+    }
+
+    for (guint i = 0; i < priv->channels->len; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        if (!ch->pending)
+            continue;
+        priv->ranges[num].remote_offset = priv->ranges[num].local_offset = ch->offset;
+        priv->ranges[num++].size = sizeof (struct KiroTrbInfo);
+    }
+
+    if (0 > kiro_client_sync_batch (priv->client, priv->ranges, num)) {
+        g_usleep (KIRO_MSB_POLL_MAX * 1000);
+        return G_SOURCE_CONTINUE;
+    }
+
+    for (guint i = 0; i < priv->channels->len; i++) {
+        struct msb_channel *ch = get_channel (priv, i);
+        if (!ch->pending)
+            continue;
+
+        struct KiroTrbInfo *header = (struct KiroTrbInfo *)(mem + ch->offset);
+        uint64_t remote = header->offset;
+        uint64_t max = kiro_trb_get_max_elements (ch->trb);
+
+        if (ch->fetching < remote && remote - ch->fetching < max) {
+            header->offset = ch->fetching + 1;
+            kiro_trb_refresh (ch->trb);
+            g_hook_list_marshal_check (&(priv->callbacks), FALSE, invoke_marshaller, GUINT_TO_POINTER (i));
+        }
+        else {
+            g_debug ("Torn read on channel '%s'. Retrying.", ch->name);
+            header->offset = ch->known;
+        }
+    }
+
+    priv->poll_timeout = KIRO_MSB_POLL_MIN;
+    return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean
+subscribe (KiroMsbPrivate *priv, const gchar * const *names)
+{
+    for (guint i = 0; i < priv->channels->len; i++)
+        get_channel (priv, i)->subscribed = (names == NULL);
+
+    for (; names && *names; names++) {
+        gboolean found = FALSE;
+        for (guint i = 0; i < priv->channels->len; i++) {
+            struct msb_channel *ch = get_channel (priv, i);
+            if (!g_strcmp0 (ch->name, *names)) {
+                ch->subscribed = TRUE;
+                found = TRUE;
+            }
+        }
+
+        if (!found) {
+            g_warning ("Remote KiroMsb has no channel '%s'", *names);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+static gboolean
+read_directory (KiroMsbPrivate *priv)
+{
+    void *mem = kiro_client_get_memory (priv->client);
+    gulong size = kiro_client_get_memory_size (priv->client);
+    struct KiroMsbDirectory *dir = (struct KiroMsbDirectory *)mem;
+
+    if (size < sizeof (struct KiroMsbDirectory) || dir->size > size
+        || dir->size != sizeof (struct KiroMsbDirectory) + (dir->num_channels * sizeof (struct KiroMsbChannelInfo))) {
+        g_warning ("Remote memory does not hold a valid KiroMsb directory");
+        return FALSE;
+    }
+
+    struct KiroMsbChannelInfo *info = (struct KiroMsbChannelInfo *)(dir + 1);
+    for (uint64_t i = 0; i < dir->num_channels; i++) {
+        struct KiroTrbInfo *header = (struct KiroTrbInfo *)(mem + info[i].offset);
+        // The channel has to hold at least one element, otherwise the TRB
+        // can't be set up from its header
+        if (info[i].offset < dir->size || info[i].offset + info[i].size > size
+            || info[i].size < sizeof (struct KiroTrbInfo) || header->buffer_size_bytes != info[i].size
+            || header->element_size == 0 || header->element_size > info[i].size - sizeof (struct KiroTrbInfo)) {
+            g_warning ("Entry %" G_GUINT64_FORMAT " of the remote KiroMsb directory is invalid", i);
+            free_channels (priv);
+            return FALSE;
+        }
+
+        struct msb_channel ch;
+        memset (&ch, 0, sizeof (struct msb_channel));
+        g_strlcpy (ch.name, info[i].name, KIRO_MSB_NAME_LENGTH);
+        ch.offset = info[i].offset;
+        ch.element_size = header->element_size;
+        ch.trb = kiro_trb_new ();
+        kiro_trb_adopt (ch.trb, header);
+        if (!kiro_trb_is_setup (ch.trb)) {
+            g_warning ("Channel '%s' of the remote KiroMsb can't be read", ch.name);
+            kiro_trb_purge (ch.trb, FALSE);
+            kiro_trb_free (ch.trb);
+            free_channels (priv);
+            return FALSE;
+        }
+        ch.depth = kiro_trb_get_max_elements (ch.trb);
+        g_array_append_val (priv->channels, ch);
+    }
+
+    return TRUE;
+}
+
+
+gboolean
+kiro_msb_clone (KiroMsb *self, const gchar *address, const gchar *port, const gchar * const *channels)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 0, FALSE);
+
+    // Channels added for serving don't apply to a clone
+    g_array_set_size (priv->channels, 0);
+
+    priv->client = kiro_client_new ();
+    if (0 > kiro_client_connect (priv->client, address, port)) {
+        g_debug ("Failed to connect to remote Multi Sync Buffer");
+        kiro_client_free (priv->client);
+        priv->client = NULL;
+        return FALSE;
+    }
+
+    kiro_client_sync (priv->client);
+    if (!read_directory (priv) || !subscribe (priv, channels)) {
+        free_channels (priv);
+        kiro_client_free (priv->client);
+        priv->client = NULL;
+        return FALSE;
+    }
+
+    // Worst case: one element and one header per channel in a single batch
+    priv->ranges = g_new0 (struct KiroSyncRange, 2 * priv->channels->len);
+    priv->close_signal = FALSE;
+    priv->poll_timeout = KIRO_MSB_POLL_MIN;
+
+    priv->main_loop = g_main_loop_new (NULL, FALSE);
+    g_idle_add ((GSourceFunc)idle_func, priv);
+    priv->main_thread = g_thread_new ("KIRO MSB Main Loop", (GThreadFunc)start_main_loop, priv->main_loop);
+
+    priv->initialized = 2;
+    return TRUE;
+}
+
+
+guint
+kiro_msb_get_channel_count (KiroMsb *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    return priv->channels->len;
+}
+
+
+gint
+kiro_msb_lookup (KiroMsb *self, const gchar *name)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (name != NULL, -1);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    for (guint i = 0; i < priv->channels->len; i++) {
+        if (!g_strcmp0 (get_channel (priv, i)->name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+
+const gchar *
+kiro_msb_get_channel_name (KiroMsb *self, guint channel)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    struct msb_channel *ch = get_channel (priv, channel);
+    return ch ? ch->name : NULL;
+}
+
+
+gulong
+kiro_msb_get_size (KiroMsb *self, guint channel)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    struct msb_channel *ch = get_channel (priv, channel);
+    return ch ? ch->element_size : 0;
+}
+
+
+gboolean
+kiro_msb_push (KiroMsb *self, guint channel, void *data_in)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 1, FALSE);
+
+    struct msb_channel *ch = get_channel (priv, channel);
+    g_return_val_if_fail (ch != NULL, FALSE);
+
+    if (0 > kiro_trb_push (ch->trb, data_in))
+        return FALSE;
+
+    // One sequence number for all channels. Clones figure out which channels
+    // have changed by reading the headers.
+    g_mutex_lock (&priv->push_lock);
+    priv->pushes++;
+    kiro_server_notify_update (priv->server, priv->pushes);
+    g_mutex_unlock (&priv->push_lock);
+
+    return TRUE;
+}
+
+
+void *
+kiro_msb_get_data (KiroMsb *self, guint channel)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    struct msb_channel *ch = get_channel (priv, channel);
+    g_return_val_if_fail (ch != NULL, NULL);
+
+    if (kiro_trb_get_offset (ch->trb) == 0)
+        return NULL;
+
+    return kiro_trb_get_element (ch->trb, -1);
+}
+
+
+gulong
+kiro_msb_add_callback (KiroMsb *self, KiroMsbCallbackFunc func, void *user_data)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    GHook *new_hook = g_hook_alloc (&(priv->callbacks));
+    new_hook->data = user_data;
+    new_hook->func = (gpointer)func;
+    g_hook_append (&(priv->callbacks), new_hook);
+    return new_hook->hook_id;
+}
+
+
+gboolean
+kiro_msb_remove_callback (KiroMsb *self, gulong hook_id)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroMsbPrivate *priv = KIRO_MSB_GET_PRIVATE (self);
+
+    return g_hook_destroy (&(priv->callbacks), hook_id);
+}
@@ -0,0 +1,301 @@
+/* Copyright (C) 2014-2015 Timo Dritschler <timo.dritschler@kit.edu>
+   (Karlsruhe Institute of Technology)
+
+   This library is free software; you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by the
+   Free Software Foundation; either version 2.1 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+   details.
+
+   You should have received a copy of the GNU Lesser General Public License along
+   with this library; if not, write to the Free Software Foundation, Inc., 51
+   Franklin St, Fifth Floor, Boston, MA 02110, USA
+*/
+
+/**
+ * SECTION: kiro-multi-sync-buffer
+ * @Short_description: KIRO 'Multi Channel Synchronizing Buffer'
+ * @Title: KiroMsb
+ *
+ * KiroMsb works like a #KiroSb, but serves any number of named channels over
+ * a single connection. Each channel is a ring buffer with its own element
+ * size. All channels live in one memory region, which starts with a directory
+ * of the channels. A 'cloning' #KiroMsb can subscribe to a subset of the
+ * channels and fetches the newest element of all changed channels in one
+ * batch of reads.
+ */
+
+#ifndef __KIRO_MSB_H
+#define __KIRO_MSB_H
+
+#include <stdint.h>
+#include <glib-object.h>
+#include "kiro-sb.h"
+
+G_BEGIN_DECLS
+
+#define KIRO_TYPE_MSB             (kiro_msb_get_type())
+#define KIRO_MSB(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), KIRO_TYPE_MSB, KiroMsb))
+#define KIRO_IS_MSB(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), KIRO_TYPE_MSB))
+#define KIRO_MSB_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), KIRO_TYPE_MSB, KiroMsbClass))
+#define KIRO_IS_MSB_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), KIRO_TYPE_MSB))
+#define KIRO_MSB_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj), KIRO_TYPE_MSB, KiroMsbClass))
+
+
+typedef struct _KiroMsb           KiroMsb;
+typedef struct _KiroMsbClass      KiroMsbClass;
+typedef struct _KiroMsbPrivate    KiroMsbPrivate;
+
+
+struct _KiroMsb {
+
+    GObject parent;
+
+};
+
+struct _KiroMsbClass {
+
+    GObjectClass parent_class;
+
+};
+
+
+// Maximum length of a channel name, including the terminating NUL
+#define KIRO_MSB_NAME_LENGTH 64
+
+/*
+ * The memory region of a #KiroMsb starts with this directory, followed by one
+ * KiroMsbChannelInfo per channel. The ring buffers of the channels follow
+ * after the directory.
+ */
+struct KiroMsbDirectory {
+
+    uint64_t num_channels;       // Number of KiroMsbChannelInfo entries
+    uint64_t size;               // Size in bytes of the directory INCLUDING all entries
+
+} __attribute__ ((packed));
+
+struct KiroMsbChannelInfo {
+
+    char     name[KIRO_MSB_NAME_LENGTH];    // NUL terminated name of the channel
+    uint64_t offset;             // Offset of the channels ring buffer within the region
+    uint64_t size;               // Size in bytes of the channels ring buffer
+
+} __attribute__ ((packed));
+
+
+/* GObject and GType functions */
+GType       kiro_msb_get_type           (void);
+
+/**
+ * kiro_msb_new:
+ *
+ *   Creates a new #KiroMsb and returns a pointer to it.
+ *
+ * Returns: (transfer full): A pointer to a new #KiroMsb
+ * See also:
+ *   kiro_msb_free
+ */
+KiroMsb*    kiro_msb_new                (void);
+
+/**
+ * kiro_msb_free:
+ * @msb: (transfer none): The #KiroMsb that is to be freed
+ *
+ *   Stops the @msb, clears all underlying memory and frees the object memory.
+ *
+ * See also:
+ *   kiro_msb_new, kiro_msb_stop
+ */
+void        kiro_msb_free               (KiroMsb *msb);
+
+/**
+ * kiro_msb_stop:
+ * @msb: (transfer none): The #KiroMsb to stop
+ *
+ *   The given #KiroMsb is stopped and all internal memory, including all of
+ *   its channels, is cleared. It is put back into its initial state.
+ *
+ * See also:
+ *   kiro_msb_serve, kiro_msb_clone
+ */
+void        kiro_msb_stop               (KiroMsb *msb);
+
+/**
+ * kiro_msb_add_channel:
+ * @msb: (transfer none): The #KiroMsb to add the channel to
+ * @name: (transfer none): Unique name of the channel
+ * @element_size: Size in bytes of one element of the channel
+ * @depth: Number of elements the channel keeps
+ *
+ *   Adds a new channel to a #KiroMsb that is not yet serving. The channels
+ *   are laid out in the order they were added.
+ *
+ * Returns: The index of the new channel, or -1 in case of error
+ * Note:
+ *   The length of @name must be less than %KIRO_MSB_NAME_LENGTH.
+ * See also:
+ *   kiro_msb_serve, kiro_msb_push, kiro_msb_lookup
+ */
+gint        kiro_msb_add_channel        (KiroMsb *msb, const gchar *name, gulong element_size, guint depth);
+
+/**
+ * kiro_msb_serve:
+ * @msb: (transfer none): The #KiroMsb to perform this operation on
+ * @addr: (transfer none): Optional address parameter to define where to
+ * listen for new connections.
+ * @port: (transfer none): Optional port to listen on for new connections
+ *
+ *   Allocates the memory region for all channels that were added to the
+ *   @msb and serves it to remote #KiroMsbs.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   No channels can be added once the #KiroMsb is serving.
+ * See also:
+ *   kiro_msb_add_channel, kiro_msb_clone
+ */
+gboolean    kiro_msb_serve              (KiroMsb *msb, const gchar *addr, const gchar *port);
+
+/**
+ * kiro_msb_clone:
+ * @msb: (transfer none): The #KiroMsb to perform this operation on
+ * @addr: (transfer none): The InfiniBand address of the remote #KiroMsb
+ * @port: (transfer none): The InfiniBand port of the remote #KiroMsb
+ * @channels: (transfer none) (array zero-terminated=1) (allow-none): Names
+ * of the channels to subscribe to, or %NULL to subscribe to all of them
+ *
+ *   Connects to the remote #KiroMsb, reads its channel directory and keeps
+ *   the subscribed channels up to date automatically.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   All channels of the remote #KiroMsb are visible locally (see
+ *   kiro_msb_lookup), but only the subscribed ones are updated.
+ * See also:
+ *   kiro_msb_serve, kiro_msb_add_callback, kiro_msb_get_data
+ */
+gboolean    kiro_msb_clone              (KiroMsb *msb, const gchar *addr, const gchar *port, const gchar * const *channels);
+
+/**
+ * kiro_msb_get_channel_count:
+ * @msb: (transfer none): The #KiroMsb to query
+ *
+ * Returns: The number of channels of the @msb
+ */
+guint       kiro_msb_get_channel_count  (KiroMsb *msb);
+
+/**
+ * kiro_msb_lookup:
+ * @msb: (transfer none): The #KiroMsb to query
+ * @name: (transfer none): Name of the channel
+ *
+ * Returns: The index of the channel with the given @name, or -1 if there is
+ *   no such channel
+ */
+gint        kiro_msb_lookup             (KiroMsb *msb, const gchar *name);
+
+/**
+ * kiro_msb_get_channel_name:
+ * @msb: (transfer none): The #KiroMsb to query
+ * @channel: Index of the channel
+ *
+ * Returns: (transfer none): The name of the channel, or %NULL if there is no
+ *   such channel
+ */
+const gchar* kiro_msb_get_channel_name  (KiroMsb *msb, guint channel);
+
+/**
+ * kiro_msb_get_size:
+ * @msb: (transfer none): The #KiroMsb to query
+ * @channel: Index of the channel
+ *
+ * Returns: The size in bytes of one element of the channel, or 0 if there is
+ *   no such channel
+ */
+gulong      kiro_msb_get_size           (KiroMsb *msb, guint channel);
+
+/**
+ * kiro_msb_push:
+ * @msb: (transfer none): The 'serving' #KiroMsb to push to
+ * @channel: Index of the channel
+ * @data: (transfer none) (type gulong): void pointer to copy data from
+ *
+ *   Copies the given element into the channel and notifies the connected
+ *   clones. Pushes to different channels may happen from different threads.
+ *
+ * Returns: %TRUE on success %FALSE in case of error
+ * Note:
+ *   The internal memcopy() will assume an element of the correct size (see
+ *   kiro_msb_get_size)
+ * See also:
+ *   kiro_msb_add_channel, kiro_msb_get_size
+ */
+gboolean    kiro_msb_push               (KiroMsb *msb, guint channel, void *data);
+
+/**
+ * kiro_msb_get_data:
+ * @msb: (transfer none): The #KiroMsb to get the data from
+ * @channel: Index of the channel
+ *
+ *   Returns a void pointer to the newest element of the channel.
+ *
+ * Returns: (transfer none) (type gulong): A void pointer to the newest
+ *   element, or %NULL if the channel holds no element yet
+ * Note:
+ *   The same restrictions as for kiro_sb_get_data apply.
+ * See also:
+ *   kiro_msb_add_callback, kiro_sb_get_data
+ */
+void*       kiro_msb_get_data           (KiroMsb *msb, guint channel);
+
+/**
+ * KiroMsbCallbackFunc:
+ * @channel: Index of the channel that was updated
+ * @user_data: (transfer none): The #user_data which was provided during
+ *   registration of this callback
+ *
+ *   Defines the type of a callback function which will be invoked for every
+ *   subscribed channel a 'cloning' #KiroMsb has fetched a new element for.
+ *
+ * Returns: A #KiroContinueFlag deciding whether to keep this callback alive or not
+ * See also:
+ *   kiro_msb_add_callback, kiro_msb_remove_callback
+ */
+typedef KiroContinueFlag (*KiroMsbCallbackFunc) (guint channel, void *user_data);
+
+/**
+ * kiro_msb_add_callback:
+ * @msb: (transfer none): The #KiroMsb to register this callback to
+ * @callback: (transfer none) (scope call): A function pointer to the callback function
+ *
+ *   Adds a #KiroMsbCallbackFunc to this #KiroMsb.
+ *
+ * Returns: The internal id of the registerd callback
+ * Note:
+ *   The callbacks will only be invoked on a 'cloning' #KiroMsb. They run
+ *   inside its sync loop, once per updated channel.
+ * See also:
+ *   kiro_msb_remove_callback
+ */
+gulong      kiro_msb_add_callback       (KiroMsb *msb, KiroMsbCallbackFunc callback, void *user_data);
+
+/**
+ * kiro_msb_remove_callback:
+ * @msb: (transfer none): The #KiroMsb to remove the callback from
+ * @id: The id of the callback to be removed
+ *
+ * Returns: A #gboolean. %TRUE if the callback was found and removed. %FALSE
+ *   otherwise
+ * See also:
+ *   kiro_msb_add_callback
+ */
+gboolean    kiro_msb_remove_callback    (KiroMsb *msb, gulong id);
+
+G_END_DECLS
+
+#endif //__KIRO_MSB_H
@@ -33,6 +33,13 @@
 
 #include <rdma/rdma_cma.h>
 
+/*
+ * Largest number of bytes a single RDMA work request transfers. The length of
+ * a scatter/gather element is only 32 bits wide and InfiniBand limits a single
+ * message to 2 GiB, so larger transfers are split into several requests.
+ */
+#define KIRO_RDMA_MAX_TRANSFER (1UL << 30)
+
 /**
  * kiro_connection_context: (skip)
  *
@@ -81,10 +88,22 @@ struct kiro_ctrl_msg {
         KIRO_RDMA_CANCEL,                           // Used to cancel pending RDMA transfer in KiroMessenger
         KIRO_PING,                                  // PING Message
         KIRO_PONG,                                  // PONG Message (PING reply)
-        KIRO_REALLOC                                // Used by the server to notify the client about a new peer_mri
+        KIRO_REALLOC,                               // Used by the server to notify the client about a new peer_mri
+        KIRO_REQ_UPDATE,                            // Client asks to be notified once the server memory changes
+        KIRO_UPDATE,                                // Server memory has changed (sequence holds the new sequence number)
+        KIRO_REGIONS,                               // The region directory of the server has changed
+        KIRO_SUBSCRIBE                              // Client asks for pushes into the memory given by peer_mri
     } msg_type;
 
     struct ibv_mr peer_mri;
+
+    struct ibv_mr dir_mri;                          // Region directory of the server (KIRO_ACK_RDMA only. Zero length if there is none)
+
+    uint64_t sequence;                              // Sequence number of the server memory (KIRO_REQ_UPDATE and KIRO_UPDATE only)
+
+    uint64_t offset;                                // Start of the changed range of the server memory (KIRO_UPDATE only)
+
+    uint64_t size;                                  // Size in bytes of the changed range (KIRO_UPDATE only)
 };
 
 
@@ -104,13 +123,98 @@ struct kiro_rdma_mem {
 };
 
 
+// Maximum number of regions a server can provide besides its main memory
+#define KIRO_MAX_REGIONS 32
+
+// Maximum length of a region name, including the terminating NUL
+#define KIRO_REGION_NAME_LENGTH 64
+
+/**
+ * kiro_region_entry: (skip)
+ *
+ * Describes one memory region in the region directory of a server
+ *
+ */
+struct kiro_region_entry {
+
+    uint32_t    id;                                 // ID of the region. 0 marks an unused entry
+    uint32_t    rkey;                               // Remote key of the region
+    uint64_t    addr;                               // Remote address of the region
+    uint64_t    length;                             // Size in bytes of the region
+    char        name[KIRO_REGION_NAME_LENGTH];      // NUL terminated name of the region
+
+} __attribute__ ((packed));
+
+/**
+ * kiro_region_directory: (skip)
+ *
+ * Table of the memory regions of a server. It is registered once with the
+ * protection domain that is shared by all clients, so they can read it like
+ * any other region.
+ *
+ */
+struct kiro_region_directory {
+
+    uint64_t                    generation;         // Odd while the server is changing the directory
+    struct kiro_region_entry    entries[KIRO_MAX_REGIONS];
+
+} __attribute__ ((packed));
+
+
+// Name of the region through which a server publishes its block versions
+#define KIRO_VERSION_REGION "kiro-versions"
+
+// Name of the region that holds the sequence counter of kiro_server_write_begin
+#define KIRO_SEQLOCK_REGION "kiro-seqlock"
+
+// Size in bytes of the blocks that kiro_server_mark_dirty keeps track of
+#define KIRO_DIRTY_BLOCK_SIZE (64 * 1024)
+
+/**
+ * kiro_version_table: (skip)
+ *
+ * Holds one version per block of the server memory. A block gets a new
+ * version every time it is marked dirty, so a client only needs to read the
+ * blocks whose version differs from the one it has seen last.
+ *
+ */
+struct kiro_version_table {
+
+    uint64_t    mem_size;                           // Size in bytes of the memory the table describes
+    uint64_t    block_size;                         // Size in bytes of one block
+    uint64_t    num_blocks;                         // Number of entries in versions
+    uint64_t    versions[];
+
+} __attribute__ ((packed));
+
+
+/**
+ * kiro_rail_info: (skip)
+ *
+ * Private data of the connection request of an additional connection
+ * ('rail') of a client. All rails of a client carry the same group. Rail 0 is
+ * the connection the client was created with, which sends no private data at
+ * all.
+ *
+ */
+struct kiro_rail_info {
+
+    uint64_t    group;                              // Random identifier shared by all connections of one client
+    uint32_t    rail;                               // Number of the rail within the group. 0 for the main connection
+
+} __attribute__ ((packed));
+
+
 static int
 kiro_attach_qp (struct rdma_cm_id *id)
 {
     if (!id)
         return -1;
 
-    id->pd = ibv_alloc_pd (id->verbs);
+    // The caller may provide a protection domain that is shared with other
+    // connections
+    if (!id->pd)
+        id->pd = ibv_alloc_pd (id->verbs);
     id->send_cq_channel = ibv_create_comp_channel (id->verbs);
     id->recv_cq_channel = ibv_create_comp_channel (id->verbs);
     id->send_cq = ibv_create_cq (id->verbs, 1, id, id->send_cq_channel, 0);
@@ -32,6 +32,30 @@
 
 #define KIRO_SB_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), KIRO_TYPE_SB, KiroSbPrivate))
 
+// Bounds for the fallback polling interval of a cloning KiroSb (in ms)
+#define KIRO_SB_POLL_MIN 1
+#define KIRO_SB_POLL_MAX 100
+
+// Number of attempts to fetch the newest element before giving up for now
+#define KIRO_SB_FETCH_TRIES 8
+
+// Number of elements in the ring buffer of a 'serving' KiroSb, unless set
+// otherwise with kiro_sb_set_depth
+#define KIRO_SB_DEFAULT_DEPTH 3
+
+struct _KiroSbElement {
+    gint        refcount;
+    uint64_t    sequence;       // Sequence number of the element in the SB
+    gulong      size;           // Size of data in bytes
+    char        data[];         // Private copy of the element
+};
+
+struct dispatch_job {
+    KiroSbElement   *element;   // Element to pass to the callbacks
+    GHook           **hooks;    // Referenced element-callbacks at the time of the sync
+    guint           num_hooks;
+};
+
 struct _KiroSbPrivate {
 
     /* Properties */
@@ -43,13 +67,56 @@ struct _KiroSbPrivate {
     KiroServer* server;         // KIRO Server component to serve
     KiroClient* client;         // KIRO Client component to clone
     KiroTrb* trb;               // KIRO Ring Buffer to hold and exchange data
+    void        *mirror;        // Client memory the TRB of a 'cloning' SB was adopted from
 
     GThread     *main_thread;   // Main thread for the main_loop
     GMainLoop   *main_loop;     // main_loop *duh*
     guint       close_signal;   // Used to signal shutdown of the main_loop
     gboolean    freeze;         // Allows to prevent auto-sync
+    gint        poll_timeout;   // Current fallback polling interval in ms
+    uint64_t    remote_offset;  // Offset of the remote buffer as seen by the last read of its header
+    uint64_t    notified;       // Sequence number of the last update notification that was acted on
+    uint64_t    valid_from;     // Oldest sequence number that is held locally with valid content
+    guint       depth;          // Number of elements in the ring buffer of a 'serving' SB
+    gboolean    lossless;       // Fetch every element instead of only the newest one
+
+    GMutex      data_lock;      // Protects generation and closing
+    GCond       data_cond;      // Signaled whenever generation changes
+    guint64     generation;     // Number of syncs that fetched new data so far
+    gboolean    closing;        // Wakes up blocking readers on kiro_sb_stop
+
+    GRecMutex   hook_lock;      // Protects element_callbacks, which are used by the workers
+    GMutex      dispatch_lock;  // Protects the dispatch queue and dispatch_stop
+    GCond       dispatch_cond;  // Signaled when a job was queued
+    GCond       dispatch_space; // Signaled when a job was taken from the queue
+    GQueue      dispatch_queue; // Pending dispatch_jobs
+    GThread     **workers;      // Worker threads running the element-callbacks
+    guint       num_workers;    // 0 means element-callbacks run inside the main loop
+    guint       max_pending;    // Maximum length of dispatch_queue
+    KiroSbDispatchPolicy policy;// What to do when dispatch_queue is full
+    gboolean    dispatch_stop;  // Tells the workers to quit
+    guint64     dispatch_dropped; // Number of jobs dropped due to a full queue
+
+    GMutex      push_lock;      // Serializes pushes with the flusher thread
+    GCond       flush_cond;     // Wakes up the flusher when a batch is opened
+    GThread     *flusher;       // Publishes batches once their time window is over
+    gboolean    flusher_stop;   // Tells the flusher to quit
+    guint       coalesce_count; // Publish after this many pushes. 0 for no limit
+    guint       coalesce_delay; // Publish this many microseconds after the first push. 0 for no limit
+    guint       batch_count;    // Number of pushes in the open batch
+    gint64      batch_start;    // Monotonic time of the first push of the open batch
+    void        *dma_slot;      // Element of the open batch that is still being written. NULL if none
 
     GHookList   callbacks;      // List of registerd sync-callbacks
+    GHookList   stream_callbacks; // List of registerd stream-callbacks
+    GHookList   element_callbacks; // List of registerd element-callbacks
+};
+
+
+struct stream_args {
+    uint64_t    first;          // Sequence number of the first delivered element
+    guint       delivered;      // Number of elements that were fetched
+    uint64_t    dropped;        // Number of elements that were overwritten before they could be fetched
 };
 
 
@@ -81,10 +148,39 @@ kiro_sb_init (KiroSb *self)
     KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
     priv->initialized = 0;
     priv->trb = NULL;
+    priv->mirror = NULL;
     priv->server = NULL;
     priv->client = NULL;
     priv->freeze = FALSE;
+    priv->poll_timeout = KIRO_SB_POLL_MIN;
+    priv->depth = KIRO_SB_DEFAULT_DEPTH;
+    priv->lossless = FALSE;
+    priv->generation = 0;
+    priv->closing = FALSE;
+    g_mutex_init (&priv->data_lock);
+    g_cond_init (&priv->data_cond);
+    g_rec_mutex_init (&priv->hook_lock);
+    g_mutex_init (&priv->dispatch_lock);
+    g_cond_init (&priv->dispatch_cond);
+    g_cond_init (&priv->dispatch_space);
+    g_queue_init (&priv->dispatch_queue);
+    priv->workers = NULL;
+    priv->num_workers = 0;
+    priv->max_pending = 0;
+    priv->policy = KIRO_SB_DISPATCH_DROP_OLDEST;
+    priv->dispatch_stop = FALSE;
+    priv->dispatch_dropped = 0;
+    g_mutex_init (&priv->push_lock);
+    g_cond_init (&priv->flush_cond);
+    priv->flusher = NULL;
+    priv->flusher_stop = FALSE;
+    priv->coalesce_count = 0;
+    priv->coalesce_delay = 0;
+    priv->batch_count = 0;
+    priv->dma_slot = NULL;
     g_hook_list_init (&(priv->callbacks), sizeof (GHook));
+    g_hook_list_init (&(priv->stream_callbacks), sizeof (GHook));
+    g_hook_list_init (&(priv->element_callbacks), sizeof (GHook));
 }
 
 
@@ -94,7 +190,18 @@ kiro_sb_finalize (GObject *object)
     g_return_if_fail (object != NULL);
     KiroSb *self = KIRO_SB (object);
 
-    kiro_sb_stop (self);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    if (priv->initialized != 0)
+        kiro_sb_stop (self);
+
+    g_mutex_clear (&priv->data_lock);
+    g_cond_clear (&priv->data_cond);
+    g_rec_mutex_clear (&priv->hook_lock);
+    g_mutex_clear (&priv->dispatch_lock);
+    g_cond_clear (&priv->dispatch_cond);
+    g_cond_clear (&priv->dispatch_space);
+    g_mutex_clear (&priv->push_lock);
+    g_cond_clear (&priv->flush_cond);
 
     G_OBJECT_CLASS (kiro_sb_parent_class)->finalize (object);
 }
@@ -110,6 +217,248 @@ kiro_sb_class_init (KiroSbClass *klass)
 }
 
 
+static void
+free_job (KiroSbPrivate *priv, struct dispatch_job *job)
+{
+    g_rec_mutex_lock (&priv->hook_lock);
+    for (guint i = 0; i < job->num_hooks; i++)
+        g_hook_unref (&(priv->element_callbacks), job->hooks[i]);
+    g_rec_mutex_unlock (&priv->hook_lock);
+
+    kiro_sb_element_unref (job->element);
+    g_free (job->hooks);
+    g_free (job);
+}
+
+
+static void
+run_job (KiroSbPrivate *priv, struct dispatch_job *job)
+{
+    for (guint i = 0; i < job->num_hooks; i++) {
+        GHook *hook = job->hooks[i];
+
+        // The callback might have been removed after the job was queued
+        if (!G_HOOK_IS_VALID (hook))
+            continue;
+
+        if (KIRO_CALLBACK_REMOVE == ((KiroSbElementCallbackFunc)hook->func) (job->element, hook->data)) {
+            g_rec_mutex_lock (&priv->hook_lock);
+            if (G_HOOK_IS_VALID (hook))
+                g_hook_destroy_link (&(priv->element_callbacks), hook);
+            g_rec_mutex_unlock (&priv->hook_lock);
+        }
+    }
+}
+
+
+static gpointer
+worker_func (KiroSbPrivate *priv)
+{
+    while (1) {
+        g_mutex_lock (&priv->dispatch_lock);
+        while (g_queue_is_empty (&priv->dispatch_queue) && !priv->dispatch_stop)
+            g_cond_wait (&priv->dispatch_cond, &priv->dispatch_lock);
+
+        if (priv->dispatch_stop) {
+            g_mutex_unlock (&priv->dispatch_lock);
+            return NULL;
+        }
+
+        struct dispatch_job *job = g_queue_pop_head (&priv->dispatch_queue);
+        g_cond_signal (&priv->dispatch_space);
+        g_mutex_unlock (&priv->dispatch_lock);
+
+        run_job (priv, job);
+        free_job (priv, job);
+    }
+}
+
+
+static void
+start_workers (KiroSbPrivate *priv)
+{
+    priv->dispatch_stop = FALSE;
+    priv->workers = g_new0 (GThread *, priv->num_workers);
+    for (guint i = 0; i < priv->num_workers; i++)
+        priv->workers[i] = g_thread_new ("KIRO SB Worker", (GThreadFunc)worker_func, priv);
+}
+
+
+static void
+stop_workers (KiroSbPrivate *priv)
+{
+    if (!priv->workers)
+        return;
+
+    g_mutex_lock (&priv->dispatch_lock);
+    priv->dispatch_stop = TRUE;
+    g_cond_broadcast (&priv->dispatch_cond);
+    g_cond_broadcast (&priv->dispatch_space);
+    g_mutex_unlock (&priv->dispatch_lock);
+
+    for (guint i = 0; i < priv->num_workers; i++)
+        g_thread_join (priv->workers[i]);
+    g_free (priv->workers);
+    priv->workers = NULL;
+
+    // Jobs that were not picked up anymore are discarded
+    g_mutex_lock (&priv->dispatch_lock);
+    GList *pending = priv->dispatch_queue.head;
+    g_queue_init (&priv->dispatch_queue);
+    g_mutex_unlock (&priv->dispatch_lock);
+
+    for (GList *it = pending; it; it = it->next)
+        free_job (priv, (struct dispatch_job *)it->data);
+    g_list_free (pending);
+}
+
+
+static gboolean
+element_marshaller (GHook *hook, gpointer data)
+{
+    return ((KiroSbElementCallbackFunc)hook->func) ((KiroSbElement *)data, hook->data);
+}
+
+
+/*
+ * Hands a snapshot of the given element to the element-callbacks. Without
+ * workers, the callbacks are invoked right away. Otherwise a job is queued for
+ * the workers, and the queue policy decides what happens if the queue is full.
+ */
+static void
+dispatch_element (KiroSbPrivate *priv, uint64_t sequence, void *data)
+{
+    if (!data || !priv->element_callbacks.hooks)
+        return;
+
+    gulong size = kiro_trb_get_element_size (priv->trb);
+    KiroSbElement *element = g_malloc (sizeof (KiroSbElement) + size);
+    element->refcount = 1;
+    element->sequence = sequence;
+    element->size = size;
+    memcpy (element->data, data, size);
+
+    if (priv->num_workers == 0) {
+        g_rec_mutex_lock (&priv->hook_lock);
+        g_hook_list_marshal_check (&(priv->element_callbacks), FALSE, element_marshaller, element);
+        g_rec_mutex_unlock (&priv->hook_lock);
+        kiro_sb_element_unref (element);
+        return;
+    }
+
+    struct dispatch_job *job = g_new0 (struct dispatch_job, 1);
+    job->element = element;
+
+    g_rec_mutex_lock (&priv->hook_lock);
+    GHook *hook = g_hook_first_valid (&(priv->element_callbacks), FALSE);
+    while (hook) {
+        job->hooks = g_renew (GHook *, job->hooks, job->num_hooks + 1);
+        job->hooks[job->num_hooks++] = g_hook_ref (&(priv->element_callbacks), hook);
+        hook = g_hook_next_valid (&(priv->element_callbacks), hook, FALSE);
+    }
+    g_rec_mutex_unlock (&priv->hook_lock);
+
+    struct dispatch_job *dropped = NULL;
+
+    g_mutex_lock (&priv->dispatch_lock);
+    if (priv->policy == KIRO_SB_DISPATCH_BLOCK) {
+        while (g_queue_get_length (&priv->dispatch_queue) >= priv->max_pending && !priv->dispatch_stop)
+            g_cond_wait (&priv->dispatch_space, &priv->dispatch_lock);
+    }
+    else if (g_queue_get_length (&priv->dispatch_queue) >= priv->max_pending) {
+        dropped = g_queue_pop_head (&priv->dispatch_queue);
+        priv->dispatch_dropped++;
+    }
+
+    if (priv->dispatch_stop) {
+        // The workers are gone already
+        g_mutex_unlock (&priv->dispatch_lock);
+        free_job (priv, job);
+    }
+    else {
+        g_queue_push_tail (&priv->dispatch_queue, job);
+        g_cond_signal (&priv->dispatch_cond);
+        g_mutex_unlock (&priv->dispatch_lock);
+    }
+
+    if (dropped)
+        free_job (priv, dropped);
+}
+
+
+/*
+ * Publishes the open batch of a coalescing 'serving' KiroSb with a single
+ * header update. Must be called with push_lock held.
+ */
+static void
+publish_batch (KiroSbPrivate *priv)
+{
+    if (priv->batch_count == 0)
+        return;
+
+    // Publishing the batch implies that its last DMA element is written
+    if (priv->dma_slot) {
+        kiro_trb_dma_commit (priv->trb, priv->dma_slot);
+        priv->dma_slot = NULL;
+    }
+
+    kiro_trb_end_batch (priv->trb);
+    priv->batch_count = 0;
+    kiro_server_notify_update (priv->server, kiro_trb_get_offset (priv->trb));
+}
+
+
+static gpointer
+flusher_func (KiroSbPrivate *priv)
+{
+    g_mutex_lock (&priv->push_lock);
+    while (!priv->flusher_stop) {
+        // A batch must not be published while the user is still writing
+        // one of its elements
+        if (priv->batch_count == 0 || priv->dma_slot) {
+            g_cond_wait (&priv->flush_cond, &priv->push_lock);
+            continue;
+        }
+
+        gint64 deadline = priv->batch_start + priv->coalesce_delay;
+        if (g_get_monotonic_time () >= deadline)
+            publish_batch (priv);
+        else
+            g_cond_wait_until (&priv->flush_cond, &priv->push_lock, deadline);
+    }
+    g_mutex_unlock (&priv->push_lock);
+    return NULL;
+}
+
+
+static void
+start_flusher (KiroSbPrivate *priv)
+{
+    // Without a time window, batches are only closed by the pushes themselves
+    if (priv->coalesce_delay == 0 || priv->flusher)
+        return;
+
+    priv->flusher_stop = FALSE;
+    priv->flusher = g_thread_new ("KIRO SB Flusher", (GThreadFunc)flusher_func, priv);
+}
+
+
+static void
+stop_flusher (KiroSbPrivate *priv)
+{
+    g_mutex_lock (&priv->push_lock);
+    publish_batch (priv);
+    priv->flusher_stop = TRUE;
+    g_cond_signal (&priv->flush_cond);
+    g_mutex_unlock (&priv->push_lock);
+
+    if (priv->flusher) {
+        g_thread_join (priv->flusher);
+        priv->flusher = NULL;
+    }
+}
+
+
 void
 kiro_sb_stop (KiroSb *self)
 {
@@ -119,11 +468,22 @@ kiro_sb_stop (KiroSb *self)
     g_return_if_fail (priv->initialized != 0);
 
     if (priv->initialized == 1) {
+        stop_flusher (priv);
         if (priv->server)
             kiro_server_free (priv->server);
+        priv->batch_count = 0;
     }
 
     if (priv->initialized == 2) {
+        // Release all threads that are blocked in kiro_sb_get_data_blocking
+        g_mutex_lock (&priv->data_lock);
+        priv->closing = TRUE;
+        g_cond_broadcast (&priv->data_cond);
+        g_mutex_unlock (&priv->data_lock);
+
+        // The main loop might wait for room in the dispatch queue
+        stop_workers (priv);
+
         priv->close_signal = TRUE;
         while (g_main_loop_is_running (priv->main_loop)) {}
         g_thread_join (priv->main_thread);
@@ -135,6 +495,10 @@ kiro_sb_stop (KiroSb *self)
     }
 
     g_hook_list_clear (&(priv->callbacks));
+    g_hook_list_clear (&(priv->stream_callbacks));
+    g_rec_mutex_lock (&priv->hook_lock);
+    g_hook_list_clear (&(priv->element_callbacks));
+    g_rec_mutex_unlock (&priv->hook_lock);
 
     if (priv->trb) {
         kiro_trb_purge (priv->trb, FALSE);
@@ -142,6 +506,7 @@ kiro_sb_stop (KiroSb *self)
     }
 
     priv->trb = NULL;
+    priv->mirror = NULL;
     priv->server = NULL;
     priv->client = NULL;
     priv->initialized = 0;
@@ -158,6 +523,176 @@ start_main_loop (GMainLoop *loop)
 }
 
 
+/*
+ * Returns a pointer to the local copy of the element with the given sequence
+ * number, or NULL if it is not held
+ */
+static void *
+element_pointer (KiroSbPrivate *priv, uint64_t sequence)
+{
+    uint64_t offset = kiro_trb_get_offset (priv->trb);
+    uint64_t max = kiro_trb_get_max_elements (priv->trb);
+    uint64_t oldest = (offset > max) ? offset - max : 0;
+
+    // A clone might not have fetched all of the elements it holds
+    if (priv->initialized == 2)
+        oldest = MAX (oldest, priv->valid_from);
+
+    if (sequence < oldest || sequence >= offset)
+        return NULL;
+
+    return kiro_trb_get_element (priv->trb, (glong)(sequence - offset));
+}
+
+
+/*
+ * Fetches the newest element (target - 1) of the remote buffer together with
+ * the remote header in one chain of reads. The header is read last. If the
+ * remote buffer has advanced far enough to reuse the slot of the element in
+ * the meantime, the element might be torn and the fetch is repeated for the
+ * then newest element.
+ * Returns TRUE if a new element was fetched.
+ */
+static gboolean
+fetch_latest (KiroSbPrivate *priv, uint64_t known, uint64_t target, struct stream_args *args)
+{
+    void *mem = kiro_client_get_memory (priv->client);
+    struct KiroTrbInfo *header = (struct KiroTrbInfo *)mem;
+    uint64_t max = kiro_trb_get_max_elements (priv->trb);
+
+    for (int tries = 0; tries < KIRO_SB_FETCH_TRIES; tries++) {
+        if (target == 0) {
+            // The remote buffer was flushed
+            header->offset = 0;
+            kiro_trb_refresh (priv->trb);
+            return FALSE;
+        }
+
+        // Indices of the local TRB are relative to what we know of
+        uint64_t seq = target - 1;
+        glong index = (glong)(seq - known);
+        void *element = kiro_trb_get_element (priv->trb, index);
+        struct KiroTrbMeta *meta = kiro_trb_get_meta (priv->trb, index);
+
+        struct KiroSyncRange ranges[3];
+        guint num = 0;
+        ranges[num].remote_offset = ranges[num].local_offset = element - mem;
+        ranges[num++].size = kiro_trb_get_element_size (priv->trb);
+        if (meta) {
+            ranges[num].remote_offset = ranges[num].local_offset = (void *)meta - mem;
+            ranges[num++].size = sizeof (struct KiroTrbMeta);
+        }
+        ranges[num].remote_offset = ranges[num].local_offset = 0;
+        ranges[num++].size = sizeof (struct KiroTrbInfo);
+
+        if (0 > kiro_client_sync_batch (priv->client, ranges, num)) {
+            g_usleep (KIRO_SB_POLL_MAX * 1000);
+            return FALSE;
+        }
+
+        uint64_t remote = priv->remote_offset = header->offset;
+        gboolean valid = (seq < remote) && (remote - seq < max);
+        if (valid && meta)
+            valid = (meta->sequence == seq);
+
+        if (valid) {
+            header->offset = target;
+            kiro_trb_refresh (priv->trb);
+            priv->valid_from = seq;
+            args->first = seq;
+            args->delivered = 1;
+            args->dropped = (seq > known) ? seq - known : 0;
+            return TRUE;
+        }
+
+        g_debug ("Torn read of element %" G_GUINT64_FORMAT ". Retrying.", seq);
+        header->offset = known;
+        target = remote;
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * Fetches all elements from known up to target of the remote buffer, together
+ * with the remote header, in one chain of reads. Elements that were already
+ * overwritten on the remote side before (or while) they could be read are
+ * reported as dropped.
+ * Returns TRUE if any element was fetched.
+ */
+static gboolean
+fetch_all (KiroSbPrivate *priv, uint64_t known, uint64_t target, struct stream_args *args)
+{
+    void *mem = kiro_client_get_memory (priv->client);
+    struct KiroTrbInfo *header = (struct KiroTrbInfo *)mem;
+    uint64_t max = kiro_trb_get_max_elements (priv->trb);
+    uint64_t element_size = kiro_trb_get_element_size (priv->trb);
+    uint64_t base = known;
+
+    // The remote buffer was flushed. Start over from its beginning.
+    if (target < known)
+        base = 0;
+
+    // Anything older than one full ring is already gone on the remote side
+    uint64_t first = MAX (base, (target > max) ? target - max : 0);
+
+    struct KiroSyncRange ranges[5];
+    guint num = 0;
+    uint64_t seq = first;
+    while (seq < target) {
+        // The elements are stored contiguously unless they wrap around the
+        // end of the buffer memory, which splits them at most once
+        glong index = (glong)(seq - known);
+        uint64_t run = MIN (target - seq, max - (seq % max));
+        void *element = kiro_trb_get_element (priv->trb, index);
+        struct KiroTrbMeta *meta = kiro_trb_get_meta (priv->trb, index);
+
+        ranges[num].remote_offset = ranges[num].local_offset = element - mem;
+        ranges[num++].size = run * element_size;
+        if (meta) {
+            ranges[num].remote_offset = ranges[num].local_offset = (void *)meta - mem;
+            ranges[num++].size = run * sizeof (struct KiroTrbMeta);
+        }
+        seq += run;
+    }
+    ranges[num].remote_offset = ranges[num].local_offset = 0;
+    ranges[num++].size = sizeof (struct KiroTrbInfo);
+
+    if (0 > kiro_client_sync_batch (priv->client, ranges, num)) {
+        header->offset = known;
+        g_usleep (KIRO_SB_POLL_MAX * 1000);
+        return FALSE;
+    }
+
+    // An element is intact if its slot was not reused before the header was
+    // read, i.e. if it is one of the newest 'max' elements of the remote side
+    uint64_t remote = priv->remote_offset = header->offset;
+    uint64_t valid = first;
+    if (remote < target)
+        valid = target;
+    else if (remote >= max && remote - max + 1 > valid)
+        valid = MIN (remote - max + 1, target);
+
+    header->offset = target;
+    kiro_trb_refresh (priv->trb);
+    priv->valid_from = valid;
+
+    args->first = valid;
+    args->delivered = target - valid;
+    args->dropped = valid - base;
+    return args->delivered > 0;
+}
+
+
+static gboolean
+stream_marshaller (GHook *hook, gpointer data)
+{
+    struct stream_args *args = (struct stream_args *)data;
+    return ((KiroSbStreamCallbackFunc)hook->func) (args->first, args->delivered, args->dropped, hook->data);
+}
+
+
 gboolean
 idle_func (KiroSbPrivate *priv)
 {
@@ -169,19 +704,85 @@ idle_func (KiroSbPrivate *priv)
         return G_SOURCE_REMOVE;
     }
 
-    if (TRUE == priv->freeze)
+    if (TRUE == priv->freeze) {
+        g_usleep (KIRO_SB_POLL_MIN * 1000);
         return G_SOURCE_CONTINUE;
+    }
 
-    struct KiroTrbInfo *header = (struct KiroTrbInfo *)kiro_trb_get_raw_buffer (priv->trb);
-    gulong old_offset = header->offset;
-    kiro_client_sync_partial (priv->client, 0, sizeof(struct KiroTrbInfo), 0);
-    kiro_trb_refresh (priv->trb);
-    if ((old_offset != header->offset) && 0 < header->offset) {
-        gulong offset = (gulong) (kiro_trb_get_element (priv->trb, -1) - kiro_trb_get_raw_buffer (priv->trb));
-        kiro_client_sync_partial (priv->client, offset, kiro_trb_get_element_size (priv->trb), offset);
-        g_hook_list_invoke_check (&(priv->callbacks), FALSE);
+    if (!kiro_client_get_memory (priv->client)) {
+        // Connection to the server was lost
+        g_usleep (KIRO_SB_POLL_MAX * 1000);
+        return G_SOURCE_CONTINUE;
     }
 
+    // The server has resized its buffer and the client has switched over to
+    // new memory. The client fills the new memory before the switch, and the
+    // migrated elements keep their sequence numbers, so it can be adopted
+    // right away.
+    // The TRB must not be asked for its memory here, since that would write
+    // its header into the old memory, which the client has freed already.
+    if (kiro_client_get_memory (priv->client) != priv->mirror) {
+        g_debug ("Remote buffer was resized. Re-adopting client memory.");
+        kiro_trb_purge (priv->trb, FALSE);
+        priv->mirror = kiro_client_get_memory (priv->client);
+        kiro_trb_adopt (priv->trb, priv->mirror);
+        priv->remote_offset = kiro_trb_get_offset (priv->trb);
+        priv->valid_from = 0;
+    }
+
+    struct KiroTrbInfo *header = (struct KiroTrbInfo *)kiro_client_get_memory (priv->client);
+    uint64_t known = kiro_trb_get_offset (priv->trb);
+
+    // Figure out up to which sequence number the remote buffer is filled.
+    // Prefer the number from an update notification, since this saves reading
+    // the remote header separately.
+    uint64_t target = priv->remote_offset;
+    uint64_t notified = kiro_client_get_update_sequence (priv->client);
+    if (notified != priv->notified) {
+        priv->notified = notified;
+        target = MAX (target, notified);
+    }
+
+    if (target == known) {
+        kiro_client_sync_partial (priv->client, 0, sizeof (struct KiroTrbInfo), 0);
+        target = priv->remote_offset = header->offset;
+        header->offset = known;
+    }
+
+    if (target != known) {
+        struct stream_args args = { 0, 0, 0 };
+        gboolean fetched;
+        if (priv->lossless)
+            fetched = fetch_all (priv, known, target, &args);
+        else
+            fetched = fetch_latest (priv, known, target, &args);
+
+        if (args.delivered || args.dropped)
+            g_hook_list_marshal_check (&(priv->stream_callbacks), FALSE, stream_marshaller, &args);
+        for (uint64_t seq = args.first; seq < args.first + args.delivered; seq++)
+            dispatch_element (priv, seq, element_pointer (priv, seq));
+
+        if (fetched) {
+            g_mutex_lock (&priv->data_lock);
+            priv->generation++;
+            g_cond_broadcast (&priv->data_cond);
+            g_mutex_unlock (&priv->data_lock);
+            g_hook_list_invoke_check (&(priv->callbacks), FALSE);
+        }
+        return G_SOURCE_CONTINUE;
+    }
+
+    // Nothing new. Sleep until the server notifies us about the next push.
+    // In case the notification gets lost (or the server does not send any),
+    // poll again after a timeout that grows while nothing happens.
+    int rv = kiro_client_wait_update (priv->client, known, priv->poll_timeout);
+    if (rv > 0)
+        priv->poll_timeout = KIRO_SB_POLL_MIN;
+    else if (rv == 0)
+        priv->poll_timeout = MIN (priv->poll_timeout * 2, KIRO_SB_POLL_MAX);
+    else
+        g_usleep (KIRO_SB_POLL_MAX * 1000);
+
     return G_SOURCE_CONTINUE;
 }
 
@@ -216,7 +817,7 @@ kiro_sb_serve (KiroSb *self, gulong size, const gchar *addr, const gchar *port)
 
     g_return_val_if_fail ((priv->trb = kiro_trb_new ()), FALSE);
 
-    if (0 > kiro_trb_reshape (priv->trb, size, 3)) {
+    if (0 > kiro_trb_reshape (priv->trb, size, priv->depth)) {
         g_debug ("Failed to create KIRO ring buffer");
         kiro_trb_free (priv->trb);
         return FALSE;
@@ -236,33 +837,110 @@ kiro_sb_serve (KiroSb *self, gulong size, const gchar *addr, const gchar *port)
     }
 
     priv->initialized = 1;
+    start_flusher (priv);
     g_message ("SyncBuffer ready");
 
     return TRUE;
 }
 
 
-KiroContinueFlag
-ready_callback (gboolean *ready)
+gboolean
+kiro_sb_set_depth (KiroSb *self, guint depth)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized != 2, FALSE);
+    g_return_val_if_fail (depth > 0, FALSE);
+
+    if (priv->initialized == 1 && !kiro_sb_resize (self, depth))
+        return FALSE;
+
+    priv->depth = depth;
+    return TRUE;
+}
+
+
+void
+kiro_sb_set_lossless (KiroSb *self, gboolean lossless)
 {
-    *ready = TRUE;
-    return KIRO_CALLBACK_REMOVE;
+    g_return_if_fail (self != NULL);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+
+    priv->lossless = lossless;
+}
+
+
+gboolean
+kiro_sb_resize (KiroSb *self, guint depth)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 1, FALSE);
+    g_return_val_if_fail (depth > 0, FALSE);
+
+    // The open batch is published first, so it is migrated like any other
+    // elements. Pushes are held off until the server has switched, so the
+    // old memory is still current if the switch fails.
+    g_mutex_lock (&priv->push_lock);
+    publish_batch (priv);
+
+    void *old_mem = NULL;
+    if (0 > kiro_trb_resize (priv->trb, depth, &old_mem)) {
+        g_mutex_unlock (&priv->push_lock);
+        g_debug ("Failed to resize KIRO ring buffer");
+        return FALSE;
+    }
+
+    // Clients keep reading the old memory until they have ACKed the switch,
+    // so it may only be freed once the realloc is done.
+    if (0 > kiro_server_realloc (priv->server, kiro_trb_get_raw_buffer (priv->trb), kiro_trb_get_raw_size (priv->trb))) {
+        // Go back to the memory the server still provides. This frees the
+        // new memory.
+        kiro_trb_adopt (priv->trb, old_mem);
+        g_mutex_unlock (&priv->push_lock);
+        g_debug ("Failed to hand the resized KIRO ring buffer to the server");
+        return FALSE;
+    }
+
+    g_mutex_unlock (&priv->push_lock);
+    g_free (old_mem);
+    return TRUE;
 }
 
 
 void *
 kiro_sb_get_data_blocking (KiroSb *self)
+{
+    return kiro_sb_get_data_blocking_timeout (self, 0);
+}
+
+
+void *
+kiro_sb_get_data_blocking_timeout (KiroSb *self, guint timeout_ms)
 {
     g_return_val_if_fail (self != NULL, NULL);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 2, NULL);
+
+    gint64 end_time = g_get_monotonic_time () + (gint64)timeout_ms * G_TIME_SPAN_MILLISECOND;
+    gboolean timed_out = FALSE;
+
+    g_mutex_lock (&priv->data_lock);
+    guint64 generation = priv->generation;
+    while (generation == priv->generation && !priv->closing && !timed_out) {
+        if (timeout_ms == 0)
+            g_cond_wait (&priv->data_cond, &priv->data_lock);
+        else
+            timed_out = !g_cond_wait_until (&priv->data_cond, &priv->data_lock, end_time);
+    }
+    gboolean fresh = (generation != priv->generation) && !priv->closing;
+    g_mutex_unlock (&priv->data_lock);
 
-    gboolean *ready = g_malloc(sizeof (gboolean));
-    if (!ready)
+    if (!fresh)
         return NULL;
-    *ready = FALSE;
-    kiro_sb_add_sync_callback (self, (KiroSbSyncCallbackFunc)ready_callback, ready);
 
-    while (!(*ready)) {}
-    g_free (ready);
     return kiro_sb_get_data (self);
 }
 
@@ -274,16 +952,115 @@ kiro_sb_get_data (KiroSb *self)
     KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
 
     struct KiroTrbInfo *header = kiro_trb_get_raw_buffer (priv->trb);
-    switch (header->offset) {
-        case 0:
-            return kiro_trb_get_element (priv->trb, 0);
-            break;
-        case 1:
-            return kiro_trb_get_element (priv->trb, 1);
-            break;
-        default:
-            return kiro_trb_get_element (priv->trb, -1);
+    if (header->offset == 0)
+        return kiro_trb_get_element (priv->trb, 0);
+
+    return kiro_trb_get_element (priv->trb, -1);
+}
+
+
+void *
+kiro_sb_get_element (KiroSb *self, uint64_t sequence)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized != 0, NULL);
+
+    return element_pointer (priv, sequence);
+}
+
+
+uint64_t
+kiro_sb_get_offset (KiroSb *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized != 0, 0);
+
+    return kiro_trb_get_offset (priv->trb);
+}
+
+
+/*
+ * Publishes the open batch of a coalescing KiroSb if it is full.
+ * Must be called with push_lock held.
+ */
+static void
+publish_if_full (KiroSbPrivate *priv)
+{
+    // A batch must never overwrite its own beginning before it is
+    // published, so it is limited by the depth of the buffer as well
+    guint limit = MIN (priv->coalesce_count ? priv->coalesce_count : G_MAXUINT,
+                       kiro_trb_get_max_elements (priv->trb));
+    if (priv->batch_count >= limit)
+        publish_batch (priv);
+}
+
+
+/*
+ * Marks the element that was handed out by kiro_sb_push_dma as written and
+ * publishes its batch if that was held back for it.
+ * Must be called with push_lock held.
+ */
+static void
+commit_dma_slot (KiroSbPrivate *priv)
+{
+    if (!priv->dma_slot)
+        return;
+
+    kiro_trb_dma_commit (priv->trb, priv->dma_slot);
+    priv->dma_slot = NULL;
+
+    // Without coalescing, the element was held back on its own
+    if (!priv->coalesce_count && !priv->coalesce_delay) {
+        publish_batch (priv);
+        return;
     }
+
+    publish_if_full (priv);
+
+    // The time window of the batch might have ended in the meantime
+    g_cond_signal (&priv->flush_cond);
+}
+
+
+/*
+ * Adds one element to the open batch of a coalescing KiroSb, opening a new
+ * batch if necessary. The batch is published once it is full, but a slot
+ * that is handed out for DMA holds it back until it is committed. Without
+ * coalescing, this is only used for DMA slots, which then form a batch of
+ * their own.
+ * Must be called with push_lock held.
+ * Returns the slot of the element or NULL on failure.
+ */
+static void *
+coalesced_push (KiroSbPrivate *priv, void *data_in)
+{
+    // By the time of the next push, the last DMA element has been written
+    commit_dma_slot (priv);
+
+    if (priv->batch_count == 0) {
+        kiro_trb_begin_batch (priv->trb);
+        priv->batch_start = g_get_monotonic_time ();
+        g_cond_signal (&priv->flush_cond);
+    }
+
+    void *mem = kiro_trb_dma_push (priv->trb);
+    if (mem) {
+        priv->batch_count++;
+        if (data_in) {
+            memcpy (mem, data_in, kiro_trb_get_element_size (priv->trb));
+            publish_if_full (priv);
+        }
+        else {
+            priv->dma_slot = mem;
+        }
+    }
+    else if (priv->batch_count == 0) {
+        kiro_trb_end_batch (priv->trb);
+    }
+
+    return mem;
 }
 
 
@@ -295,7 +1072,23 @@ kiro_sb_push (KiroSb *self, void *data_in)
     KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
     g_return_val_if_fail (priv->initialized == 1, FALSE);
 
-    return kiro_trb_push (priv->trb, data_in);
+    gboolean rv = TRUE;
+    g_mutex_lock (&priv->push_lock);
+
+    if (priv->coalesce_count || priv->coalesce_delay) {
+        rv = (coalesced_push (priv, data_in) != NULL);
+    }
+    else {
+        // A pending element from kiro_sb_push_dma is published first
+        commit_dma_slot (priv);
+        if (0 > kiro_trb_push (priv->trb, data_in))
+            rv = FALSE;
+        else
+            kiro_server_notify_update (priv->server, kiro_trb_get_offset (priv->trb));
+    }
+
+    g_mutex_unlock (&priv->push_lock);
+    return rv;
 }
 
 
@@ -307,7 +1100,66 @@ kiro_sb_push_dma (KiroSb *self)
     KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
     g_return_val_if_fail (priv->initialized == 1, NULL);
 
-    return kiro_trb_dma_push (priv->trb);
+    g_mutex_lock (&priv->push_lock);
+
+    // Without coalescing, the element forms a batch of its own, which is
+    // published once the element is committed
+    void *mem = coalesced_push (priv, NULL);
+
+    g_mutex_unlock (&priv->push_lock);
+    return mem;
+}
+
+
+gboolean
+kiro_sb_push_dma_commit (KiroSb *self)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 1, FALSE);
+
+    g_mutex_lock (&priv->push_lock);
+    commit_dma_slot (priv);
+    g_mutex_unlock (&priv->push_lock);
+    return TRUE;
+}
+
+
+gboolean
+kiro_sb_set_coalescing (KiroSb *self, guint max_count, guint max_delay_us)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized != 2, FALSE);
+
+    // Publish whatever was pushed under the old settings
+    if (priv->initialized == 1)
+        stop_flusher (priv);
+
+    g_mutex_lock (&priv->push_lock);
+    priv->coalesce_count = max_count;
+    priv->coalesce_delay = max_delay_us;
+    g_mutex_unlock (&priv->push_lock);
+
+    if (priv->initialized == 1)
+        start_flusher (priv);
+
+    return TRUE;
+}
+
+
+gboolean
+kiro_sb_publish (KiroSb *self)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 1, FALSE);
+
+    g_mutex_lock (&priv->push_lock);
+    publish_batch (priv);
+    g_mutex_unlock (&priv->push_lock);
+    return TRUE;
 }
 
 
@@ -330,7 +1182,16 @@ kiro_sb_clone (KiroSb *self, const gchar* address, const gchar* port)
     }
 
     kiro_client_sync (priv->client);
-    kiro_trb_adopt (priv->trb, kiro_client_get_memory (priv->client));
+    priv->mirror = kiro_client_get_memory (priv->client);
+    kiro_trb_adopt (priv->trb, priv->mirror);
+    priv->remote_offset = kiro_trb_get_offset (priv->trb);
+    priv->notified = 0;
+    priv->valid_from = 0;
+    priv->close_signal = FALSE;
+    priv->closing = FALSE;
+
+    if (priv->num_workers > 0)
+        start_workers (priv);
 
     priv->main_loop = g_main_loop_new (NULL, FALSE);
     g_idle_add ((GSourceFunc)idle_func, priv);
@@ -356,6 +1217,132 @@ kiro_sb_add_sync_callback (KiroSb *self, KiroSbSyncCallbackFunc func, void *user
 }
 
 
+gulong
+kiro_sb_add_stream_callback (KiroSb *self, KiroSbStreamCallbackFunc func, void *user_data)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+
+    GHook *new_hook = g_hook_alloc (&(priv->stream_callbacks));
+    new_hook->data = user_data;
+    new_hook->func = (gpointer)func;
+    g_hook_append (&(priv->stream_callbacks), new_hook);
+    return new_hook->hook_id;
+}
+
+
+gboolean
+kiro_sb_remove_stream_callback (KiroSb *self, gulong hook_id)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+
+    return g_hook_destroy (&(priv->stream_callbacks), hook_id);
+}
+
+
+gulong
+kiro_sb_add_element_callback (KiroSb *self, KiroSbElementCallbackFunc func, void *user_data)
+{
+    g_return_val_if_fail (self != NULL, 0);
+
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+
+    g_rec_mutex_lock (&priv->hook_lock);
+    GHook *new_hook = g_hook_alloc (&(priv->element_callbacks));
+    new_hook->data = user_data;
+    new_hook->func = (gpointer)func;
+    g_hook_append (&(priv->element_callbacks), new_hook);
+    gulong hook_id = new_hook->hook_id;
+    g_rec_mutex_unlock (&priv->hook_lock);
+    return hook_id;
+}
+
+
+gboolean
+kiro_sb_remove_element_callback (KiroSb *self, gulong hook_id)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+
+    g_rec_mutex_lock (&priv->hook_lock);
+    gboolean rv = g_hook_destroy (&(priv->element_callbacks), hook_id);
+    g_rec_mutex_unlock (&priv->hook_lock);
+    return rv;
+}
+
+
+gboolean
+kiro_sb_set_dispatch (KiroSb *self, guint workers, guint max_pending, KiroSbDispatchPolicy policy)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+    g_return_val_if_fail (priv->initialized == 0, FALSE);
+    g_return_val_if_fail (workers == 0 || max_pending > 0, FALSE);
+
+    priv->num_workers = workers;
+    priv->max_pending = max_pending;
+    priv->policy = policy;
+    return TRUE;
+}
+
+
+guint64
+kiro_sb_get_dispatch_dropped (KiroSb *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroSbPrivate *priv = KIRO_SB_GET_PRIVATE (self);
+
+    g_mutex_lock (&priv->dispatch_lock);
+    guint64 dropped = priv->dispatch_dropped;
+    g_mutex_unlock (&priv->dispatch_lock);
+    return dropped;
+}
+
+
+const void *
+kiro_sb_element_get_data (KiroSbElement *element)
+{
+    g_return_val_if_fail (element != NULL, NULL);
+    return element->data;
+}
+
+
+uint64_t
+kiro_sb_element_get_sequence (KiroSbElement *element)
+{
+    g_return_val_if_fail (element != NULL, 0);
+    return element->sequence;
+}
+
+
+gulong
+kiro_sb_element_get_size (KiroSbElement *element)
+{
+    g_return_val_if_fail (element != NULL, 0);
+    return element->size;
+}
+
+
+KiroSbElement *
+kiro_sb_element_ref (KiroSbElement *element)
+{
+    g_return_val_if_fail (element != NULL, NULL);
+    g_atomic_int_inc (&element->refcount);
+    return element;
+}
+
+
+void
+kiro_sb_element_unref (KiroSbElement *element)
+{
+    g_return_if_fail (element != NULL);
+    if (g_atomic_int_dec_and_test (&element->refcount))
+        g_free (element);
+}
+
+
 gboolean
 kiro_sb_remove_sync_callback (KiroSb *self, gulong hook_id)
 {
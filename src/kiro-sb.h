@@ -177,6 +177,258 @@ gboolean    kiro_sb_remove_sync_callback (KiroSb *sb, gulong id);
  */
 void    kiro_sb_clear_sync_callbacks (KiroSb *sb);
 
+/**
+ * KiroSbStreamCallbackFunc:
+ * @first: Sequence number of the first element that was delivered
+ * @delivered: Number of consecutive elements, starting at @first, that were
+ *   fetched
+ * @dropped: Number of elements before @first that were overwritten on the
+ *   remote side before they could be fetched
+ * @user_data: (transfer none): The #user_data which was provided during
+ *   registration of this callback
+ *
+ *   Defines the type of a callback function which will be invoked every time
+ *   a 'cloning' #KiroSb has fetched new elements. The delivered elements can
+ *   be accessed with kiro_sb_get_element.
+ *
+ * Returns: A #KiroContinueFlag deciding whether to keep this callback alive or not
+ * Note:
+ *   Unless the #KiroSb is in lossless mode (see kiro_sb_set_lossless), only
+ *   the newest element is fetched and @delivered is at most 1.
+ * See also:
+ *   kiro_sb_add_stream_callback, kiro_sb_remove_stream_callback
+ */
+typedef KiroContinueFlag (*KiroSbStreamCallbackFunc) (uint64_t first, guint delivered, uint64_t dropped, void *user_data);
+
+/**
+ * kiro_sb_add_stream_callback:
+ * @sb: (transfer none): The #KiroSb to register this callback to
+ * @callback: (transfer none) (scope call): A function pointer to the callback function
+ *
+ *   Adds a #KiroSbStreamCallbackFunc to this #KiroSb which will be invoked
+ *   every time the #KiroSb has fetched new elements or noticed dropped ones.
+ *
+ * Returns: The internal id of the registerd callback
+ * Note:
+ *   Stream callbacks are invoked before the sync callbacks. They will only be
+ *   invoked on a 'cloning' #KiroSb.
+ * See also:
+ *   kiro_sb_remove_stream_callback, kiro_sb_set_lossless
+ */
+gulong    kiro_sb_add_stream_callback (KiroSb *sb, KiroSbStreamCallbackFunc callback, void *user_data);
+
+/**
+ * kiro_sb_remove_stream_callback:
+ * @sb: (transfer none): The #KiroSb to remove the callback from
+ * @id: The id of the callback to be removed
+ *
+ *   Removes the stream callback with the given @id from the internal list.
+ *
+ * Returns: A #gboolean. %TRUE if the callback was found and removed. %FALSE
+ *   otherwise
+ * See also:
+ *   kiro_sb_add_stream_callback
+ */
+gboolean  kiro_sb_remove_stream_callback (KiroSb *sb, gulong id);
+
+/**
+ * KiroSbElement:
+ *
+ *   An immutable, reference counted snapshot of a single element of a
+ *   'cloning' #KiroSb, as it is passed to element callbacks. The snapshot stays
+ *   valid regardless of further syncs for as long as a reference is held.
+ *
+ * See also:
+ *   kiro_sb_add_element_callback, kiro_sb_element_ref, kiro_sb_element_unref
+ */
+typedef struct _KiroSbElement    KiroSbElement;
+
+/**
+ * kiro_sb_element_get_data:
+ * @element: (transfer none): The #KiroSbElement to query
+ *
+ * Returns: (transfer none): A pointer to the content of the element
+ */
+const void* kiro_sb_element_get_data     (KiroSbElement *element);
+
+/**
+ * kiro_sb_element_get_sequence:
+ * @element: (transfer none): The #KiroSbElement to query
+ *
+ * Returns: The sequence number of the element within its #KiroSb
+ */
+uint64_t  kiro_sb_element_get_sequence (KiroSbElement *element);
+
+/**
+ * kiro_sb_element_get_size:
+ * @element: (transfer none): The #KiroSbElement to query
+ *
+ * Returns: The size of the element content in bytes
+ */
+gulong    kiro_sb_element_get_size     (KiroSbElement *element);
+
+/**
+ * kiro_sb_element_ref:
+ * @element: (transfer none): The #KiroSbElement to reference
+ *
+ *   Takes an additional reference on the given @element. Callbacks that want
+ *   to keep the element after they have returned need to do so.
+ *
+ * Returns: (transfer full): The given @element
+ * See also:
+ *   kiro_sb_element_unref
+ */
+KiroSbElement* kiro_sb_element_ref     (KiroSbElement *element);
+
+/**
+ * kiro_sb_element_unref:
+ * @element: (transfer full): The #KiroSbElement to release
+ *
+ *   Releases a reference on the given @element. The element is freed once the
+ *   last reference is gone.
+ *
+ * See also:
+ *   kiro_sb_element_ref
+ */
+void      kiro_sb_element_unref        (KiroSbElement *element);
+
+/**
+ * KiroSbElementCallbackFunc:
+ * @element: (transfer none): Snapshot of the element that was fetched
+ * @user_data: (transfer none): The #user_data which was provided during
+ *   registration of this callback
+ *
+ *   Defines the type of a callback function which will be invoked for every
+ *   element a 'cloning' #KiroSb has fetched.
+ *
+ * Returns: A #KiroContinueFlag deciding whether to keep this callback alive or not
+ * Note:
+ *   If the #KiroSb dispatches to more than one worker (see
+ *   kiro_sb_set_dispatch), the callback might run concurrently for different
+ *   elements and has to be thread safe.
+ * See also:
+ *   kiro_sb_add_element_callback, kiro_sb_remove_element_callback
+ */
+typedef KiroContinueFlag (*KiroSbElementCallbackFunc) (KiroSbElement *element, void *user_data);
+
+/**
+ * kiro_sb_add_element_callback:
+ * @sb: (transfer none): The #KiroSb to register this callback to
+ * @callback: (transfer none) (scope call): A function pointer to the callback function
+ *
+ *   Adds a #KiroSbElementCallbackFunc to this #KiroSb which will be invoked
+ *   with a snapshot of every element the #KiroSb fetches.
+ *
+ * Returns: The internal id of the registerd callback
+ * Note:
+ *   Element callbacks are invoked inside the sync loop of the #KiroSb unless
+ *   a worker pool was configured using kiro_sb_set_dispatch. They will only be
+ *   invoked on a 'cloning' #KiroSb.
+ * See also:
+ *   kiro_sb_remove_element_callback, kiro_sb_set_dispatch
+ */
+gulong    kiro_sb_add_element_callback (KiroSb *sb, KiroSbElementCallbackFunc callback, void *user_data);
+
+/**
+ * kiro_sb_remove_element_callback:
+ * @sb: (transfer none): The #KiroSb to remove the callback from
+ * @id: The id of the callback to be removed
+ *
+ *   Removes the element callback with the given @id from the internal list.
+ *
+ * Returns: A #gboolean. %TRUE if the callback was found and removed. %FALSE
+ *   otherwise
+ * Note:
+ *   Jobs that were already dispatched to a worker will not invoke the
+ *   callback anymore, unless it is running already.
+ * See also:
+ *   kiro_sb_add_element_callback
+ */
+gboolean  kiro_sb_remove_element_callback (KiroSb *sb, gulong id);
+
+/**
+ * KiroSbDispatchPolicy:
+ * @KIRO_SB_DISPATCH_DROP_OLDEST: Discard the oldest pending element when the
+ *   dispatch queue is full. Syncing never waits for the callbacks.
+ * @KIRO_SB_DISPATCH_BLOCK: Stop syncing until the workers have made room in
+ *   the dispatch queue.
+ *
+ *   Decides what a #KiroSb does when its element callbacks can't keep up.
+ */
+typedef enum {
+    KIRO_SB_DISPATCH_DROP_OLDEST = 0,
+    KIRO_SB_DISPATCH_BLOCK
+} KiroSbDispatchPolicy;
+
+/**
+ * kiro_sb_set_dispatch:
+ * @sb: (transfer none): The #KiroSb to perform this operation on
+ * @workers: Number of worker threads. 0 runs the element callbacks inside the
+ *   sync loop (the default)
+ * @max_pending: Maximum number of elements waiting for a worker
+ * @policy: The #KiroSbDispatchPolicy to apply once @max_pending is reached
+ *
+ *   Runs the element callbacks of a 'cloning' #KiroSb on a pool of worker
+ *   threads, so that slow callbacks don't hold back the syncing.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   This has to be called before kiro_sb_clone. Sync and stream callbacks
+ *   are still invoked inside the sync loop. With more than one worker,
+ *   elements might be handled out of order.
+ * See also:
+ *   kiro_sb_add_element_callback, kiro_sb_get_dispatch_dropped
+ */
+gboolean  kiro_sb_set_dispatch (KiroSb *sb, guint workers, guint max_pending, KiroSbDispatchPolicy policy);
+
+/**
+ * kiro_sb_get_dispatch_dropped:
+ * @sb: (transfer none): The #KiroSb to query
+ *
+ * Returns: The number of elements that were discarded because the dispatch
+ *   queue was full
+ * See also:
+ *   kiro_sb_set_dispatch
+ */
+guint64   kiro_sb_get_dispatch_dropped (KiroSb *sb);
+
+/**
+ * kiro_sb_set_depth:
+ * @sb: (transfer none): The #KiroSb to perform this operation on
+ * @depth: Number of elements to keep
+ *
+ *   Sets the number of elements a 'serving' #KiroSb keeps in its internal
+ *   ring buffer (3 by default). If called before kiro_sb_serve, the ring
+ *   buffer is created with the given depth. If the #KiroSb is already serving,
+ *   its ring buffer is resized using kiro_sb_resize.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   The depth of a 'cloning' #KiroSb is always the one of the #KiroSb it
+ *   clones. A deeper ring buffer allows lossless clones to fall behind
+ *   further before elements are dropped.
+ * See also:
+ *   kiro_sb_serve, kiro_sb_resize, kiro_sb_set_lossless
+ */
+gboolean  kiro_sb_set_depth   (KiroSb *sb, guint depth);
+
+/**
+ * kiro_sb_set_lossless:
+ * @sb: (transfer none): The #KiroSb to perform this operation on
+ * @lossless: %TRUE to fetch every element, %FALSE to only fetch the newest
+ *
+ *   In lossless mode, a 'cloning' #KiroSb fetches all elements that were
+ *   pushed since its last sync, instead of only the newest one. They are
+ *   fetched in one batched read, together with the remote header.
+ *
+ * Note:
+ *   Elements that were already overwritten on the remote side by the time they
+ *   are read are reported as dropped to the stream callbacks.
+ * See also:
+ *   kiro_sb_add_stream_callback, kiro_sb_set_depth
+ */
+void      kiro_sb_set_lossless (KiroSb *sb, gboolean lossless);
+
 /**
  * kiro_sb_serve:
  * @sb: (transfer none): The #KiroSb to perform this operation on
@@ -223,6 +475,28 @@ gboolean    kiro_sb_serve           (KiroSb *sb, gulong size, const gchar *addr,
  */
 gboolean    kiro_sb_clone       (KiroSb *sb, const gchar *address, const gchar *port);
 
+/**
+ * kiro_sb_resize:
+ * @sb: (transfer none): The #KiroSb to perform this operation on
+ * @depth: New number of elements to keep in the internal ring buffer
+ *
+ *   Changes the number of elements a 'serving' #KiroSb keeps. The most recent
+ *   elements are migrated into the new memory and keep their sequence
+ *   numbers. All connected clients are switched over to the new memory
+ *   before the old memory is freed, so cloning #KiroSbs continue without a
+ *   gap.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   This operation is only valid for a 'serving' #KiroSb. It must not be
+ *   called concurrently with kiro_sb_push or kiro_sb_push_dma. Clients that
+ *   do not acknowledge the switch in time are disconnected. On failure, the
+ *   #KiroSb keeps its previous memory and depth.
+ * See also:
+ *   kiro_sb_serve, kiro_trb_resize, kiro_server_realloc
+ */
+gboolean    kiro_sb_resize      (KiroSb *sb, guint depth);
+
 /**
  * kiro_sb_get_size:
  * @sb: (transfer none): The #KiroSb to perform this operation on
@@ -283,14 +557,50 @@ void     kiro_sb_thaw         (KiroSb *sb);
  */
 void*   kiro_sb_get_data     (KiroSb *sb);
 
+/**
+ * kiro_sb_get_element:
+ * @sb: (transfer none) The #KiroSb to get the data from
+ * @sequence: Sequence number of the element
+ *
+ *   Returns a void pointer to the element with the given sequence number,
+ *   if it is still held by the #KiroSb. The first element ever pushed has the
+ *   sequence number 0.
+ *
+ * Returns: (transfer none) (type gulong):
+ *   A void pointer to the element, or %NULL if the element is not held (or,
+ *   on a 'cloning' #KiroSb, was not fetched)
+ * Note:
+ *   The same restrictions as for kiro_sb_get_data apply.
+ * See also:
+ *   kiro_sb_get_offset, kiro_sb_add_stream_callback, kiro_sb_get_data
+ */
+void*   kiro_sb_get_element  (KiroSb *sb, uint64_t sequence);
+
+/**
+ * kiro_sb_get_offset:
+ * @sb: (transfer none) The #KiroSb to query
+ *
+ *   Returns the number of elements that were pushed into the #KiroSb (or,
+ *   for a 'cloning' #KiroSb, that were synchronized so far). The newest
+ *   element therefore has the sequence number offset - 1.
+ *
+ * Returns: The current offset of the #KiroSb
+ * See also:
+ *   kiro_sb_get_element
+ */
+uint64_t kiro_sb_get_offset  (KiroSb *sb);
+
 /**
  * kiro_sb_get_data_blocking:
  * @sb: (transfer none) The #KiroSb to get the data from
  *
  *   Calling this function will do the same thing as kiro_sb_get_data, but it
  *   will internaly wait until new data has arived before returning it.
+ *   Waiting threads sleep and are all woken up once the next sync has fetched
+ *   a new element. This operation is only valid for a 'cloning' #KiroSb.
  *
- * Returns: (transfer none) (type gulong): A void pointer the stored data
+ * Returns: (transfer none) (type gulong): A void pointer the stored data, or
+ *   %NULL if the #KiroSb was stopped while waiting
  * Note:
  *   The returned pointer to the element might become invalid at any time by
  *   automatic or manual sync. Under no circumstances might the returned pointer
@@ -298,10 +608,28 @@ void*   kiro_sb_get_data     (KiroSb *sb);
  *   after a sync, you should use memcpy().
  * See also:
  *   kiro_sb_freeze, kiro_sb_serve, kiro_sb_clone, kiro_sb_push,
- *   kiro_sb_push_dma, kiro_sb_get_data
+ *   kiro_sb_push_dma, kiro_sb_get_data, kiro_sb_get_data_blocking_timeout
  */
 void*   kiro_sb_get_data_blocking  (KiroSb *sb);
 
+/**
+ * kiro_sb_get_data_blocking_timeout:
+ * @sb: (transfer none) The #KiroSb to get the data from
+ * @timeout_ms: Maximum time to wait for new data in milliseconds
+ *
+ *   Same as kiro_sb_get_data_blocking, but gives up if no new data has
+ *   arrived within @timeout_ms milliseconds. A @timeout_ms of 0 waits
+ *   indefinitely.
+ *
+ * Returns: (transfer none) (type gulong): A void pointer the stored data, or
+ *   %NULL on timeout or if the #KiroSb was stopped while waiting
+ * Note:
+ *   The same restrictions as for kiro_sb_get_data_blocking apply.
+ * See also:
+ *   kiro_sb_get_data_blocking, kiro_sb_get_data
+ */
+void*   kiro_sb_get_data_blocking_timeout  (KiroSb *sb, guint timeout_ms);
+
 /**
  * kiro_sb_push:
  * @sb: (transfer none) The #KiroSb to get the data from
@@ -335,11 +663,71 @@ gboolean kiro_sb_push       (KiroSb *sb, void *data);
  *   pointed memory then was specified with the initial call to kiro_sb_serve or
  *   returned by kiro_sb_get_size.  Under no circumstances might the returned
  *   pointer be freed by the user.
+ *   The returned element is not published before it is committed with
+ *   kiro_sb_push_dma_commit, the next push or kiro_sb_publish. On a
+ *   coalescing #KiroSb, this holds back its whole batch.
  * See also:
- *   kiro_sb_get_size, kiro_sb_serve
+ *   kiro_sb_get_size, kiro_sb_serve, kiro_sb_push_dma_commit
  */
 void* kiro_sb_push_dma      (KiroSb *sb);
 
+/**
+ * kiro_sb_push_dma_commit:
+ * @sb: (transfer none) The #KiroSb to perform this operation on
+ *
+ *   Tells a 'serving' #KiroSb that the element returned by the last call to
+ *   kiro_sb_push_dma has been written completely. Without coalescing, the
+ *   element is published right away. Otherwise, its batch is published if
+ *   the element filled it or the time window of the batch is over.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   If no element from kiro_sb_push_dma is pending, this call has no effect.
+ * See also:
+ *   kiro_sb_push_dma, kiro_sb_set_coalescing
+ */
+gboolean kiro_sb_push_dma_commit (KiroSb *sb);
+
+/**
+ * kiro_sb_set_coalescing:
+ * @sb: (transfer none) The #KiroSb to perform this operation on
+ * @max_count: Publish a batch after this many pushes. 0 for no limit
+ * @max_delay_us: Publish a batch at most this many microseconds after its
+ *   first push. 0 for no limit
+ *
+ *   Makes a 'serving' #KiroSb coalesce pushes into batches. The elements of a
+ *   batch are stored right away, but they are published to the clones with a
+ *   single header update and update notification once the batch is closed.
+ *   Passing 0 for both @max_count and @max_delay_us disables coalescing (the
+ *   default), so every push is published on its own.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * Note:
+ *   A batch is always closed before it would overwrite its own first element,
+ *   regardless of @max_count. If only @max_count is given, the last elements
+ *   of a burst stay unpublished until the next push or kiro_sb_publish.
+ *   An element from kiro_sb_push_dma holds back its batch until it is
+ *   committed (see kiro_sb_push_dma_commit).
+ *   Lossless clones (see kiro_sb_set_lossless) receive a whole batch in a
+ *   single stream callback.
+ * See also:
+ *   kiro_sb_publish, kiro_sb_push, kiro_trb_begin_batch
+ */
+gboolean kiro_sb_set_coalescing (KiroSb *sb, guint max_count, guint max_delay_us);
+
+/**
+ * kiro_sb_publish:
+ * @sb: (transfer none) The #KiroSb to perform this operation on
+ *
+ *   Closes and publishes the current batch of a coalescing 'serving' #KiroSb
+ *   immediately, e.g. at the end of a burst of pushes.
+ *
+ * Returns: A gboolean. TRUE = success. FALSE = fail.
+ * See also:
+ *   kiro_sb_set_coalescing
+ */
+gboolean kiro_sb_publish     (KiroSb *sb);
+
 
 G_END_DECLS
 
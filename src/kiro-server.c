@@ -52,41 +52,124 @@ struct _KiroServerPrivate {
     gboolean                    close_signal;    // Flag used to signal event listening to stop for server shutdown
     GThread                     *main_thread;    // Main KIRO server thread
 
+    uint64_t                    update_sequence; // Sequence number given to the last kiro_server_notify_update
+    uint64_t                    update_previous; // Sequence number of the update before that
+    uint64_t                    update_offset;   // Changed range of the last update
+    uint64_t                    update_size;
+    GList                       *update_requests;// Clients waiting to be notified about the next update
+
+    /* Reallocation handshake (protected by realloc_handling) */
+    gint                        realloc_state;   // REALLOC_IDLE, REALLOC_REQUESTED or REALLOC_RUNNING
+    KiroServer                  *realloc_server; // The server object handed to the realloc callback
+    void                        *realloc_mem;    // Memory that is to be provided once the realloc starts
+    size_t                      realloc_size;    // Size in bytes of realloc_mem
+    guint                       realloc_timeout; // Time in milliseconds the clients have to ACK
+    KiroServerReallocCallback   realloc_callback;// Invoked once the realloc is done
+    void                        *realloc_user_data;
+    GList                       *realloc_pending;// IDs of the clients that still need to ACK
+    GList                       *realloc_acked;  // IDs of the clients that have ACKed
+    GList                       *realloc_failed; // IDs of the clients that failed to ACK
+
+    /* Additional memory regions (protected by region_handling) */
+    struct ibv_pd               *pd;             // Protection Domain shared by all clients
+    GList                       *regions;        // List of struct kiro_server_region
+    guint                       next_region_id;  // ID for the next region that is added
+    struct kiro_region_directory *directory;     // Table of all regions, readable by the clients
+    struct ibv_mr               *directory_mr;   // Registration of the directory with the shared pd
+
+    /* Dirty tracking (protected by dirty_handling) */
+    struct kiro_version_table   *versions;       // Version of every block of the memory, readable by the clients
+    size_t                      versions_size;   // Size in bytes of the version table
+    void                        *versions_mem;   // Memory the version table was created for
+    gint                        versions_region; // Region ID of the version table. 0 while there is none
+    uint64_t                    dirty_version;   // Version given to the blocks of the last kiro_server_mark_dirty
+
+    /* Consistent snapshots (protected by seqlock_handling) */
+    uint64_t                    *seqlock;        // Sequence counter. Odd while a write is in progress
+    gint                        seqlock_region;  // Region ID of the sequence counter. 0 while there is none
+
+    /* Push mode (protected by push_handling) */
+    GList                       *subscribers;    // Clients that asked for pushes
+    uint64_t                    push_sequence;   // Sequence number of the last kiro_server_publish
+
     uv_loop_t *uv_event_loop;                   // libuv event loop handle
     uv_poll_t *uv_ec_fd_poll;                   // libuv poll handle for event channel file descriptor - the trigger for process_cm_event
+    uv_async_t *uv_realloc_async;               // libuv async handle to start a realloc on the event loop
+    uv_timer_t *uv_realloc_timer;               // libuv timer handle for the realloc timeout
 };
 
+enum {
+    REALLOC_IDLE = 0,
+    REALLOC_REQUESTED,
+    REALLOC_RUNNING
+};
 
-G_DEFINE_TYPE (KiroServer, kiro_server, G_TYPE_OBJECT);
 
+G_DEFINE_TYPE (KiroServer, kiro_server, G_TYPE_OBJECT);
 
-// List of clients that were asked to realloc their memory
-GList *realloc_list;
 
 // Temporary lock for connecting clients
 G_LOCK_DEFINE (connection_handling);
 G_LOCK_DEFINE (rdma_handling);
 
-// Used to prevent raceconditions during realloc timeout
-G_LOCK_DEFINE (realloc_timeout);
+// Protects the reallocation handshake state
+G_LOCK_DEFINE (realloc_handling);
+
+// Protects the region list and directory
+G_LOCK_DEFINE (region_handling);
+
+// Protects the list of subscribers and their push memory
+G_LOCK_DEFINE (push_handling);
+
+// Protects the update notification state
+G_LOCK_DEFINE (update_handling);
+
+// Protects the version table of the dirty tracking
+G_LOCK_DEFINE (dirty_handling);
+
+// Held from kiro_server_write_begin to kiro_server_write_end
+G_LOCK_DEFINE (seqlock_handling);
+
+struct kiro_server_region {
+
+    guint                       id;              // ID of the region, as given to the clients
+    gchar                       *name;           // Name of the region
+    void                        *mem;            // Pointer to the memory of the region
+    size_t                      size;            // Size of the region in bytes
+    struct ibv_mr               *mr;             // Registration with the shared pd (if there is one yet)
+};
 
 struct kiro_client_connection {
 
     guint                       id;              // Client identification (Easy access)
+    KiroServerPrivate           *server;         // The server this client is connected to
+    uint64_t                    update_known;    // Latest sequence number the client knows of
     uv_poll_t                   *uv_recv_cq_fd_poll;// libuv poll handle for receive comp q file descriptor - the trigger for process_rdma_event
     struct rdma_cm_id           *conn;           // Connection Manager ID of the client
     struct kiro_rdma_mem        *backup_mri;     // Backup MRI for reallocation
+    struct ibv_mr               push_mri;        // Client memory that kiro_server_publish writes to
+    gboolean                    push_ready;      // push_mri matches the memory that is currently provided
+    uint64_t                    group;           // Group of connections of the same client (see kiro_rail_info)
+    guint                       rail;            // Number of this connection in its group. 0 for the main connection
 };
 
 
 G_LOCK_DEFINE (send_lock);
 
+/*
+ * Sends the given message over the connection. The message is copied into
+ * the registered send memory of the connection only while send_lock is held,
+ * so callers from other threads than the event loop can't overwrite a message
+ * that is still being sent.
+ */
 static inline gboolean
-send_msg (struct rdma_cm_id *id, struct kiro_rdma_mem *r)
+send_msg (struct rdma_cm_id *id, struct kiro_ctrl_msg *msg)
 {
     gboolean retval = TRUE;
+    struct kiro_rdma_mem *r = ((struct kiro_connection_context *)id->context)->cf_mr_send;
     G_LOCK (send_lock);
     g_debug ("Sending message");
+    memcpy (r->mem, msg, sizeof (struct kiro_ctrl_msg));
     if (rdma_post_send (id, id, r->mem, r->size, r->mr, IBV_SEND_SIGNALED)) {
         retval = FALSE;
     }
@@ -129,6 +212,9 @@ kiro_server_init (KiroServer *self)
     memset (priv, 0, sizeof (&priv));
 
     priv->uv_ec_fd_poll = (uv_poll_t *) malloc (sizeof(uv_poll_t));
+    priv->uv_realloc_async = (uv_async_t *) malloc (sizeof(uv_async_t));
+    priv->uv_realloc_timer = (uv_timer_t *) malloc (sizeof(uv_timer_t));
+    priv->directory = g_malloc0 (sizeof (struct kiro_region_directory));
 
     priv->uv_event_loop = uv_default_loop();
     // Following is not required in the current scenario. 
@@ -145,6 +231,17 @@ kiro_server_finalize (GObject *object)
     //Clean up the server
     kiro_server_stop (self);
 
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_server_region *region = (struct kiro_server_region *)current->data;
+        g_free (region->name);
+        g_free (region);
+    }
+    g_list_free (priv->regions);
+    g_free (priv->directory);
+    g_free (priv->versions);
+    g_free (priv->seqlock);
+
     G_OBJECT_CLASS (kiro_server_parent_class)->finalize (object);
 }
 
@@ -159,6 +256,96 @@ kiro_server_class_init (KiroServerClass *klass)
 }
 
 
+// Must be called with region_handling held
+static void
+publish_regions (KiroServerPrivate *priv)
+{
+    struct kiro_region_directory *dir = priv->directory;
+
+    // Clients that read the directory while it changes see an odd generation
+    // and read it again
+    dir->generation++;
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+
+    memset (dir->entries, 0, sizeof (dir->entries));
+    guint slot = 0;
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_server_region *region = (struct kiro_server_region *)current->data;
+        if (!region->mr)
+            continue;
+
+        struct kiro_region_entry *entry = &dir->entries[slot++];
+        entry->id = region->id;
+        entry->rkey = region->mr->rkey;
+        entry->addr = (uint64_t) (uintptr_t) region->mem;
+        entry->length = region->size;
+        g_strlcpy (entry->name, region->name, KIRO_REGION_NAME_LENGTH);
+    }
+
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    dir->generation++;
+}
+
+
+static struct ibv_mr *
+register_region (KiroServerPrivate *priv, void *mem, size_t size)
+{
+    struct ibv_mr *mr = ibv_reg_mr (priv->pd, mem, size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ);
+    if (!mr)
+        g_warning ("Failed to register memory region: %s", strerror (errno));
+    return mr;
+}
+
+
+static void
+setup_shared_pd (KiroServerPrivate *priv, struct ibv_context *verbs)
+{
+    priv->pd = ibv_alloc_pd (verbs);
+    if (!priv->pd) {
+        g_warning ("Failed to create the shared Protection Domain: %s. Regions won't be available.", strerror (errno));
+        return;
+    }
+
+    priv->directory_mr = register_region (priv, priv->directory, sizeof (struct kiro_region_directory));
+    if (!priv->directory_mr) {
+        ibv_dealloc_pd (priv->pd);
+        priv->pd = NULL;
+        return;
+    }
+
+    // Regions that were added before the first client connected
+    G_LOCK (region_handling);
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_server_region *region = (struct kiro_server_region *)current->data;
+        region->mr = register_region (priv, region->mem, region->size);
+    }
+    publish_regions (priv);
+    G_UNLOCK (region_handling);
+}
+
+
+static void
+teardown_shared_pd (KiroServerPrivate *priv)
+{
+    if (!priv->pd)
+        return;
+
+    G_LOCK (region_handling);
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_server_region *region = (struct kiro_server_region *)current->data;
+        if (region->mr)
+            ibv_dereg_mr (region->mr);
+        region->mr = NULL;
+    }
+    G_UNLOCK (region_handling);
+
+    ibv_dereg_mr (priv->directory_mr);
+    priv->directory_mr = NULL;
+    ibv_dealloc_pd (priv->pd);
+    priv->pd = NULL;
+}
+
+
 static int
 connect_client (struct rdma_cm_id *client)
 {
@@ -211,7 +398,7 @@ error:
 
 
 static int
-grant_client_access (struct rdma_cm_id *client, void *mem, size_t mem_size, guint type)
+grant_client_access (struct rdma_cm_id *client, void *mem, size_t mem_size, guint type, struct ibv_mr *dir_mr)
 {
     struct kiro_connection_context *ctx = (struct kiro_connection_context *) (client->context);
     ctx->rdma_mr = (struct kiro_rdma_mem *)g_try_malloc0 (sizeof (struct kiro_rdma_mem));
@@ -223,6 +410,9 @@ grant_client_access (struct rdma_cm_id *client, void *mem, size_t mem_size, guin
 
     ctx->rdma_mr->mem = mem;
     ctx->rdma_mr->size = mem_size;
+    // Unlike the additional regions, the main memory is registered once per
+    // client, since its registration is owned and released by the connection
+    // context.
     ctx->rdma_mr->mr = rdma_reg_read (client, ctx->rdma_mr->mem, ctx->rdma_mr->size);
 
     if (!ctx->rdma_mr->mr) {
@@ -231,12 +421,14 @@ grant_client_access (struct rdma_cm_id *client, void *mem, size_t mem_size, guin
         return -1;
     }
 
-    struct kiro_ctrl_msg *msg = (struct kiro_ctrl_msg *) (ctx->cf_mr_send->mem);
+    struct kiro_ctrl_msg msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_type = type;
+    msg.peer_mri = * (ctx->rdma_mr->mr);
+    if (dir_mr)
+        msg.dir_mri = *dir_mr;
 
-    msg->msg_type = type;
-    msg->peer_mri = * (ctx->rdma_mr->mr);
-
-    if (!send_msg (client, ctx->cf_mr_send)) {
+    if (!send_msg (client, &msg)) {
         g_warning ("Failure while trying to post SEND: %s", strerror (errno));
         kiro_destroy_rdma_memory (ctx->rdma_mr);
         return -1;
@@ -246,6 +438,93 @@ grant_client_access (struct rdma_cm_id *client, void *mem, size_t mem_size, guin
     return 0;
 }
 
+static void
+send_update (struct kiro_client_connection *cc, uint64_t known)
+{
+    KiroServerPrivate *priv = cc->server;
+    struct kiro_ctrl_msg msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_type = KIRO_UPDATE;
+    msg.sequence = priv->update_sequence;
+
+    // Only the range of the last update is remembered. A client that has
+    // missed more than that is told that everything has changed.
+    if (known == priv->update_previous) {
+        msg.offset = priv->update_offset;
+        msg.size = priv->update_size;
+    }
+    else {
+        msg.offset = 0;
+        msg.size = priv->mem_size;
+    }
+
+    if (!send_msg (cc->conn, &msg))
+        g_warning ("Failure while trying to post UPDATE send to client %u: %s", cc->id, strerror (errno));
+}
+
+
+static void
+forget_update_request (struct kiro_client_connection *cc)
+{
+    G_LOCK (update_handling);
+    cc->server->update_requests = g_list_remove (cc->server->update_requests, cc);
+    G_UNLOCK (update_handling);
+}
+
+static void
+forget_subscription (struct kiro_client_connection *cc)
+{
+    G_LOCK (push_handling);
+    cc->server->subscribers = g_list_remove (cc->server->subscribers, cc);
+    cc->push_ready = FALSE;
+    G_UNLOCK (push_handling);
+}
+
+
+static void
+drop_backup_mri (struct kiro_client_connection *cc)
+{
+    // The old memory stays registered until the client has switched over
+    if (cc->backup_mri) {
+        if (cc->backup_mri->mr)
+            ibv_dereg_mr (cc->backup_mri->mr);
+        g_free (cc->backup_mri);
+        cc->backup_mri = NULL;
+    }
+}
+
+
+static void start_realloc (uv_async_t *handle);
+static void realloc_done (uv_timer_t *timer);
+
+// Must be called with realloc_handling held
+static void
+finish_realloc_soon (KiroServerPrivate *priv)
+{
+    // Finishing the realloc needs the connection handling locks, which the
+    // callers usually hold. Let the timer fire on the next loop iteration
+    // instead.
+    if (!priv->realloc_pending && priv->realloc_state == REALLOC_RUNNING && !priv->close_signal)
+        uv_timer_start (priv->uv_realloc_timer, realloc_done, 0, 0);
+}
+
+
+static void
+forget_realloc_request (struct kiro_client_connection *cc)
+{
+    KiroServerPrivate *priv = cc->server;
+    G_LOCK (realloc_handling);
+    GList *pending = g_list_find (priv->realloc_pending, GUINT_TO_POINTER (cc->id));
+    if (pending) {
+        g_debug ("Client %u disconnected before it ACKed the reallocation request", cc->id);
+        priv->realloc_pending = g_list_delete_link (priv->realloc_pending, pending);
+        priv->realloc_failed = g_list_append (priv->realloc_failed, GUINT_TO_POINTER (cc->id));
+        finish_realloc_soon (priv);
+    }
+    G_UNLOCK (realloc_handling);
+    drop_backup_mri (cc);
+}
+
 /** Modified to match uv_poll_cb **/
 void 
 server_process_rdma_event (uv_poll_t *handle, int status __attribute__ ((unused)), int events __attribute__ ((unused)))
@@ -283,10 +562,11 @@ server_process_rdma_event (uv_poll_t *handle, int status __attribute__ ((unused)
     switch (type) {
         case KIRO_PING:
         {
-            struct kiro_ctrl_msg *msg = (struct kiro_ctrl_msg *) (ctx->cf_mr_send->mem);
-            msg->msg_type = KIRO_PONG;
+            struct kiro_ctrl_msg msg;
+            memset (&msg, 0, sizeof (msg));
+            msg.msg_type = KIRO_PONG;
 
-            if (!send_msg (cc->conn, ctx->cf_mr_send)) {
+            if (!send_msg (cc->conn, &msg)) {
                 g_warning ("Failure while trying to post PONG send: %s", strerror (errno));
                 goto done;
             }
@@ -295,19 +575,45 @@ server_process_rdma_event (uv_poll_t *handle, int status __attribute__ ((unused)
         case KIRO_ACK_RDMA:
         {
             g_debug ("ACK received");
-            if (G_TRYLOCK (realloc_timeout)) {
-                g_debug ("Client %i has ACKed the reallocation request", cc->id);
-                GList *client = g_list_find (realloc_list, (gpointer)cc);
-                if (client) {
-                    realloc_list = g_list_remove_link (realloc_list, client);
-                    if (cc->backup_mri->mr)
-                        ibv_dereg_mr (cc->backup_mri->mr);
-                    g_free (cc->backup_mri);
-                    cc->backup_mri = NULL;
-                    g_debug ("Client %i removed from realloc_list", cc->id);
-                }
-                G_UNLOCK (realloc_timeout);
+            KiroServerPrivate *priv = cc->server;
+            G_LOCK (realloc_handling);
+            GList *pending = g_list_find (priv->realloc_pending, GUINT_TO_POINTER (cc->id));
+            if (pending) {
+                g_debug ("Client %u has ACKed the reallocation request", cc->id);
+                priv->realloc_pending = g_list_delete_link (priv->realloc_pending, pending);
+                priv->realloc_acked = g_list_append (priv->realloc_acked, GUINT_TO_POINTER (cc->id));
+                drop_backup_mri (cc);
+                finish_realloc_soon (priv);
             }
+            G_UNLOCK (realloc_handling);
+            break;
+        }
+        case KIRO_SUBSCRIBE:
+        {
+            struct kiro_ctrl_msg *msg = (struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem;
+            g_debug ("Client %u subscribed for pushes", cc->id);
+            G_LOCK (push_handling);
+            cc->push_mri = msg->peer_mri;
+            cc->push_ready = TRUE;
+            if (!g_list_find (cc->server->subscribers, cc))
+                cc->server->subscribers = g_list_append (cc->server->subscribers, cc);
+            G_UNLOCK (push_handling);
+            break;
+        }
+        case KIRO_REQ_UPDATE:
+        {
+            uint64_t known = ((struct kiro_ctrl_msg *)ctx->cf_mr_recv->mem)->sequence;
+            G_LOCK (update_handling);
+            if (cc->server->update_sequence > known) {
+                // The client has already missed an update. Tell it right away.
+                send_update (cc, known);
+            }
+            else {
+                cc->update_known = known;
+                if (!g_list_find (cc->server->update_requests, cc))
+                    cc->server->update_requests = g_list_append (cc->server->update_requests, cc);
+            }
+            G_UNLOCK (update_handling);
             break;
         }
         default:
@@ -361,6 +667,12 @@ server_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
         }
 
         memcpy (ev, active_event, sizeof (*active_event));
+
+        // The private data is gone once the event is acknowledged
+        struct kiro_rail_info rail_info = { 0, 0 };
+        if (ev->event == RDMA_CM_EVENT_CONNECT_REQUEST && ev->param.conn.private_data
+            && ev->param.conn.private_data_len >= sizeof (struct kiro_rail_info))
+            memcpy (&rail_info, ev->param.conn.private_data, sizeof (struct kiro_rail_info));
         rdma_ack_cm_event (active_event);
 
         if (ev->event == RDMA_CM_EVENT_CONNECT_REQUEST) {
@@ -381,11 +693,19 @@ server_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
                     goto fail;
                 }
 
+                // All clients on the same device share one protection
+                // domain, so the regions only need to be registered once
+                if (!priv->pd)
+                    setup_shared_pd (priv, ev->id->verbs);
+                if (priv->pd && priv->pd->context == ev->id->verbs)
+                    ev->id->pd = priv->pd;
+
                 if (connect_client (ev->id))
                     goto fail;
 
                 // Post a welcoming "Receive" for handshaking
-                if (grant_client_access (ev->id, priv->mem, priv->mem_size, KIRO_ACK_RDMA))
+                struct ibv_mr *dir_mr = (priv->pd && ev->id->pd == priv->pd) ? priv->directory_mr : NULL;
+                if (grant_client_access (ev->id, priv->mem, priv->mem_size, KIRO_ACK_RDMA, dir_mr))
                     goto fail;
 
                 ibv_req_notify_cq (ev->id->recv_cq, 0); // Make the respective Queue push events onto the channel
@@ -399,6 +719,12 @@ server_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
                 // Fill the client connection container. Allocate a uv_poll_t handle and add to clients list
                 cc->id = ctx->identifier;
                 cc->conn = ev->id;
+                cc->server = priv;
+                cc->update_known = 0;
+                cc->backup_mri = NULL;
+                cc->push_ready = FALSE;
+                cc->group = rail_info.group;
+                cc->rail = rail_info.rail;
                 cc->uv_recv_cq_fd_poll = (uv_poll_t *) malloc (sizeof(uv_poll_t));
                 priv->clients = g_list_append (priv->clients, (gpointer)cc);
                 GList *client = g_list_find (priv->clients, (gpointer)cc);
@@ -413,6 +739,8 @@ server_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
                 uv_poll_start(cc->uv_recv_cq_fd_poll, UV_READABLE, server_process_rdma_event);        // Equivalent to g_io_add_watch
 
                 g_debug ("Client connection assigned with ID %u", ctx->identifier);
+                if (cc->rail)
+                    g_debug ("Client %u is rail %u of group %016lx", cc->id, cc->rail, cc->group);
                 g_debug ("Currently %u clients in total are connected", g_list_length (priv->clients));
                 break;
 
@@ -436,6 +764,9 @@ server_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
                 g_debug ("Got disconnect request from client ID %u", ctx->identifier);
                 struct kiro_client_connection *cc = (struct kiro_client_connection *)ctx->container;
                 uv_unref((uv_handle_t *)cc->uv_recv_cq_fd_poll);    // Unref poll handle
+                forget_update_request (cc);
+                forget_realloc_request (cc);
+                forget_subscription (cc);
                 priv->clients = g_list_delete_link (priv->clients, client);
                 g_free (cc);
                 ctx->container = NULL;
@@ -449,9 +780,11 @@ server_process_cm_event (uv_poll_t *handle, int status __attribute__ ((unused)),
             // create manually. So we also need to clean it up manually.
             // This needs to be done AFTER the connection is brought down, so we
             // buffer the pointer to the pd and clean it up afterwards.
+            // The pd that is shared by all clients stays until the server stops.
             struct ibv_pd *pd = ev->id->pd;
             kiro_destroy_connection (& (ev->id));
-            g_free (pd);
+            if (pd != priv->pd)
+                g_free (pd);
 
             g_debug ("Connection closed successfully. %u connected clients remaining", g_list_length (priv->clients));
         }
@@ -570,6 +903,11 @@ kiro_server_start (KiroServer *self, const char *address, const char *port, void
     // Initiate poll on event channel fd and start poll
     uv_poll_init (priv->uv_event_loop, priv->uv_ec_fd_poll, priv->ec->fd);
     uv_poll_start(priv->uv_ec_fd_poll, UV_READABLE, server_process_cm_event);
+    // Reallocations are started and timed on the event loop
+    priv->uv_realloc_async->data = (void *) priv;
+    uv_async_init (priv->uv_event_loop, priv->uv_realloc_async, start_realloc);
+    priv->uv_realloc_timer->data = (void *) priv;
+    uv_timer_init (priv->uv_event_loop, priv->uv_realloc_timer);
     // Spawn a new thread for libuv event loop to run
     priv->main_thread = g_thread_new ("KIRO server libuv event loop", start_server_event_loop, (gpointer) priv->uv_event_loop);
 
@@ -589,6 +927,9 @@ disconnect_client (gpointer data, gpointer user_data)
         struct kiro_connection_context *ctx = (struct kiro_connection_context *) (id->context);
         g_debug ("Disconnecting client: %u", ctx->identifier);
         uv_unref((uv_handle_t *)cc->uv_recv_cq_fd_poll);    // Unref poll handle
+        forget_update_request (cc);
+        forget_realloc_request (cc);
+        forget_subscription (cc);
 
         // Note:
         // The ProtectionDomain needs to be buffered and freed manually.
@@ -596,160 +937,636 @@ disconnect_client (gpointer data, gpointer user_data)
         // create manually. So we also need to clean it up manually.
         // This needs to be done AFTER the connection is brought down, so we
         // buffer the pointer to the pd and clean it up afterwards.
+        // The pd that is shared by all clients stays until the server stops.
         struct ibv_pd *pd = cc->conn->pd;
+        gboolean shared = (pd == cc->server->pd);
         kiro_destroy_connection (&(cc->conn));
         g_free (cc);
-        g_free (pd);
+        if (!shared)
+            g_free (pd);
     }
 }
 
 
-void
-request_client_realloc (gpointer data, gpointer user_data) {
-
-    if (!data || !user_data) {
-        g_critical ("Either client or server pointer was lost during client reconnect!");
-        // The client will remain in the old list, never receive the
-        // reallocation request, therefore never send an ACK and therefore will
-        // be forcefully disconnected once the timeout happens.
-        return;
-    }
-
-    realloc_list = g_list_append (realloc_list, data);
-
-    struct kiro_client_connection *cc = (struct kiro_client_connection *)data;
+static gboolean
+request_client_realloc (struct kiro_client_connection *cc, struct kiro_rdma_mem *new_rdma_mem)
+{
     struct kiro_connection_context *ctx = (struct kiro_connection_context *)cc->conn->context;
 
-    // user_data is used to pass the information about the new RDMA memory to
-    // this function. It is encapsulated in a kiro_rdma_mem struct.
-    struct kiro_rdma_mem *new_rdma_mem = (struct kiro_rdma_mem *)user_data;
+    // The client subscribes again once it has switched to its new memory
+    G_LOCK (push_handling);
+    cc->push_ready = FALSE;
+    G_UNLOCK (push_handling);
 
     cc->backup_mri = ctx->rdma_mr;
     ctx->rdma_mr = NULL;
-    g_debug ("Requesting REALLOC for client %i", cc->id);
-    if (grant_client_access (cc->conn, new_rdma_mem->mem, new_rdma_mem->size, KIRO_REALLOC)) {
+
+    g_debug ("Requesting REALLOC for client %u", cc->id);
+    if (grant_client_access (cc->conn, new_rdma_mem->mem, new_rdma_mem->size, KIRO_REALLOC, NULL)) {
         ctx->rdma_mr = cc->backup_mri;
         cc->backup_mri = NULL;
-        g_warning ("Failed to request REALLOC for client %i", cc->id);
-        G_UNLOCK (rdma_handling);
-        return;
+        g_warning ("Failed to request REALLOC for client %u", cc->id);
+        return FALSE;
     }
-    g_debug ("Client %i REALLOC request sent.", cc->id);
+    g_debug ("Client %u REALLOC request sent.", cc->id);
+    return TRUE;
 }
 
 
-volatile gboolean timeout_done = FALSE;
-
-gboolean
-client_realloc_timeout (gpointer data) {
-
-    (void) data;
-    g_debug ("TIMEOUT OCCURED");
-    timeout_done = TRUE;
-    return TRUE;
+static struct kiro_client_connection *
+find_client (KiroServerPrivate *priv, guint id)
+{
+    for (GList *current = priv->clients; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
+        if (cc->id == id)
+            return cc;
+    }
+    return NULL;
 }
 
 
 /*
  * NOTE:
- * Since all currently connected clients are guaranteed to be stored in the
- * priv->clients list, using that one to detect failed ACKs makes much more
- * sense, since clients that failed to be informed of reallocation would simply
- * never send an ACK, stay on the list, and then securely be disconnected after
- * the timeout.
+ * The reallocation handshake runs entirely on the event loop, so new
+ * connections, PINGs and update requests keep being served while the clients
+ * switch over to the new memory.
  *
- * Therefore, we first try to send the REALLOC request to the clients, then try
- * to copy them to the realloc_list. Once this is done, the realloc_list will only
- * contain the list of clients that are guaranteed to have received the REALLOC
- * request. We then swap the realloc_list and priv->clients list. The
- * realloc_list then contains all of the clients that were previously
- * connected, before we started to send out REALLOC requests. This makes it easy
- * for us to ensure, that we don't 'forget' any client during timeout check.
+ * start_realloc sends the REALLOC request to every connected client and keeps
+ * the IDs of the clients that got it in realloc_pending. Every ACK moves the
+ * client from realloc_pending to realloc_acked. Clients that could not be
+ * asked, or disconnect before they ACK, end up in realloc_failed. Once
+ * realloc_pending is empty, or the timeout fires, realloc_done disconnects all
+ * clients that are still pending and reports the outcome to the callback.
  *
- * This is a trick to circumvent problems with clients that, for whatever
- * reason, could not be copied to the 'new' list. If that happens, we would not
- * even recognize that a client was not informed, because it never appears in
- * the new list to begin with, and the client would therefore survive the
- * timeout for reallocation. That clients peer_mri would then never be unpinned
- * (unless the server stops or the client disconnects), causing MASSIVE memory
- * leakage. Also, the client would continue to read stale data in the best case,
- * or newly allocated garbage in the worst case.
+ * Clients that connect after start_realloc are given the new memory right
+ * away and are not part of the handshake. Clients that never ACK are
+ * forcefully disconnected. Otherwise their old memory region would never be
+ * unpinned and they would continue to read stale data in the best case, or
+ * newly allocated garbage in the worst case.
  **/
 
-void
-kiro_server_realloc (KiroServer *self, void *mem, size_t size) {
+static void
+start_realloc (uv_async_t *handle)
+{
+    KiroServerPrivate *priv = (KiroServerPrivate *)handle->data;
 
-    if (!self)
-        return;
+    G_LOCK (connection_handling);
+    G_LOCK (rdma_handling);
+    G_LOCK (realloc_handling);
+
+    if (priv->realloc_state != REALLOC_REQUESTED)
+        goto done;
 
     g_debug ("Starting realloc");
+    priv->realloc_state = REALLOC_RUNNING;
+    priv->mem = priv->realloc_mem;
+    priv->mem_size = priv->realloc_size;
 
     struct kiro_rdma_mem rdma_mem;
-    rdma_mem.mem = mem;
-    rdma_mem.size = size;
+    rdma_mem.mem = priv->realloc_mem;
+    rdma_mem.size = priv->realloc_size;
+
+    GList *rails = NULL;
+    for (GList *current = priv->clients; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
+
+        // Rails don't take part in the handshake. The client dials them
+        // again once its main connection has switched to the new memory.
+        if (cc->rail) {
+            rails = g_list_prepend (rails, cc);
+            continue;
+        }
+
+        if (request_client_realloc (cc, &rdma_mem))
+            priv->realloc_pending = g_list_append (priv->realloc_pending, GUINT_TO_POINTER (cc->id));
+        else
+            priv->realloc_failed = g_list_append (priv->realloc_failed, GUINT_TO_POINTER (cc->id));
+    }
+
+    for (GList *current = rails; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
+        g_debug ("Dropping rail %u of client group %016lx", cc->rail, cc->group);
+        priv->clients = g_list_remove (priv->clients, cc);
+        disconnect_client (cc, NULL);
+    }
+    g_list_free (rails);
+
+    // With no client left to wait for, the realloc is done right away
+    uv_timer_start (priv->uv_realloc_timer, realloc_done,
+                    priv->realloc_pending ? priv->realloc_timeout : 0, 0);
+
+done:
+    G_UNLOCK (realloc_handling);
+    G_UNLOCK (rdma_handling);
+    G_UNLOCK (connection_handling);
+}
+
+
+// Must be called with realloc_handling held. Resets the realloc state and
+// hands the result over to the caller.
+static void
+take_realloc_result (KiroServerPrivate *priv, KiroServerReallocCallback *callback, void **user_data, GList **acked, GList **failed)
+{
+    *callback = priv->realloc_callback;
+    *user_data = priv->realloc_user_data;
+    *acked = priv->realloc_acked;
+    *failed = g_list_concat (priv->realloc_failed, priv->realloc_pending);
+
+    priv->realloc_callback = NULL;
+    priv->realloc_user_data = NULL;
+    priv->realloc_acked = NULL;
+    priv->realloc_failed = NULL;
+    priv->realloc_pending = NULL;
+    priv->realloc_state = REALLOC_IDLE;
+}
 
-    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+static void
+finish_realloc (KiroServerPrivate *priv, KiroServerReallocCallback callback, void *user_data, GList *acked, GList *failed)
+{
+    if (callback)
+        callback (priv->realloc_server, acked, failed, user_data);
+
+    g_list_free (acked);
+    g_list_free (failed);
+}
 
 
+static void
+realloc_done (uv_timer_t *timer)
+{
+    KiroServerPrivate *priv = (KiroServerPrivate *)timer->data;
+
+    KiroServerReallocCallback callback;
+    void *user_data;
+    GList *acked, *failed;
+
     G_LOCK (connection_handling);
     G_LOCK (rdma_handling);
 
-    priv->mem = mem;
-    priv->mem_size = size;
-    if (!priv->clients) {
-        g_debug ("No clients to reconnect. Done.");
+    G_LOCK (realloc_handling);
+    if (priv->realloc_state != REALLOC_RUNNING) {
+        G_UNLOCK (realloc_handling);
         G_UNLOCK (rdma_handling);
         G_UNLOCK (connection_handling);
         return;
     }
-    g_list_foreach (priv->clients, request_client_realloc, &rdma_mem);
+    take_realloc_result (priv, &callback, &user_data, &acked, &failed);
+    G_UNLOCK (realloc_handling);
+
+    for (GList *current = failed; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = find_client (priv, GPOINTER_TO_UINT (current->data));
+        if (!cc)
+            continue;
+
+        g_debug ("Client %u did not ACK the REALLOC request in time.", cc->id);
+        priv->clients = g_list_remove (priv->clients, cc);
+        disconnect_client (cc, NULL);
+    }
 
-    // Swap the two lists. See Note above.
-    GList *tmp = priv->clients;
-    priv->clients = realloc_list;
-    realloc_list = tmp;
     G_UNLOCK (rdma_handling);
+    G_UNLOCK (connection_handling);
 
-    guint timeout = g_timeout_add_seconds (2, client_realloc_timeout, NULL);
+    g_debug ("Realloc procedure done! %u clients ACKed, %u failed",
+             g_list_length (acked), g_list_length (failed));
+    finish_realloc (priv, callback, user_data, acked, failed);
+}
 
-    timeout_done = FALSE;
-    while (!timeout_done) {
-        if (!realloc_list) {
-            g_debug ("All clients have ACKed");
-            break; // all clients ACKed
-        }
+
+int
+kiro_server_realloc_async (KiroServer *self, void *mem, size_t size, guint timeout_ms,
+                           KiroServerReallocCallback callback, void *user_data)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (mem != NULL && size > 0, -1);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    G_LOCK (realloc_handling);
+    if (priv->realloc_state != REALLOC_IDLE) {
+        G_UNLOCK (realloc_handling);
+        g_warning ("A reallocation is already in progress.");
+        return -1;
+    }
+
+    priv->realloc_server = self;
+    if (!priv->base) {
+        // Not serving yet. There is nobody to tell.
+        priv->mem = mem;
+        priv->mem_size = size;
+        G_UNLOCK (realloc_handling);
+        if (callback)
+            callback (self, NULL, NULL, user_data);
+        return 0;
     }
 
-    GSource *timeout_source = g_main_context_find_source_by_id (NULL, timeout);
-    if (timeout_source) {
-        g_source_destroy (timeout_source);
+    priv->realloc_state = REALLOC_REQUESTED;
+    priv->realloc_mem = mem;
+    priv->realloc_size = size;
+    priv->realloc_timeout = timeout_ms;
+    priv->realloc_callback = callback;
+    priv->realloc_user_data = user_data;
+    G_UNLOCK (realloc_handling);
+
+    uv_async_send (priv->uv_realloc_async);
+    return 0;
+}
+
+
+struct realloc_wait {
+    GMutex      lock;
+    GCond       cond;
+    gboolean    done;
+};
+
+
+static void
+realloc_wait_callback (KiroServer *server, GList *acked, GList *failed, struct realloc_wait *wait)
+{
+    (void)server;
+    (void)acked;
+    (void)failed;
+
+    g_mutex_lock (&wait->lock);
+    wait->done = TRUE;
+    g_cond_signal (&wait->cond);
+    g_mutex_unlock (&wait->lock);
+}
+
+
+int
+kiro_server_realloc (KiroServer *self, void *mem, size_t size)
+{
+    g_return_val_if_fail (self != NULL, -1);
+
+    struct realloc_wait wait;
+    g_mutex_init (&wait.lock);
+    g_cond_init (&wait.cond);
+    wait.done = FALSE;
+
+    int rv = kiro_server_realloc_async (self, mem, size, KIRO_SERVER_REALLOC_TIMEOUT,
+                                        (KiroServerReallocCallback)realloc_wait_callback, &wait);
+    if (0 == rv) {
+        g_mutex_lock (&wait.lock);
+        while (!wait.done)
+            g_cond_wait (&wait.cond, &wait.lock);
+        g_mutex_unlock (&wait.lock);
     }
 
-    G_LOCK (realloc_timeout);
-    GList *current = g_list_first (realloc_list);
+    g_cond_clear (&wait.cond);
+    g_mutex_clear (&wait.lock);
+    return rv;
+}
+
+
+void
+kiro_server_notify_update (KiroServer *self, uint64_t sequence)
+{
+    g_return_if_fail (self != NULL);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+    kiro_server_notify_update_range (self, sequence, 0, priv->mem_size);
+}
+
+
+void
+kiro_server_notify_update_range (KiroServer *self, uint64_t sequence, gulong offset, gulong size)
+{
+    g_return_if_fail (self != NULL);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    G_LOCK (update_handling);
+    if (offset > priv->mem_size)
+        offset = priv->mem_size;
+    if (size > priv->mem_size - offset)
+        size = priv->mem_size - offset;
+
+    priv->update_previous = priv->update_sequence;
+    priv->update_sequence = sequence;
+    priv->update_offset = offset;
+    priv->update_size = size;
+
+    GList *current = priv->update_requests;
     while (current) {
+        GList *next = g_list_next (current);
         struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
-        g_debug ("Client %i did not ACK the REALLOC request in time.", cc->id);
-        GList *client = g_list_find (priv->clients, current->data);
-        if (client) {
-            priv->clients = g_list_delete_link (priv->clients, client);
+
+        if (sequence > cc->update_known) {
+            send_update (cc, cc->update_known);
+            priv->update_requests = g_list_delete_link (priv->update_requests, current);
         }
-        disconnect_client (current->data, NULL);
-        current = g_list_next (current);
+        current = next;
     }
+    G_UNLOCK (update_handling);
+}
 
-    if (realloc_list) {
-        g_list_free (realloc_list);
-        realloc_list = NULL;
-    }
-    G_UNLOCK (realloc_timeout);
 
+static void
+notify_regions (KiroServerPrivate *priv)
+{
+    G_LOCK (connection_handling);
+    for (GList *current = priv->clients; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
+        // Rails only carry RDMA_READs. The main connection of their client is
+        // notified instead.
+        if (cc->conn->pd != priv->pd || cc->rail)
+            continue;
+
+        struct kiro_ctrl_msg msg;
+        memset (&msg, 0, sizeof (msg));
+        msg.msg_type = KIRO_REGIONS;
 
-    g_debug ("Realloc procedure done!");
+        if (!send_msg (cc->conn, &msg))
+            g_warning ("Failure while trying to post REGIONS send to client %u: %s", cc->id, strerror (errno));
+    }
     G_UNLOCK (connection_handling);
 }
 
 
+static struct kiro_server_region *
+find_region (KiroServerPrivate *priv, guint id, const gchar *name)
+{
+    for (GList *current = priv->regions; current; current = g_list_next (current)) {
+        struct kiro_server_region *region = (struct kiro_server_region *)current->data;
+        if (region->id == id || (name && !g_strcmp0 (region->name, name)))
+            return region;
+    }
+    return NULL;
+}
+
+
+gint
+kiro_server_add_region (KiroServer *self, const gchar *name, void *mem, size_t size)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (name != NULL, -1);
+    g_return_val_if_fail (mem != NULL && size > 0, -1);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    if (strlen (name) >= KIRO_REGION_NAME_LENGTH) {
+        g_warning ("Region name '%s' is too long.", name);
+        return -1;
+    }
+
+    G_LOCK (region_handling);
+    if (g_list_length (priv->regions) >= KIRO_MAX_REGIONS) {
+        G_UNLOCK (region_handling);
+        g_warning ("The server can not provide more than %i regions.", KIRO_MAX_REGIONS);
+        return -1;
+    }
+
+    if (find_region (priv, 0, name)) {
+        G_UNLOCK (region_handling);
+        g_warning ("There already is a region called '%s'.", name);
+        return -1;
+    }
+
+    struct kiro_server_region *region = g_new0 (struct kiro_server_region, 1);
+    region->id = ++priv->next_region_id;
+    region->name = g_strdup (name);
+    region->mem = mem;
+    region->size = size;
+
+    // Without a shared pd, the region is registered once the first client
+    // connects
+    if (priv->pd) {
+        region->mr = register_region (priv, mem, size);
+        if (!region->mr) {
+            G_UNLOCK (region_handling);
+            g_free (region->name);
+            g_free (region);
+            return -1;
+        }
+    }
+
+    priv->regions = g_list_append (priv->regions, region);
+    publish_regions (priv);
+    G_UNLOCK (region_handling);
+
+    notify_regions (priv);
+    g_debug ("Added region '%s' with ID %u", name, region->id);
+    return region->id;
+}
+
+
+gboolean
+kiro_server_remove_region (KiroServer *self, guint id)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    G_LOCK (region_handling);
+    struct kiro_server_region *region = id ? find_region (priv, id, NULL) : NULL;
+    if (!region) {
+        G_UNLOCK (region_handling);
+        return FALSE;
+    }
+
+    priv->regions = g_list_remove (priv->regions, region);
+    publish_regions (priv);
+    G_UNLOCK (region_handling);
+
+    // Tell the clients before the region becomes inaccessible, so they stop
+    // reading from it
+    notify_regions (priv);
+
+    if (region->mr)
+        ibv_dereg_mr (region->mr);
+    g_debug ("Removed region '%s' with ID %u", region->name, region->id);
+    g_free (region->name);
+    g_free (region);
+    return TRUE;
+}
+
+
+/*
+ * (Re-)creates the version table if there is none yet or if the memory was
+ * reallocated. Must be called with dirty_handling held.
+ */
+static gboolean
+prepare_versions (KiroServer *self, KiroServerPrivate *priv)
+{
+    if (priv->versions && priv->versions_mem == priv->mem && priv->versions->mem_size == priv->mem_size)
+        return TRUE;
+
+    if (priv->versions_region) {
+        // Clients that see the table vanish fall back to a full sync
+        kiro_server_remove_region (self, priv->versions_region);
+        priv->versions_region = 0;
+    }
+    g_free (priv->versions);
+
+    uint64_t num_blocks = (priv->mem_size + KIRO_DIRTY_BLOCK_SIZE - 1) / KIRO_DIRTY_BLOCK_SIZE;
+    priv->versions_size = sizeof (struct kiro_version_table) + num_blocks * sizeof (uint64_t);
+    priv->versions = g_malloc0 (priv->versions_size);
+    priv->versions->mem_size = priv->mem_size;
+    priv->versions->block_size = KIRO_DIRTY_BLOCK_SIZE;
+    priv->versions->num_blocks = num_blocks;
+
+    gint id = kiro_server_add_region (self, KIRO_VERSION_REGION, priv->versions, priv->versions_size);
+    if (id < 0) {
+        g_free (priv->versions);
+        priv->versions = NULL;
+        return FALSE;
+    }
+
+    priv->versions_region = id;
+    priv->versions_mem = priv->mem;
+    return TRUE;
+}
+
+
+int
+kiro_server_mark_dirty (KiroServer *self, gulong offset, gulong size)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    if (!priv->mem) {
+        g_warning ("Server does not provide any memory");
+        return -1;
+    }
+
+    if (offset > priv->mem_size || size > priv->mem_size - offset) {
+        g_warning ("kiro_server_mark_dirty: Range exceeds the provided memory");
+        return -1;
+    }
+
+    if (size == 0)
+        return 0;
+
+    G_LOCK (dirty_handling);
+    if (!prepare_versions (self, priv)) {
+        G_UNLOCK (dirty_handling);
+        g_warning ("Failed to provide the version table");
+        return -1;
+    }
+
+    // The data is written before it is marked dirty. A client that reads the
+    // new version is therefore guaranteed to read the new data, too.
+    uint64_t version = ++priv->dirty_version;
+    guint64 last = (offset + size - 1) / KIRO_DIRTY_BLOCK_SIZE;
+    for (guint64 block = offset / KIRO_DIRTY_BLOCK_SIZE; block <= last; block++)
+        __atomic_store_n (&priv->versions->versions[block], version, __ATOMIC_RELEASE);
+    G_UNLOCK (dirty_handling);
+
+    return 0;
+}
+
+
+int
+kiro_server_write_begin (KiroServer *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    // Writers are serialized. Readers never take this lock.
+    G_LOCK (seqlock_handling);
+
+    if (!priv->seqlock) {
+        priv->seqlock = g_malloc0 (sizeof (uint64_t));
+        gint id = kiro_server_add_region (self, KIRO_SEQLOCK_REGION, priv->seqlock, sizeof (uint64_t));
+        if (id < 0) {
+            g_warning ("Failed to provide the sequence counter");
+            g_free (priv->seqlock);
+            priv->seqlock = NULL;
+            return -1;
+        }
+        priv->seqlock_region = id;
+    }
+
+    // The odd counter must be visible before any of the data changes
+    __atomic_store_n (priv->seqlock, *priv->seqlock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    return 0;
+}
+
+
+void
+kiro_server_write_end (KiroServer *self)
+{
+    g_return_if_fail (self != NULL);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    if (priv->seqlock)
+        __atomic_store_n (priv->seqlock, *priv->seqlock + 1, __ATOMIC_RELEASE);
+    G_UNLOCK (seqlock_handling);
+}
+
+
+int
+kiro_server_publish (KiroServer *self, gulong offset, gulong size)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroServerPrivate *priv = KIRO_SERVER_GET_PRIVATE (self);
+
+    if (!priv->base) {
+        g_warning ("Server not started");
+        return -1;
+    }
+
+    if (offset > priv->mem_size || size > priv->mem_size - offset) {
+        g_warning ("kiro_server_publish: range exceeds the memory boundary! Won't publish.");
+        return -1;
+    }
+
+    // Every subscriber gets exactly one signaled WRITE, which can't carry more
+    if (size > KIRO_RDMA_MAX_TRANSFER) {
+        g_warning ("kiro_server_publish: range is larger than %lu bytes! Won't publish.", KIRO_RDMA_MAX_TRANSFER);
+        return -1;
+    }
+
+    G_LOCK (push_handling);
+    uint32_t imm = htonl ((uint32_t) ++priv->push_sequence);
+    GList *posted = NULL;
+
+    // Post the WRITEs to all subscribers first, so they are all in flight at
+    // the same time. The immediate data makes the WRITE complete a receive at
+    // the client, which wakes it up once the data has arrived.
+    G_LOCK (send_lock);
+    for (GList *current = priv->subscribers; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
+        struct kiro_connection_context *ctx = (struct kiro_connection_context *)cc->conn->context;
+        if (!cc->push_ready || !ctx->rdma_mr || offset + size > cc->push_mri.length)
+            continue;
+
+        struct ibv_sge sge;
+        sge.addr = (uint64_t) (uintptr_t) (ctx->rdma_mr->mem + offset);
+        sge.length = (uint32_t) size;
+        sge.lkey = ctx->rdma_mr->mr->lkey;
+
+        struct ibv_send_wr wr, *bad;
+        memset (&wr, 0, sizeof (struct ibv_send_wr));
+        wr.wr_id = (uintptr_t) cc->conn;
+        wr.sg_list = size ? &sge : NULL;
+        wr.num_sge = size ? 1 : 0;
+        wr.opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+        wr.send_flags = IBV_SEND_SIGNALED;
+        wr.imm_data = imm;
+        wr.wr.rdma.remote_addr = (uint64_t)cc->push_mri.addr + offset;
+        wr.wr.rdma.rkey = cc->push_mri.rkey;
+
+        if (ibv_post_send (cc->conn->qp, &wr, &bad))
+            g_warning ("Failed to post push to client %u: %s", cc->id, strerror (errno));
+        else
+            posted = g_list_prepend (posted, cc);
+    }
+
+    gint reached = 0;
+    for (GList *current = posted; current; current = g_list_next (current)) {
+        struct kiro_client_connection *cc = (struct kiro_client_connection *)current->data;
+        struct ibv_wc wc;
+        if (rdma_get_send_comp (cc->conn, &wc) < 0 || wc.status != IBV_WC_SUCCESS)
+            g_warning ("Push to client %u failed", cc->id);
+        else
+            reached++;
+    }
+    G_UNLOCK (send_lock);
+    G_UNLOCK (push_handling);
+
+    g_list_free (posted);
+    return reached;
+}
+
+
 void
 kiro_server_stop (KiroServer *self)
 {
@@ -765,6 +1582,7 @@ kiro_server_stop (KiroServer *self)
 
     g_list_foreach (priv->clients, disconnect_client, NULL);
     g_list_free (priv->clients);
+    priv->clients = NULL;
 
     // Stop event loop
     uv_stop(priv->uv_event_loop);
@@ -776,6 +1594,26 @@ kiro_server_stop (KiroServer *self)
 
     // Unref all libuv handles
     uv_unref((uv_handle_t *)priv->uv_ec_fd_poll);
+    uv_unref((uv_handle_t *)priv->uv_realloc_async);
+    uv_unref((uv_handle_t *)priv->uv_realloc_timer);
+
+    // A realloc that was still running will never finish now. All of its
+    // clients are gone.
+    G_LOCK (realloc_handling);
+    if (priv->realloc_state != REALLOC_IDLE) {
+        KiroServerReallocCallback callback;
+        void *user_data;
+        GList *acked, *failed;
+        take_realloc_result (priv, &callback, &user_data, &acked, &failed);
+        G_UNLOCK (realloc_handling);
+        finish_realloc (priv, callback, user_data, acked, failed);
+    }
+    else
+        G_UNLOCK (realloc_handling);
+
+    // All clients are gone, so the shared pd is no longer in use
+    teardown_shared_pd (priv);
+
     priv->close_signal = FALSE;
 
     // kiro_destroy_connection would try to call rdma_disconnect on the given
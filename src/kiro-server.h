@@ -121,6 +121,9 @@ void         kiro_server_free                (KiroServer *server);
 int kiro_server_start (KiroServer *server, const char *bind_addr, const char *bind_port, void *mem, size_t mem_size);
 
 
+// Time in milliseconds the clients have to ACK a kiro_server_realloc
+#define KIRO_SERVER_REALLOC_TIMEOUT 2000
+
 /**
  * kiro_server_realloc:
  * @server: #KiroServer to perform the operation on
@@ -128,9 +131,231 @@ int kiro_server_start (KiroServer *server, const char *bind_addr, const char *bi
  * @mem_size: Size in bytes of the given memory
  *
  *   Changes the memory that is provided by the server. All connected clients
- *   will automatically be informed about this change.
+ *   will automatically be informed about this change. The call blocks until
+ *   all clients have ACKed the change, or %KIRO_SERVER_REALLOC_TIMEOUT has
+ *   passed. Clients that did not ACK in time are disconnected.
+ *
+ * Returns:
+ *   0 once the server provides @mem, -1 if the change could not be started
+ *   (e.g. because another reallocation is in progress). In that case the
+ *   server keeps providing its previous memory.
+ * Note:
+ *   This must not be called from within a #KiroServerReallocCallback.
+ * See also:
+ *   kiro_server_realloc_async
+ */
+int kiro_server_realloc (KiroServer *server, void* mem, size_t mem_size);
+
+
+/**
+ * KiroServerReallocCallback:
+ * @server: The #KiroServer that did the reallocation
+ * @acked: (transfer none) (element-type guint): IDs of the clients that have
+ *   switched to the new memory
+ * @failed: (transfer none) (element-type guint): IDs of the clients that did
+ *   not ACK in time, or disconnected during the reallocation
+ * @user_data: (transfer none): The @user_data given to
+ *   kiro_server_realloc_async
+ *
+ *   Defines the type of the function that is invoked once a reallocation is
+ *   done. The client IDs are stored with GUINT_TO_POINTER.
+ *
+ * Note:
+ *   The callback runs on the event loop of the server. The old memory is no
+ *   longer used by any client once it is invoked.
+ * See also:
+ *   kiro_server_realloc_async
+ */
+typedef void (*KiroServerReallocCallback) (KiroServer *server, GList *acked, GList *failed, void *user_data);
+
+
+/**
+ * kiro_server_realloc_async:
+ * @server: #KiroServer to perform the operation on
+ * @mem: (transfer none) (type gulong): Pointer to the memory that is to be provided
+ * @mem_size: Size in bytes of the given memory
+ * @timeout_ms: Time in milliseconds the clients have to ACK the change
+ * @callback: (scope async) (allow-none): Function to invoke once the
+ *   reallocation is done
+ * @user_data: (transfer none): Data to pass to @callback
+ *
+ *   Changes the memory that is provided by the server without blocking. The
+ *   REALLOC requests are sent and the ACKs collected on the event loop of the
+ *   server, which keeps serving new connections and PINGs in the meantime.
+ *   Clients that did not ACK within @timeout_ms are disconnected.
+ *
+ * Returns: 0 if the reallocation was started, -1 in case of error
+ * Note:
+ *   Only one reallocation can be in progress at a time. The old memory must
+ *   stay valid until @callback was invoked. If the server is not started, the
+ *   memory is exchanged and @callback is invoked right away.
+ * See also:
+ *   kiro_server_realloc
+ */
+int kiro_server_realloc_async (KiroServer *server, void* mem, size_t mem_size, guint timeout_ms,
+                               KiroServerReallocCallback callback, void *user_data);
+
+
+/**
+ * kiro_server_add_region:
+ * @server: #KiroServer to perform the operation on
+ * @name: (transfer none): Unique name of the region
+ * @mem: (transfer none) (type gulong): Pointer to the memory of the region
+ * @mem_size: Size in bytes of the given memory
+ *
+ *   Provides an additional, named memory region over the same connections as
+ *   the main memory. The server keeps a directory of all regions, which the
+ *   clients read to look up a region by its name. Regions can be added at any
+ *   time, also while the server is running.
+ *
+ * Returns: The ID of the region (> 0), or -1 in case of error
+ * Note:
+ *   The memory given to kiro_server_start is region 0. A server provides at
+ *   most 32 additional regions. Each region is registered only once, and
+ *   that registration is shared by all clients. The memory must
+ *   stay valid until the region is removed or the server is freed.
+ * See also:
+ *   kiro_server_remove_region, kiro_client_lookup_region
+ */
+gint kiro_server_add_region (KiroServer *server, const gchar *name, void *mem, size_t mem_size);
+
+
+/**
+ * kiro_server_remove_region:
+ * @server: #KiroServer to perform the operation on
+ * @id: ID of the region, as returned by kiro_server_add_region
+ *
+ *   Removes the region from the directory and revokes the access of all
+ *   clients to it.
+ *
+ * Returns: %TRUE if the region was found and removed, %FALSE otherwise
+ * Note:
+ *   The clients are told about the removal, but a client that is reading
+ *   from the region at that very moment will lose its connection.
+ * See also:
+ *   kiro_server_add_region
+ */
+gboolean kiro_server_remove_region (KiroServer *server, guint id);
+
+
+/**
+ * kiro_server_notify_update:
+ * @server: #KiroServer to perform the operation on
+ * @sequence: New sequence number of the provided memory
+ *
+ *   Tells the server that the provided memory has changed. Every client that
+ *   is waiting in kiro_client_wait_update for a sequence number smaller than
+ *   @sequence is notified.
+ *
+ * Note:
+ *   The meaning of @sequence is up to the user, but it must increase with
+ *   every update. Clients only receive a notification if they asked for one,
+ *   so calling this function is cheap while nobody is waiting.
+ * See also:
+ *   kiro_server_notify_update_range, kiro_client_wait_update
+ */
+void kiro_server_notify_update (KiroServer *server, uint64_t sequence);
+
+
+/**
+ * kiro_server_notify_update_range:
+ * @server: #KiroServer to perform the operation on
+ * @sequence: New sequence number of the provided memory
+ * @offset: Offset in bytes of the changed range within the provided memory
+ * @size: Size in bytes of the changed range
+ *
+ *   Works like kiro_server_notify_update, but also tells the clients which
+ *   range of the memory has changed. The range is handed to the callbacks
+ *   that were added with kiro_client_add_update_callback.
+ *
+ * Note:
+ *   Only the range of the last update is kept. A client that has missed
+ *   more than one update is told that the whole memory has changed.
+ * See also:
+ *   kiro_server_notify_update, kiro_client_add_update_callback
+ */
+void kiro_server_notify_update_range (KiroServer *server, uint64_t sequence, gulong offset, gulong size);
+
+
+/**
+ * kiro_server_publish:
+ * @server: #KiroServer to perform the operation on
+ * @offset: Offset in bytes of the published range within the provided memory
+ * @size: Size in bytes of the published range. May be 0 for a notification only
+ *
+ *   Pushes the given range of the provided memory to all clients that have
+ *   called kiro_client_subscribe. The range is written into the memory of the
+ *   clients at the same offset, and wakes up any kiro_client_wait_push on
+ *   them. Each call increments the push sequence number by one.
+ *
+ * Returns: The number of clients the range was pushed to, or -1 in case of
+ *   error
+ * Note:
+ *   All pushes are in flight at the same time, and the call returns once
+ *   they have all completed. Clients that are in the middle of a
+ *   kiro_server_realloc are skipped until they have switched over.
+ *   A single push carries at most 1 GiB. Larger ranges are rejected and have
+ *   to be published in several calls.
+ * See also:
+ *   kiro_client_subscribe, kiro_client_wait_push
+ */
+int kiro_server_publish (KiroServer *server, gulong offset, gulong size);
+
+
+/**
+ * kiro_server_mark_dirty:
+ * @server: #KiroServer to perform the operation on
+ * @offset: Offset in bytes of the changed range within the provided memory
+ * @size: Size in bytes of the changed range
+ *
+ *   Records that the given range of the provided memory has changed. The
+ *   server keeps a version for every 64 KiB block of the memory and
+ *   gives all blocks of the range a new version. Clients read the
+ *   versions with kiro_client_sync_delta and fetch only the changed blocks.
+ *
+ * Returns: 0 on success, -1 in case of error
+ * Note:
+ *   Call this after the data has been written. The version table is provided
+ *   as an additional region called 'kiro-versions', which is created
+ *   on the first call and counts towards the limit of regions.
+ * See also:
+ *   kiro_client_sync_delta, kiro_server_add_region
+ */
+int kiro_server_mark_dirty (KiroServer *server, gulong offset, gulong size);
+
+
+/**
+ * kiro_server_write_begin:
+ * @server: #KiroServer to perform the operation on
+ *
+ *   Starts a write to the provided memory. Together with
+ *   kiro_server_write_end, this brackets the write with a sequence counter,
+ *   so clients can use kiro_client_sync_consistent to read a snapshot of the
+ *   memory that does not contain any partial write.
+ *
+ * Returns: 0 on success, -1 if the sequence counter could not be provided
+ * Note:
+ *   Every call must be followed by a call to kiro_server_write_end from the
+ *   same thread, even if it failed. Writers are serialized, but they never
+ *   wait for any reader. The counter is provided as an additional region
+ *   called 'kiro-seqlock', which is created on the first call and counts
+ *   towards the limit of regions.
+ * See also:
+ *   kiro_server_write_end, kiro_client_sync_consistent
+ */
+int kiro_server_write_begin (KiroServer *server);
+
+
+/**
+ * kiro_server_write_end:
+ * @server: #KiroServer to perform the operation on
+ *
+ *   Ends the write that was started with kiro_server_write_begin.
+ *
+ * See also:
+ *   kiro_server_write_begin
  */
-void kiro_server_realloc (KiroServer *server, void* mem, size_t mem_size);
+void kiro_server_write_end (KiroServer *server);
 
 
 /**
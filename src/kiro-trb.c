@@ -19,6 +19,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
 #include <glib.h>
 #include "kiro-trb.h"
 
@@ -38,11 +44,21 @@ struct _KiroTrbPrivate {
     /* (Not accessible by properties) */
     int         initialized;    // 1 if Buffer is Valid, 0 otherwise
     void        *mem;            // Access to the actual buffer in Memory
+    size_t      mapped;         // Length of the file mapping backing 'mem'. 0 if 'mem' was allocated
+    void        *meta_top;       // First byte of the metadata column (if any)
     void        *frame_top;      // First byte of the buffer storage
     void        *current;        // Pointer to the current fill state
     uint64_t    element_size;
+    uint64_t    meta_size;      // Size of one metadata record. 0 if there is no metadata column
     uint64_t    max_elements;
     uint64_t    iteration;      // How many times the buffer has wraped around
+    gboolean    batching;       // Header updates are deferred until kiro_trb_end_batch
+
+    /* Multi-producer mode */
+    uint64_t    *committed;     // Per slot: sequence number + 1 of the last committed element
+    uint64_t    reserved;       // Next sequence number to be handed out by kiro_trb_reserve
+    uint64_t    published;      // All sequence numbers below this one are committed
+    GMutex      publish_lock;
 
     /* easy access */
     uint64_t    buff_size;
@@ -76,6 +92,25 @@ void kiro_trb_init (KiroTrb *self)
     g_return_if_fail (self != NULL);
     KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
     priv->initialized = 0;
+    priv->committed = NULL;
+    priv->batching = FALSE;
+    g_mutex_init (&priv->publish_lock);
+}
+
+
+static void
+release_memory (KiroTrbPrivate *priv)
+{
+    if (!priv->mem)
+        return;
+
+    if (priv->mapped)
+        munmap (priv->mem, priv->mapped);
+    else
+        g_free (priv->mem);
+
+    priv->mem = NULL;
+    priv->mapped = 0;
 }
 
 
@@ -86,8 +121,12 @@ kiro_trb_finalize (GObject *object)
     KiroTrb *self = KIRO_TRB (object);
     KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
 
-    if (priv->mem)
-        g_free (priv->mem);
+    release_memory (priv);
+
+    if (priv->committed)
+        g_free (priv->committed);
+
+    g_mutex_clear (&priv->publish_lock);
 
     G_OBJECT_CLASS (kiro_trb_parent_class)->finalize (object);
 }
@@ -114,11 +153,130 @@ write_header (KiroTrbPrivate *priv)
     struct KiroTrbInfo *tmp_info = (struct KiroTrbInfo *)priv->mem;
     tmp_info->buffer_size_bytes = priv->buff_size;
     tmp_info->element_size = priv->element_size;
+    tmp_info->meta_size = priv->meta_size;
+    tmp_info->version = KIRO_TRB_VERSION;
+    // Make sure the element data is visible before the new offset is
+    __atomic_thread_fence (__ATOMIC_RELEASE);
     tmp_info->offset = (priv->iteration * priv->max_elements) + ((priv->current - priv->frame_top) / priv->element_size);
     memcpy (priv->mem, tmp_info, sizeof (struct KiroTrbInfo));
 }
 
 
+static inline uint64_t
+read_offset (KiroTrbPrivate *priv)
+{
+    // The header might be changed concurrently by a producer or by a remote
+    // write to the memory, so always fetch it from memory
+    uint64_t offset = ((volatile struct KiroTrbInfo *)priv->mem)->offset;
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    return offset;
+}
+
+
+
+static inline struct KiroTrbMeta *
+meta_for_slot (KiroTrbPrivate *priv, void *element)
+{
+    if (!priv->meta_size)
+        return NULL;
+
+    uint64_t slot = (element - priv->frame_top) / priv->element_size;
+    return (struct KiroTrbMeta *)(priv->meta_top + (slot * priv->meta_size));
+}
+
+
+static inline void
+begin_meta (KiroTrbPrivate *priv, void *element, uint64_t size, uint64_t tag)
+{
+    struct KiroTrbMeta *meta = meta_for_slot (priv, element);
+    if (!meta)
+        return;
+
+    // Invalidate the sequence number before the element is overwritten, so a
+    // reader of the previous element in this slot can't take the new data
+    // for the old one
+    meta->sequence = G_MAXUINT64;
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    meta->timestamp = g_get_real_time ();
+    meta->size = size;
+    meta->tag = tag;
+}
+
+
+static inline void
+end_meta (KiroTrbPrivate *priv, void *element, uint64_t sequence)
+{
+    struct KiroTrbMeta *meta = meta_for_slot (priv, element);
+    if (!meta)
+        return;
+
+    // The sequence number is written last, so it can be used to tell if the
+    // record (and the element) is complete
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    meta->sequence = sequence;
+}
+
+
+static inline uint64_t
+sequence_for_slot (KiroTrbPrivate *priv, void *element)
+{
+    return (priv->iteration * priv->max_elements) + ((element - priv->frame_top) / priv->element_size);
+}
+
+
+static void
+reset_multi_producer (KiroTrbPrivate *priv)
+{
+    if (!priv->committed)
+        return;
+
+    g_free (priv->committed);
+    priv->committed = g_try_malloc0 (priv->max_elements * sizeof (uint64_t));
+    if (!priv->committed) {
+        g_critical ("Failed to allocate the commit table. Leaving multi-producer mode.");
+        return;
+    }
+
+    priv->published = (priv->iteration * priv->max_elements) + ((priv->current - priv->frame_top) / priv->element_size);
+    priv->reserved = priv->published;
+}
+
+
+static void
+publish_committed (KiroTrbPrivate *priv)
+{
+    // Only one thread needs to move the header forward. Whoever fails to get
+    // the lock can rely on the current holder to pick up its commit, because
+    // the holder checks again after releasing the lock.
+    // The mutex is no full barrier, so a committer that stores its commit and
+    // then fails the trylock, and a holder that unlocks and then loads the
+    // commit, could otherwise both miss each other. With a sequentially
+    // consistent fence on both sides, at least one of them sees the other.
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    while (g_mutex_trylock (&priv->publish_lock)) {
+        uint64_t published = __atomic_load_n (&priv->published, __ATOMIC_ACQUIRE);
+
+        while (__atomic_load_n (&priv->committed[published % priv->max_elements], __ATOMIC_ACQUIRE) == published + 1)
+            published++;
+
+        uint64_t old = (priv->iteration * priv->max_elements) + ((priv->current - priv->frame_top) / priv->element_size);
+        if (published != old) {
+            priv->iteration = published / priv->max_elements;
+            priv->current = priv->frame_top + ((published % priv->max_elements) * priv->element_size);
+            write_header (priv);
+            __atomic_store_n (&priv->published, published, __ATOMIC_RELEASE);
+        }
+
+        g_mutex_unlock (&priv->publish_lock);
+        __atomic_thread_fence (__ATOMIC_SEQ_CST);
+
+        // Stop if nobody committed the next element while we were holding
+        // the lock
+        if (__atomic_load_n (&priv->committed[published % priv->max_elements], __ATOMIC_ACQUIRE) != published + 1)
+            break;
+    }
+}
+
 
 /* TRB functions */
 
@@ -184,23 +342,57 @@ kiro_trb_get_element (KiroTrb *self, glong element_in)
     if (priv->initialized != 1)
         return NULL;
 
-    gulong offset = element_in;
+    // Positive indices count forward from the current position (which holds
+    // the oldest element once the buffer has wrapped), negative indices count
+    // backwards from it, so -1 is the most recently pushed element.
+    gulong offset;
     if (0 <= element_in) {
-        offset %= priv->max_elements;
-        offset = priv->max_elements - offset;
+        offset = element_in % priv->max_elements;
     }
     else {
-        offset *= -1;
-        offset %= priv->max_elements;
+        offset = (gulong)(-element_in) % priv->max_elements;
+        offset = (priv->max_elements - offset) % priv->max_elements;
     }
 
     gulong relative = (priv->current - priv->frame_top) + (offset * priv->element_size);
-    relative %= (priv->buff_size - sizeof(struct KiroTrbInfo));
+    relative %= (priv->max_elements * priv->element_size);
 
     return priv->frame_top + relative;
 }
 
 
+struct KiroTrbMeta *
+kiro_trb_get_meta (KiroTrb *self, glong element_in)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || !priv->meta_size)
+        return NULL;
+
+    return meta_for_slot (priv, kiro_trb_get_element (self, element_in));
+}
+
+
+gboolean
+kiro_trb_get_meta_column (KiroTrb *self, uint64_t *offset, uint64_t *size)
+{
+    g_return_val_if_fail (self != NULL, FALSE);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || !priv->meta_size)
+        return FALSE;
+
+    if (offset)
+        *offset = priv->meta_top - priv->mem;
+
+    if (size)
+        *size = priv->max_elements * priv->meta_size;
+
+    return TRUE;
+}
+
+
 void
 kiro_trb_flush (KiroTrb *self)
 {
@@ -209,6 +401,7 @@ kiro_trb_flush (KiroTrb *self)
     priv->iteration = 0;
     priv->current = priv->frame_top;
     write_header (priv);
+    reset_multi_producer (priv);
 }
 
 
@@ -223,12 +416,16 @@ kiro_trb_purge (KiroTrb *self, gboolean free_memory)
     priv->max_elements = 0;
     priv->buff_size = 0;
     priv->frame_top = NULL;
+    priv->meta_top = NULL;
     priv->element_size = 0;
+    priv->meta_size = 0;
+    priv->batching = FALSE;
 
     if (free_memory)
-        g_free (priv->mem);
+        release_memory (priv);
 
     priv->mem = NULL;
+    priv->mapped = 0;
 }
 
 
@@ -241,14 +438,14 @@ kiro_trb_is_setup (KiroTrb *self)
 }
 
 
-int
-kiro_trb_reshape (KiroTrb *self, uint64_t element_size, uint64_t element_count)
+static int
+reshape_internal (KiroTrb *self, uint64_t element_size, uint64_t element_count, uint64_t meta_size)
 {
     g_return_val_if_fail (self != NULL, -1);
     if (element_size < 1 || element_count < 1)
         return -1;
 
-    size_t new_size = (element_size * element_count) + sizeof (struct KiroTrbInfo);
+    size_t new_size = ((element_size + meta_size) * element_count) + sizeof (struct KiroTrbInfo);
     void *newmem = g_try_malloc0 (new_size);
 
     if (!newmem)
@@ -257,24 +454,64 @@ kiro_trb_reshape (KiroTrb *self, uint64_t element_size, uint64_t element_count)
     ((struct KiroTrbInfo *)newmem)->buffer_size_bytes = new_size;
     ((struct KiroTrbInfo *)newmem)->element_size = element_size;
     ((struct KiroTrbInfo *)newmem)->offset = 0;
+    ((struct KiroTrbInfo *)newmem)->meta_size = meta_size;
+    ((struct KiroTrbInfo *)newmem)->version = KIRO_TRB_VERSION;
     kiro_trb_adopt (self, newmem);
     return 0;
 }
 
 
+int
+kiro_trb_reshape (KiroTrb *self, uint64_t element_size, uint64_t element_count)
+{
+    return reshape_internal (self, element_size, element_count, 0);
+}
+
+
+int
+kiro_trb_reshape_with_meta (KiroTrb *self, uint64_t element_size, uint64_t element_count)
+{
+    return reshape_internal (self, element_size, element_count, sizeof (struct KiroTrbMeta));
+}
+
+
 int
 kiro_trb_push (KiroTrb *self, void *element_in)
 {
     g_return_val_if_fail (self != NULL, -1);
     KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
 
+    return kiro_trb_push_with_meta (self, element_in, priv->element_size, 0);
+}
+
+
+int
+kiro_trb_push_with_meta (KiroTrb *self, void *element_in, uint64_t size, uint64_t tag)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
     if (priv->initialized != 1)
         return -1;
 
+    if (size > priv->element_size)
+        return -1;
+
     if ((priv->current + priv->element_size) > (priv->mem + priv->buff_size))
         return -1;
 
-    memcpy (priv->current, element_in, priv->element_size);
+    if (priv->committed) {
+        uint64_t seq;
+        void *slot = kiro_trb_reserve (self, &seq);
+        begin_meta (priv, slot, size, tag);
+        memcpy (slot, element_in, size);
+        end_meta (priv, slot, seq);
+        return kiro_trb_commit (self, seq);
+    }
+
+    begin_meta (priv, priv->current, size, tag);
+    memcpy (priv->current, element_in, size);
+    end_meta (priv, priv->current, sequence_for_slot (priv, priv->current));
     priv->current += priv->element_size;
 
     if (priv->current >= priv->frame_top + (priv->element_size * priv->max_elements)) {
@@ -282,7 +519,8 @@ kiro_trb_push (KiroTrb *self, void *element_in)
         priv->iteration++;
     }
 
-    write_header (priv);
+    if (!priv->batching)
+        write_header (priv);
     return 0;
 }
 
@@ -299,7 +537,15 @@ kiro_trb_dma_push (KiroTrb *self)
     if ((priv->current + priv->element_size) > (priv->mem + priv->buff_size))
         return NULL;
 
+    if (priv->committed) {
+        uint64_t seq;
+        void *slot = kiro_trb_reserve (self, &seq);
+        begin_meta (priv, slot, priv->element_size, 0);
+        return slot;
+    }
+
     void *mem_out = priv->current;
+    begin_meta (priv, mem_out, priv->element_size, 0);
     priv->current += priv->element_size;
 
     if (priv->current >= priv->frame_top + (priv->element_size * priv->max_elements)) {
@@ -307,11 +553,53 @@ kiro_trb_dma_push (KiroTrb *self)
         priv->iteration++;
     }
 
-    write_header (priv);
+    if (!priv->batching)
+        write_header (priv);
     return mem_out;
 }
 
 
+int
+kiro_trb_dma_commit (KiroTrb *self, void *element)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1)
+        return -1;
+
+    if (element < priv->frame_top || element >= priv->frame_top + (priv->max_elements * priv->element_size))
+        return -1;
+
+    uint64_t slot = (element - priv->frame_top) / priv->element_size;
+    uint64_t sequence;
+
+    if (priv->committed) {
+        // The element is not committed yet, so the published offset can't
+        // have passed it, and kiro_trb_reserve never hands out a slot more
+        // than one lap ahead of it. That leaves exactly one candidate.
+        uint64_t published = __atomic_load_n (&priv->published, __ATOMIC_ACQUIRE);
+        sequence = published + ((slot + priv->max_elements - (published % priv->max_elements)) % priv->max_elements);
+        if (sequence >= __atomic_load_n (&priv->reserved, __ATOMIC_RELAXED))
+            return -1;
+
+        end_meta (priv, element, sequence);
+        return kiro_trb_commit (self, sequence);
+    }
+    else {
+        // Find the most recent element that was pushed into this slot
+        uint64_t pushed = sequence_for_slot (priv, priv->current);
+        uint64_t back = (((pushed + priv->max_elements - 1) % priv->max_elements) + priv->max_elements - slot) % priv->max_elements;
+        if (pushed <= back)
+            return -1;
+        sequence = pushed - 1 - back;
+    }
+
+    end_meta (priv, element, sequence);
+    return 0;
+}
+
+
 void
 kiro_trb_refresh (KiroTrb *self)
 {
@@ -322,13 +610,22 @@ kiro_trb_refresh (KiroTrb *self)
         return;
 
     struct KiroTrbInfo *tmp = (struct KiroTrbInfo *)priv->mem;
+    if (tmp->version != KIRO_TRB_VERSION) {
+        g_warning ("TRB memory has layout version %" G_GUINT64_FORMAT ", expected %i", tmp->version, KIRO_TRB_VERSION);
+        priv->initialized = 0;
+        return;
+    }
+
     priv->buff_size = tmp->buffer_size_bytes;
     priv->element_size = tmp->element_size;
-    priv->max_elements = (tmp->buffer_size_bytes - sizeof (struct KiroTrbInfo)) / tmp->element_size;
+    priv->meta_size = tmp->meta_size;
+    priv->max_elements = (tmp->buffer_size_bytes - sizeof (struct KiroTrbInfo)) / (tmp->element_size + tmp->meta_size);
     priv->iteration = tmp->offset / priv->max_elements;
-    priv->frame_top = priv->mem + sizeof (struct KiroTrbInfo);
+    priv->meta_top = priv->mem + sizeof (struct KiroTrbInfo);
+    priv->frame_top = priv->meta_top + (priv->max_elements * priv->meta_size);
     priv->current = priv->frame_top + ((tmp->offset % priv->max_elements) * priv->element_size);
     priv->initialized = 1;
+    reset_multi_producer (priv);
 }
 
 
@@ -341,10 +638,14 @@ kiro_trb_adopt (KiroTrb *self, void *buff_in)
 
     KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
 
-    if (priv->mem)
-        g_free (priv->mem);
+    // Re-adopting the own memory (e.g. after its header was changed) keeps
+    // it, including a file mapping
+    if (priv->mem != buff_in) {
+        release_memory (priv);
+        priv->mem = buff_in;
+        priv->mapped = 0;
+    }
 
-    priv->mem = buff_in;
     priv->initialized = 1;
     kiro_trb_refresh (self);
 }
@@ -356,19 +657,321 @@ kiro_trb_clone (KiroTrb *self, void *buff_in)
     g_return_val_if_fail (self != NULL, -1);
     KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
     struct KiroTrbInfo *header = (struct KiroTrbInfo *)buff_in;
+    if (header->version != KIRO_TRB_VERSION) {
+        g_warning ("TRB memory has layout version %" G_GUINT64_FORMAT ", expected %i", header->version, KIRO_TRB_VERSION);
+        return -1;
+    }
+
     void *newmem = g_try_malloc0 (header->buffer_size_bytes);
 
     if (!newmem)
         return -1;
 
     memcpy (newmem, buff_in, header->buffer_size_bytes);
+    release_memory (priv);
+    priv->mem = newmem;
+    priv->initialized = 1;
+    kiro_trb_refresh (self);
+    return 0;
+}
 
-    if (priv->mem)
-        g_free (priv->mem);
+
+int
+kiro_trb_resize (KiroTrb *self, uint64_t element_count, void **old_memory)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || element_count < 1)
+        return -1;
+
+    if (priv->mapped) {
+        g_warning ("Resizing a file backed TRB is not supported");
+        return -1;
+    }
+
+    uint64_t element_size = priv->element_size;
+    uint64_t meta_size = priv->meta_size;
+    uint64_t old_count = priv->max_elements;
+    uint64_t offset = (priv->iteration * old_count) + ((priv->current - priv->frame_top) / element_size);
+
+    size_t new_size = ((element_size + meta_size) * element_count) + sizeof (struct KiroTrbInfo);
+    void *newmem = g_try_malloc0 (new_size);
+
+    if (!newmem)
+        return -1;
+
+    void *new_meta_top = newmem + sizeof (struct KiroTrbInfo);
+    void *new_frame_top = new_meta_top + (element_count * meta_size);
+
+    // Migrate the most recent elements that fit into both layouts. Every
+    // element keeps its sequence number, so it moves from slot (seq % old) to
+    // slot (seq % new). Copy in runs that don't wrap in either layout.
+    uint64_t keep = MIN (offset, MIN (old_count, element_count));
+    uint64_t seq = offset - keep;
+
+    while (seq < offset) {
+        uint64_t src = seq % old_count;
+        uint64_t dst = seq % element_count;
+        uint64_t run = MIN (offset - seq, MIN (old_count - src, element_count - dst));
+
+        memcpy (new_frame_top + (dst * element_size), priv->frame_top + (src * element_size), run * element_size);
+        if (meta_size)
+            memcpy (new_meta_top + (dst * meta_size), priv->meta_top + (src * meta_size), run * meta_size);
+
+        seq += run;
+    }
+
+    struct KiroTrbInfo *header = (struct KiroTrbInfo *)newmem;
+    header->buffer_size_bytes = new_size;
+    header->element_size = element_size;
+    header->meta_size = meta_size;
+    header->version = KIRO_TRB_VERSION;
+    header->offset = offset;
+
+    if (old_memory)
+        *old_memory = priv->mem;
+    else
+        release_memory (priv);
 
     priv->mem = newmem;
+    priv->mapped = 0;
+    kiro_trb_refresh (self);
+    return 0;
+}
+
+
+int
+kiro_trb_open_file (KiroTrb *self, const char *path, uint64_t element_size, uint64_t element_count)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    g_return_val_if_fail (path != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (element_size < 1 || element_count < 1)
+        return -1;
+
+    int fd = open (path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        g_critical ("Failed to open '%s' for the TRB: %s", path, strerror (errno));
+        return -1;
+    }
+
+    struct stat st;
+    struct statfs stfs;
+    if (fstat (fd, &st) || fstatfs (fd, &stfs)) {
+        g_critical ("Failed to stat '%s': %s", path, strerror (errno));
+        close (fd);
+        return -1;
+    }
+
+    size_t size = (element_size * element_count) + sizeof (struct KiroTrbInfo);
+    // hugetlbfs only allows mappings in multiples of the huge page size,
+    // which it reports as the block size of the file system
+    size_t map_size = ((size + stfs.f_bsize - 1) / stfs.f_bsize) * stfs.f_bsize;
+
+    // Keep the content of an existing buffer with the same geometry, so a
+    // restarted producer continues at the offset it left off at
+    gboolean resume = FALSE;
+    if ((size_t)st.st_size == map_size) {
+        struct KiroTrbInfo header;
+        if (pread (fd, &header, sizeof (header), 0) == sizeof (header)
+            && header.buffer_size_bytes == size
+            && header.element_size == element_size
+            && header.meta_size == 0
+            && header.version == KIRO_TRB_VERSION)
+            resume = TRUE;
+    }
+
+    if (!resume && ftruncate (fd, map_size)) {
+        g_critical ("Failed to resize '%s': %s", path, strerror (errno));
+        close (fd);
+        return -1;
+    }
+
+    void *mem = mmap (NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+
+    if (mem == MAP_FAILED) {
+        g_critical ("Failed to map '%s': %s", path, strerror (errno));
+        return -1;
+    }
+
+    if (!resume) {
+        memset (mem, 0, sizeof (struct KiroTrbInfo));
+        ((struct KiroTrbInfo *)mem)->buffer_size_bytes = size;
+        ((struct KiroTrbInfo *)mem)->element_size = element_size;
+        ((struct KiroTrbInfo *)mem)->offset = 0;
+        ((struct KiroTrbInfo *)mem)->version = KIRO_TRB_VERSION;
+    }
+    else
+        g_debug ("Resuming TRB in '%s' at offset %" G_GUINT64_FORMAT, path, ((struct KiroTrbInfo *)mem)->offset);
+
+    release_memory (priv);
+    priv->mem = mem;
+    priv->mapped = map_size;
     priv->initialized = 1;
     kiro_trb_refresh (self);
     return 0;
 }
 
+
+uint64_t
+kiro_trb_get_offset (KiroTrb *self)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1)
+        return 0;
+
+    return read_offset (priv);
+}
+
+
+void
+kiro_trb_cursor_init (KiroTrb *self, struct KiroTrbCursor *cursor)
+{
+    g_return_if_fail (self != NULL);
+    g_return_if_fail (cursor != NULL);
+
+    cursor->next = kiro_trb_get_offset (self);
+}
+
+
+guint
+kiro_trb_cursor_read (KiroTrb *self, struct KiroTrbCursor *cursor, struct KiroTrbSpan *spans, uint64_t *lost)
+{
+    g_return_val_if_fail (self != NULL, 0);
+    g_return_val_if_fail (cursor != NULL, 0);
+    g_return_val_if_fail (spans != NULL, 0);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (lost)
+        *lost = 0;
+
+    if (priv->initialized != 1)
+        return 0;
+
+    uint64_t offset = read_offset (priv);
+
+    // The buffer was flushed or reshaped since the last read. Start over.
+    if (cursor->next > offset)
+        cursor->next = offset;
+
+    uint64_t available = offset - cursor->next;
+    if (available > priv->max_elements) {
+        if (lost)
+            *lost = available - priv->max_elements;
+        cursor->next = offset - priv->max_elements;
+        available = priv->max_elements;
+    }
+
+    guint num_spans = 0;
+    while (available > 0) {
+        uint64_t slot = cursor->next % priv->max_elements;
+        uint64_t run = MIN (available, priv->max_elements - slot);
+
+        spans[num_spans].data = priv->frame_top + (slot * priv->element_size);
+        spans[num_spans].first = cursor->next;
+        spans[num_spans].count = run;
+        spans[num_spans].meta = priv->meta_size ? (priv->meta_top + (slot * priv->meta_size)) : NULL;
+        num_spans++;
+
+        cursor->next += run;
+        available -= run;
+    }
+
+    return num_spans;
+}
+
+
+int
+kiro_trb_enable_multi_producer (KiroTrb *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || priv->batching)
+        return -1;
+
+    if (priv->committed)
+        return 0;
+
+    priv->committed = g_try_malloc0 (priv->max_elements * sizeof (uint64_t));
+    if (!priv->committed)
+        return -1;
+
+    priv->published = sequence_for_slot (priv, priv->current);
+    priv->reserved = priv->published;
+    return 0;
+}
+
+
+void *
+kiro_trb_reserve (KiroTrb *self, uint64_t *sequence)
+{
+    g_return_val_if_fail (self != NULL, NULL);
+    g_return_val_if_fail (sequence != NULL, NULL);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || !priv->committed)
+        return NULL;
+
+    uint64_t seq = __atomic_fetch_add (&priv->reserved, 1, __ATOMIC_RELAXED);
+
+    // Don't hand out a slot that a still pending element from the previous
+    // lap is being written to
+    while (seq >= __atomic_load_n (&priv->published, __ATOMIC_ACQUIRE) + priv->max_elements)
+        g_thread_yield ();
+
+    *sequence = seq;
+    return priv->frame_top + ((seq % priv->max_elements) * priv->element_size);
+}
+
+
+int
+kiro_trb_commit (KiroTrb *self, uint64_t sequence)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || !priv->committed)
+        return -1;
+
+    if (sequence >= __atomic_load_n (&priv->reserved, __ATOMIC_RELAXED))
+        return -1;
+
+    __atomic_store_n (&priv->committed[sequence % priv->max_elements], sequence + 1, __ATOMIC_RELEASE);
+    publish_committed (priv);
+    return 0;
+}
+
+
+int
+kiro_trb_begin_batch (KiroTrb *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (priv->initialized != 1 || priv->committed)
+        return -1;
+
+    priv->batching = TRUE;
+    return 0;
+}
+
+
+int
+kiro_trb_end_batch (KiroTrb *self)
+{
+    g_return_val_if_fail (self != NULL, -1);
+    KiroTrbPrivate *priv = KIRO_TRB_GET_PRIVATE (self);
+
+    if (!priv->batching)
+        return -1;
+
+    priv->batching = FALSE;
+    write_header (priv);
+    return 0;
+}
@@ -60,16 +60,68 @@ struct _KiroTrbClass {
 };
 
 
+/*
+ * Version of the memory layout described by struct KiroTrbInfo. It has to be
+ * increased whenever the header or the placement of the data behind it
+ * changes, so a KiroTrb never interprets memory of a different layout.
+ */
+#define KIRO_TRB_VERSION 2
+
+
 struct KiroTrbInfo {
 
     /* internal information about the buffer */
     uint64_t buffer_size_bytes;  // Size in bytes INCLUDING this header
     uint64_t element_size;       // Size in bytes of one single element
     uint64_t offset;             // Current Offset to access the 'oldest' element (in element count!)
+    uint64_t meta_size;          // Size in bytes of one metadata record. 0 if there is no metadata column
+    uint64_t version;            // Layout version of the memory. Always KIRO_TRB_VERSION
 
 } __attribute__ ((packed));
 
 
+/*
+ * Fixed-size metadata record that is kept for every element of a TRB that was
+ * set up using kiro_trb_reshape_with_meta. The records are stored as one
+ * contiguous column right after the memory header, in the same order as the
+ * elements themselves.
+ */
+struct KiroTrbMeta {
+
+    uint64_t timestamp;          // Producer wall-clock time of the push (in microseconds)
+    uint64_t sequence;           // Absolute sequence number of the element
+    uint64_t size;               // Number of valid bytes in the element
+    uint64_t tag;                // User defined tag
+
+} __attribute__ ((packed));
+
+
+/*
+ * Reading position of a single consumer of a TRB. The cursor is a plain
+ * structure owned by the consumer, so any number of consumers can read from
+ * the same TRB independently of each other.
+ */
+struct KiroTrbCursor {
+
+    uint64_t next;               // Absolute sequence number of the next element to consume
+
+};
+
+
+/*
+ * A run of consecutive elements in the TRBs memory, as returned by
+ * kiro_trb_cursor_read.
+ */
+struct KiroTrbSpan {
+
+    void     *data;              // Pointer to the first element of this span
+    uint64_t first;              // Absolute sequence number of the first element
+    uint64_t count;              // Number of consecutive elements in this span
+    struct KiroTrbMeta *meta;    // Metadata of the first element. NULL if the TRB has no metadata column
+
+};
+
+
 /* GObject and GType functions */
 GType       kiro_trb_get_type           (void);
 
@@ -176,8 +228,12 @@ void* kiro_trb_get_raw_buffer (KiroTrb *trb);
  * @index: Index of the element in the buffer to access
  *
  *   Returns a pointer to the element in the buffer at the given index.
+ *   Index 0 refers to the slot that will be written by the next push (which
+ *   holds the oldest element once the buffer has wrapped around). Positive
+ *   indices count forward from there, negative indices count backwards, so
+ *   -1 always refers to the most recently pushed element.
  *
- * Returns: (transfer none) (type gulong): 
+ * Returns: (transfer none) (type gulong):
  *   A pointer to the element at the given index.
  * Notes:
  *   The returned pointer to the element is only guaranteed to be valid
@@ -190,12 +246,56 @@ void* kiro_trb_get_raw_buffer (KiroTrb *trb);
  *   pointer be 'freed' by the user!
  *   If this function is called on a buffer that is not yet setup,
  *   a NULL pointer is returned instead.
+ *   Up to ABI version 1, the direction of the indices was reversed: positive
+ *   indices counted backwards from the next slot and negative ones forward,
+ *   so -1 referred to the second oldest element. Callers that compensated
+ *   for that need to be adapted.
  * See also:
  *   kiro_trb_get_element_size, kiro_trb_get_raw_buffer
  */
 void* kiro_trb_get_element (KiroTrb *trb, glong index);
 
 
+/**
+ * kiro_trb_get_meta:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @index: Index of the element in the buffer to access
+ *
+ *   Returns a pointer to the #KiroTrbMeta record of the element at the given
+ *   index. Indices are interpreted the same way as by kiro_trb_get_element.
+ *
+ * Returns: (transfer none):
+ *   A pointer to the metadata record of the element at the given index.
+ * Notes:
+ *   The same restrictions as for kiro_trb_get_element apply. After a call to
+ *   kiro_trb_dma_push, the record of the new element (index -1) may be used
+ *   to set its 'size' and 'tag' members before kiro_trb_dma_commit is called.
+ *   If the buffer is not setup or has no metadata column, a NULL pointer is
+ *   returned instead.
+ * See also:
+ *   kiro_trb_get_element, kiro_trb_reshape_with_meta
+ */
+struct KiroTrbMeta* kiro_trb_get_meta (KiroTrb *trb, glong index);
+
+
+/**
+ * kiro_trb_get_meta_column:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @offset: (out): Offset in bytes of the metadata column within the raw buffer
+ * @size: (out): Size in bytes of the metadata column
+ *
+ *   Retrieves the location of the metadata column within the memory returned
+ *   by kiro_trb_get_raw_buffer. This is the range a remote client needs to
+ *   read to learn the metadata of all elements in the buffer.
+ *
+ * Returns:
+ *   %TRUE if the buffer has a metadata column, %FALSE otherwise
+ * See also:
+ *   kiro_trb_get_meta, kiro_trb_reshape_with_meta
+ */
+gboolean kiro_trb_get_meta_column (KiroTrb *trb, uint64_t *offset, uint64_t *size);
+
+
 /**
  * kiro_trb_dma_push:
  * @trb: (transfer none): #KiroTrb to perform the operation on
@@ -215,14 +315,43 @@ void* kiro_trb_get_element (KiroTrb *trb, glong index);
  *   changing the buffer memory entirely.
  *   Under no circumstances might the memory pointed to by the returned
  *   pointer be 'freed' by the user!
+ *   Once the element is written, it has to be handed to kiro_trb_dma_commit.
  *   If this function is called on a buffer that is not yet setup,
  *   a NULL pointer is returned instead.
  * See also:
- *   kiro_trb_push, kiro_trb_get_element_size, kiro_trb_get_raw_buffer
+ *   kiro_trb_dma_commit, kiro_trb_push, kiro_trb_get_element_size,
+ *   kiro_trb_get_raw_buffer
  */
 void* kiro_trb_dma_push (KiroTrb *trb);
 
 
+/**
+ * kiro_trb_dma_commit:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @element: (transfer none) (type gulong): Pointer returned by
+ *   kiro_trb_dma_push
+ *
+ *   Marks an element that was obtained from kiro_trb_dma_push as completely
+ *   written. For a buffer with a metadata column, this stamps the sequence
+ *   number into the metadata record of the element, which readers use to
+ *   tell if the element is complete. In multi-producer mode, this commits
+ *   the element like kiro_trb_commit.
+ *
+ * Returns:
+ *   0 on success, -1 if the buffer is not setup or @element is not an element
+ *   that is pending in the buffer
+ * Notes:
+ *   Until this function is called, the metadata record of the element holds
+ *   no valid sequence number, so readers that check it treat the element as
+ *   incomplete. In multi-producer mode, the buffer offset does not advance
+ *   past an element before it is committed, so every element returned by
+ *   kiro_trb_dma_push has to be committed eventually.
+ * See also:
+ *   kiro_trb_dma_push, kiro_trb_get_meta
+ */
+int kiro_trb_dma_commit (KiroTrb *trb, void *element);
+
+
 /**
  * kiro_trb_flush:
  * @trb: (transfer none): #KiroTrb to perform the operation on
@@ -297,6 +426,26 @@ int kiro_trb_is_setup (KiroTrb *trb);
 int kiro_trb_reshape (KiroTrb *trb, uint64_t element_size, uint64_t element_count);
 
 
+/**
+ * kiro_trb_reshape_with_meta:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @element_size: Individual size of the elements to store in bytes
+ * @element_count: Maximum number of elements to be stored
+ *
+ *   Works like kiro_trb_reshape, but additionally reserves a #KiroTrbMeta
+ *   record for every element. The records are stored as a separate,
+ *   contiguous column directly after the memory header, so a remote client
+ *   can read the metadata of all elements with one small transfer and then
+ *   fetch only the payloads it is interested in.
+ *
+ * Returns:
+ *   integer: < 0 for error, >= 0 for success
+ * See also:
+ *   kiro_trb_reshape, kiro_trb_get_meta, kiro_trb_get_meta_column
+ */
+int kiro_trb_reshape_with_meta (KiroTrb *trb, uint64_t element_size, uint64_t element_count);
+
+
 /**
  * kiro_trb_clone:
  * @trb: (transfer none); #KiroTrb to perform the operation on
@@ -314,13 +463,74 @@ int kiro_trb_reshape (KiroTrb *trb, uint64_t element_size, uint64_t element_coun
  *   If the given memory is not a consistent KIRO TRB memory block,
  *   the behavior of this function is undefined.
  *   Returns 0 if the buffer was cloned and -1 if memory allocation
- *   failed.
+ *   failed or the memory header is of a different KIRO_TRB_VERSION.
  * See also:
  *   kiro_trb_reshape, kiro_trb_adopt
  */
 int kiro_trb_clone (KiroTrb *trb, void *source);
 
 
+/**
+ * kiro_trb_resize:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @element_count: New maximum number of elements to be stored
+ * @old_memory: (out) (allow-none): Storage for a pointer to the previous
+ *   buffer memory
+ *
+ *   Changes the number of elements the buffer can hold without discarding
+ *   its content. The most recent elements that fit into the new layout are
+ *   migrated, together with their metadata records (if any), and keep their
+ *   sequence numbers. The offset of the buffer is preserved, so
+ *   #KiroTrbCursor based readers continue without a gap.
+ *
+ * Returns:
+ *   0 on success, -1 if the buffer is not setup, is backed by a file or
+ *   memory allocation failed
+ * Notes:
+ *   If @old_memory is given, the previous buffer memory is not freed, but
+ *   handed over to the caller, who is responsible to g_free() it. This
+ *   allows the old memory to remain valid until all remote readers have
+ *   switched to the new memory (see kiro_server_realloc).
+ *   Like kiro_trb_reshape, this function must not be called while elements
+ *   are being pushed concurrently.
+ * See also:
+ *   kiro_trb_reshape, kiro_sb_resize
+ */
+int kiro_trb_resize (KiroTrb *trb, uint64_t element_count, void **old_memory);
+
+
+/**
+ * kiro_trb_open_file:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @path: (transfer none): Path of the file to back the buffer with
+ * @element_size: Individual size of the elements to store in bytes
+ * @element_count: Maximum number of elements to be stored
+ *
+ *   Backs the buffer with a shared memory mapping of the file at @path,
+ *   instead of allocated memory. If the file already holds a buffer with the
+ *   same geometry, its content is kept and the buffer continues at the offset
+ *   stored in its header. Otherwise the file is created or resized and the
+ *   buffer starts out empty.
+ *
+ * Returns:
+ *   0 on success, -1 if the file could not be created or mapped
+ * Notes:
+ *   Since the content of the file is kept on restart, a producer that was
+ *   restarted resumes the buffer where it left off and readers never see the
+ *   offset being reset. The file may reside on a hugetlbfs or DAX mount, in
+ *   which case the mapping is rounded up to the page size of that file
+ *   system.
+ *   The memory returned by kiro_trb_get_raw_buffer is the mapping itself and
+ *   can be handed to kiro_server_start directly. Calling kiro_trb_purge with
+ *   free_memory set to %FALSE orphans the mapping; it is the users
+ *   responsibility to munmap() it afterwards.
+ *   Any previously held memory is released.
+ * See also:
+ *   kiro_trb_reshape, kiro_trb_refresh, kiro_trb_get_raw_buffer
+ */
+int kiro_trb_open_file (KiroTrb *trb, const char *path, uint64_t element_size, uint64_t element_count);
+
+
 /**
  * kiro_trb_push:
  * @trb: (transfer none): #KiroTrb to perform the operation on
@@ -343,6 +553,28 @@ int kiro_trb_clone (KiroTrb *trb, void *source);
 int kiro_trb_push (KiroTrb *trb, void *source);
 
 
+/**
+ * kiro_trb_push_with_meta:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @source: (transfer none) (type gulong):
+ *   Pointer to the memory of the element to add
+ * @size: Number of bytes to copy from @source
+ * @tag: User defined tag to store with the element
+ *
+ *   Copies @size bytes of the given element into the buffer and records
+ *   @size and @tag, together with the current time and the sequence number
+ *   of the element, in the elements #KiroTrbMeta record.
+ *
+ * Notes:
+ *   @size may not exceed the element size of the buffer. For buffers
+ *   without a metadata column, @size and @tag are not recorded.
+ *   Returns 0 on success, -1 on failure.
+ * See also:
+ *   kiro_trb_push, kiro_trb_reshape_with_meta, kiro_trb_get_meta
+ */
+int kiro_trb_push_with_meta (KiroTrb *trb, void *source, uint64_t size, uint64_t tag);
+
+
 /**
  * kiro_trb_refresh:
  * @trb: (transfer none): #KiroTrb to perform the operation on
@@ -356,6 +588,8 @@ int kiro_trb_push (KiroTrb *trb, void *source);
  *   aware of the changes to its memory. Only the buffers memory
  *   header is examined and changes are made according to these
  *   informations.
+ *   If the header is of a different KIRO_TRB_VERSION, the buffer is marked
+ *   as not setup.
  * See also:
  *   kiro_trb_get_raw_buffer, kiro_trb_push_dma, kiro_trb_adopt
  */
@@ -386,6 +620,181 @@ void kiro_trb_refresh (KiroTrb *trb);
  */
 void kiro_trb_adopt (KiroTrb *trb, void *source);
 
+
+/**
+ * kiro_trb_get_offset:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ *
+ *   Returns the absolute sequence number of the next element that will be
+ *   pushed onto the buffer, which equals the total number of elements pushed
+ *   since the buffer was reshaped or flushed.
+ *
+ * Notes:
+ *   The value is read from the memory header of the buffer, so for a buffer
+ *   that mirrors remote memory it reflects the last synchronized header.
+ *   If this function is called on a buffer that is not yet setup, 0 is
+ *   returned instead.
+ * See also:
+ *   kiro_trb_cursor_init, kiro_trb_cursor_read
+ */
+uint64_t kiro_trb_get_offset (KiroTrb *trb);
+
+
+/**
+ * kiro_trb_cursor_init:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @cursor: (transfer none): The #KiroTrbCursor to initialize
+ *
+ *   Positions the given cursor at the current offset of the buffer, so the
+ *   next call to kiro_trb_cursor_read will only return elements that are
+ *   pushed after this call.
+ *
+ * Notes:
+ *   To replay elements that are already held by the buffer, set the 'next'
+ *   member of the cursor to an earlier sequence number after calling this
+ *   function.
+ * See also:
+ *   kiro_trb_cursor_read, kiro_trb_get_offset
+ */
+void kiro_trb_cursor_init (KiroTrb *trb, struct KiroTrbCursor *cursor);
+
+
+/**
+ * kiro_trb_cursor_read:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @cursor: (transfer none): The #KiroTrbCursor of the consumer
+ * @spans: (transfer none) (array fixed-size=2): Storage for (at least) two
+ *   #KiroTrbSpan structures
+ * @lost: (out) (allow-none): Number of elements that were overwritten before
+ *   they could be read
+ *
+ *   Returns all elements that were pushed since the last read of the given
+ *   @cursor and advances the cursor past them. Because the elements may wrap
+ *   around the end of the buffer memory, they are returned as at most two
+ *   contiguous spans in ascending sequence order.
+ *
+ * Returns:
+ *   The number of spans (0, 1 or 2) that were filled in
+ * Notes:
+ *   If the consumer fell behind by more than kiro_trb_get_max_elements, the
+ *   oldest unread elements have already been overwritten. Their number is
+ *   stored in @lost and only the elements still held by the buffer are
+ *   returned.
+ *   The returned pointers are subject to the same restrictions as the ones
+ *   returned by kiro_trb_get_element. In particular, a producer that keeps
+ *   pushing while the spans are being processed will eventually overwrite
+ *   them. Compare the sequence numbers of the spans against
+ *   kiro_trb_get_offset after processing if this needs to be detected.
+ *   For a buffer that mirrors remote memory, kiro_trb_refresh should be
+ *   called after the header was synchronized.
+ * See also:
+ *   kiro_trb_cursor_init, kiro_trb_get_offset, kiro_trb_get_element
+ */
+guint kiro_trb_cursor_read (KiroTrb *trb, struct KiroTrbCursor *cursor, struct KiroTrbSpan *spans, uint64_t *lost);
+
+
+/**
+ * kiro_trb_enable_multi_producer:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ *
+ *   Switches the buffer into multi-producer mode. In this mode, any number of
+ *   threads may claim slots concurrently by using kiro_trb_reserve and
+ *   complete them in any order by using kiro_trb_commit. The offset in the
+ *   buffer header only advances over contiguous committed elements, so readers
+ *   always see a consistent prefix of the stream.
+ *
+ * Returns:
+ *   0 on success, -1 if the buffer is not setup, a batch is open (see
+ *   kiro_trb_begin_batch) or memory allocation failed
+ * Notes:
+ *   While in multi-producer mode, kiro_trb_push and kiro_trb_dma_push (together
+ *   with kiro_trb_dma_commit) use reserve/commit internally and are therefore
+ *   also safe to be called concurrently. All other functions that change the buffer (flush, reshape,
+ *   adopt, ...) must not be called while any producer is active. The mode is
+ *   kept across these calls.
+ * See also:
+ *   kiro_trb_reserve, kiro_trb_commit
+ */
+int kiro_trb_enable_multi_producer (KiroTrb *trb);
+
+
+/**
+ * kiro_trb_reserve:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @sequence: (out): The sequence number of the reserved slot
+ *
+ *   Atomically claims the next slot in the buffer and returns a pointer to
+ *   it. The element can then be written by the caller and has to be handed
+ *   back using kiro_trb_commit with the returned @sequence number.
+ *
+ * Returns: (transfer none):
+ *   A pointer to the reserved slot, or NULL if the buffer is not setup or not
+ *   in multi-producer mode
+ * Notes:
+ *   If the slot is still occupied by an uncommitted element from the
+ *   previous lap through the buffer, this function yields until that element
+ *   has been committed. Every reserved slot must be committed eventually,
+ *   otherwise the buffer offset stops advancing.
+ * See also:
+ *   kiro_trb_enable_multi_producer, kiro_trb_commit
+ */
+void* kiro_trb_reserve (KiroTrb *trb, uint64_t *sequence);
+
+
+/**
+ * kiro_trb_commit:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ * @sequence: Sequence number obtained from kiro_trb_reserve
+ *
+ *   Marks the element with the given sequence number as complete. The buffer
+ *   offset is advanced past it as soon as all elements before it have been
+ *   committed as well.
+ *
+ * Returns:
+ *   0 on success, -1 if the buffer is not in multi-producer mode or
+ *   @sequence was never reserved
+ * See also:
+ *   kiro_trb_enable_multi_producer, kiro_trb_reserve
+ */
+int kiro_trb_commit (KiroTrb *trb, uint64_t sequence);
+
+
+/**
+ * kiro_trb_begin_batch:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ *
+ *   Starts a batch of pushes. Elements pushed with kiro_trb_push or
+ *   kiro_trb_dma_push during the batch are stored as usual, but the offset
+ *   in the buffer header is only updated once, by kiro_trb_end_batch. Readers
+ *   of the header (e.g. remote clones) therefore see the whole batch appear
+ *   at once instead of chasing individual elements.
+ *
+ * Returns:
+ *   0 on success, -1 if the buffer is not setup or in multi-producer mode
+ * Notes:
+ *   kiro_trb_get_offset reports the published offset, so it does not
+ *   advance during a batch. A batch of more than kiro_trb_get_max_elements
+ *   elements overwrites its own beginning before it is published.
+ * See also:
+ *   kiro_trb_end_batch
+ */
+int kiro_trb_begin_batch (KiroTrb *trb);
+
+
+/**
+ * kiro_trb_end_batch:
+ * @trb: (transfer none): #KiroTrb to perform the operation on
+ *
+ *   Ends a batch started with kiro_trb_begin_batch and publishes all elements
+ *   pushed during the batch with a single header update.
+ *
+ * Returns:
+ *   0 on success, -1 if no batch was started
+ * See also:
+ *   kiro_trb_begin_batch
+ */
+int kiro_trb_end_batch (KiroTrb *trb);
+
 G_END_DECLS
 
 #endif //__KIRO_TRB_H
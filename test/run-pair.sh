@@ -0,0 +1,32 @@
+#!/bin/sh
+# Runs a serve/clone test pair on one host: the server side is started in the
+# background, the clone side runs until it reports its result.
+#
+# Usage: run-pair.sh <test binary> <address> <port> [<clone arguments>...]
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 <test binary> <address> <port> [<clone arguments>...]"
+    exit 2
+fi
+
+binary=$1
+address=$2
+port=$3
+shift 3
+
+"$binary" serve "$address" "$port" &
+server=$!
+
+# Give the server time to listen before the clone connects
+sleep 2
+if ! kill -0 $server 2>/dev/null; then
+    echo "FAILED: $binary serve did not start"
+    exit 1
+fi
+
+"$binary" clone "$address" "$port" "$@"
+result=$?
+
+kill $server 2>/dev/null
+wait $server 2>/dev/null
+exit $result
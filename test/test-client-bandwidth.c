@@ -1,16 +1,36 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "kiro-client.h"
 #include "kiro-trb.h"
 #include <assert.h>
 
 
+static double
+measure (KiroClient *client, int rounds)
+{
+    GTimer *timer = g_timer_new ();
+    for (int i = 0; i < rounds; i++) {
+        // A failed sync transfers nothing, so it must not count
+        if (0 > kiro_client_sync (client)) {
+            g_timer_destroy (timer);
+            return -1;
+        }
+    }
+
+    double elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+    size_t size = kiro_client_get_memory_size (client);
+    return ((size * rounds) / elapsed)/(1024*1024*1024);
+}
+
+
 int 
 main ( int argc, char *argv[] )
 {
     if (argc < 3) {
-        printf ("Not enough aruments. Usage: kiro-test-bandwidth <address> <port>\n");
+        printf ("Not enough aruments. Usage: kiro-test-bandwidth <address> <port> [<rail address>[@<local address>] ...]\n");
         return -1;
     }
 
@@ -25,26 +45,48 @@ main ( int argc, char *argv[] )
     KiroTrb *trb = kiro_trb_new ();
     kiro_trb_adopt (trb, kiro_client_get_memory (client));
 
-    GTimer *timer = g_timer_new ();
-
-
-while (1) {   
-    g_timer_reset (timer);
-    int i = 0;
-    while(i < 500) {
-        kiro_client_sync (client);
-        i++;
+    // Every further argument adds a rail. The single connection is measured
+    // first, so the gain of the rails is visible.
+    double single = 0;
+    if (argc > 3) {
+        single = measure (client, 500);
+        if (single < 0)
+            goto fail;
+        printf ("Throughput (1 connection): %.2fGbyte/s\n", single);
+
+        for (int i = 3; i < argc; i++) {
+            char *address = g_strdup (argv[i]);
+            char *local = strchr (address, '@');
+            if (local)
+                *local++ = '\0';
+            if (0 > kiro_client_add_rail (client, local, address, argv[2]))
+                printf ("Failed to add rail %s\n", argv[i]);
+            g_free (address);
+        }
     }
 
-    double elapsed = g_timer_elapsed (timer, NULL);
-    size_t size = kiro_client_get_memory_size (client);
-    printf ("Throughput: %.2fGbyte/s\n",((size * 500) / elapsed)/(1024*1024*1024));
+while (1) {   
+    double throughput = measure (client, 500);
+    if (throughput < 0)
+        goto fail;
+    guint rails = kiro_client_get_rail_count (client);
+
+    if (single > 0 && rails)
+        printf ("Throughput (%u connections): %.2fGbyte/s (%.2fx)\n", rails + 1, throughput, throughput / single);
+    else
+        printf ("Throughput: %.2fGbyte/s\n", throughput);
 }
-    g_timer_stop (timer);
     kiro_trb_purge (trb, FALSE);
     kiro_trb_free (trb);
     kiro_client_free (client);
     return 0;
+
+fail:
+    printf ("Sync failed\n");
+    kiro_trb_purge (trb, FALSE);
+    kiro_trb_free (trb);
+    kiro_client_free (client);
+    return -1;
 }
 
 
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+#define ENTRY_SIZE 256
+
+
+static int
+run_serve (const char *address, const char *port, gulong size, guint updates)
+{
+    char *mem = g_malloc0 (size);
+    KiroServer *server = kiro_server_new ();
+    if (0 > kiro_server_start (server, address, port, mem, size)) {
+        kiro_server_free (server);
+        g_free (mem);
+        return -1;
+    }
+
+    // The table consists of entries that start with their own index and the
+    // number of times they were updated
+    gulong entries = size / ENTRY_SIZE;
+    for (gulong i = 0; i < entries; i++)
+        *(uint64_t *)(mem + i * ENTRY_SIZE) = i;
+    kiro_server_mark_dirty (server, 0, size);
+
+    while (1) {
+        for (guint u = 0; u < updates; u++) {
+            gulong i = g_random_int_range (0, entries);
+            uint64_t *entry = (uint64_t *)(mem + i * ENTRY_SIZE);
+            entry[1]++;
+            kiro_server_mark_dirty (server, i * ENTRY_SIZE, ENTRY_SIZE);
+        }
+        g_usleep (G_USEC_PER_SEC / 100);
+    }
+
+    kiro_server_free (server);
+    g_free (mem);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint num_pages, guint hot_percent, guint seconds)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port)) {
+        kiro_client_free (client);
+        return -1;
+    }
+
+    gulong entries = kiro_client_get_memory_size (client) / ENTRY_SIZE;
+    gulong hot = MAX (entries * hot_percent / 100, 1);
+    char entry[ENTRY_SIZE];
+
+    kiro_client_set_cache (client, num_pages, 4096);
+    guint64 wrong = 0;
+
+    for (guint s = 0; s < seconds || seconds == 0; s++) {
+        guint64 reads = 0, bad = 0;
+        guint64 hits, misses, old_hits, old_misses;
+        double cached = 0, direct = 0;
+        kiro_client_get_cache_stats (client, &old_hits, &old_misses);
+        gint64 start = g_get_monotonic_time ();
+
+        // Nine out of ten lookups go to the hot part of the table
+        while (g_get_monotonic_time () - start < G_USEC_PER_SEC) {
+            gulong i = g_random_int_range (0, 10) ? g_random_int_range (0, hot) : g_random_int_range (0, entries);
+
+            GTimer *timer = g_timer_new ();
+            if (0 > kiro_client_read (client, i * ENTRY_SIZE, ENTRY_SIZE, entry))
+                goto fail;
+            cached += g_timer_elapsed (timer, NULL);
+            bad += (*(uint64_t *)entry != i);
+
+            // For comparison, the same lookup without the cache
+            g_timer_start (timer);
+            if (0 > kiro_client_sync_partial (client, i * ENTRY_SIZE, ENTRY_SIZE, i * ENTRY_SIZE))
+                goto fail;
+            direct += g_timer_elapsed (timer, NULL);
+            g_timer_destroy (timer);
+            reads++;
+        }
+
+        kiro_client_get_cache_stats (client, &hits, &misses);
+        hits -= old_hits;
+        misses -= old_misses;
+        printf ("Reads: %7lu/s  Hit rate: %5.1f%%  Avg. latency: %6.2fus (uncached: %6.2fus)  Wrong entries: %lu\n",
+                reads, (hits + misses) ? 100. * hits / (hits + misses) : 0., cached * 1e6 / reads,
+                direct * 1e6 / reads, bad);
+        wrong += bad;
+    }
+
+    kiro_client_free (client);
+
+    if (wrong) {
+        printf ("FAILED: kiro_client_read returned %" G_GUINT64_FORMAT " wrong entries\n", wrong);
+        return 1;
+    }
+
+    printf ("PASSED: All cached reads returned the right entries\n");
+    return 0;
+
+fail:
+    printf ("Read failed\n");
+    kiro_client_free (client);
+    return -1;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-client-cache serve <address> <port> [<size in MByte> [<updates per 10ms>]]\n");
+        printf ("       kiro-test-client-cache clone <address> <port> [<cached pages> [<hot entries in %%> [<seconds, 0 for no limit>]]]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve")) {
+        gulong size = argc > 4 ? strtoul (argv[4], NULL, 10) : 256;
+        guint updates = argc > 5 ? strtoul (argv[5], NULL, 10) : 10;
+        return run_serve (argv[2], argv[3], MAX (size, 1) * 1024 * 1024, updates);
+    }
+
+    guint pages = argc > 4 ? strtoul (argv[4], NULL, 10) : 4096;
+    guint hot = argc > 5 ? strtoul (argv[5], NULL, 10) : 1;
+    guint seconds = argc > 6 ? strtoul (argv[6], NULL, 10) : 10;
+    return run_clone (argv[2], argv[3], pages, CLAMP (hot, 1, 100), seconds);
+}
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+#define BLOCK_SIZE (64 * 1024)
+
+
+static int
+run_serve (const char *address, const char *port, gulong size, guint percent)
+{
+    char *mem = g_malloc0 (size);
+    KiroServer *server = kiro_server_new ();
+    if (0 > kiro_server_start (server, address, port, mem, size)) {
+        kiro_server_free (server);
+        g_free (mem);
+        return -1;
+    }
+
+    // Every round, the given share of the blocks is overwritten with the
+    // number of the round
+    gulong blocks = size / BLOCK_SIZE;
+    gulong changed = MAX (blocks * percent / 100, 1);
+
+    for (uint64_t round = 1; ; round++) {
+        for (gulong i = 0; i < changed; i++) {
+            gulong block = g_random_int_range (0, blocks);
+            uint64_t *data = (uint64_t *)(mem + block * BLOCK_SIZE);
+            for (gulong w = 0; w < BLOCK_SIZE / sizeof (uint64_t); w++)
+                data[w] = round;
+            kiro_server_mark_dirty (server, block * BLOCK_SIZE, BLOCK_SIZE);
+        }
+        g_usleep (G_USEC_PER_SEC / 10);
+    }
+
+    kiro_server_free (server);
+    g_free (mem);
+    return 0;
+}
+
+
+/*
+ * Counts the blocks of a delta synced copy that are behind the mirror after a
+ * full sync. The server may have written a block once more in between, but a
+ * block the delta sync missed is older than that.
+ */
+static gulong
+count_stale (const char *copy, const char *mem, gulong size)
+{
+    gulong stale = 0;
+
+    for (gulong offset = 0; offset + BLOCK_SIZE <= size; offset += BLOCK_SIZE) {
+        uint64_t seen = *(uint64_t *)(copy + offset);
+        uint64_t current = *(uint64_t *)(mem + offset);
+        stale += (current > seen + 1);
+    }
+    return stale;
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint rounds)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port)) {
+        kiro_client_free (client);
+        return -1;
+    }
+
+    gulong size = kiro_client_get_memory_size (client);
+    char *copy = g_malloc (size);
+    gulong stale = 0;
+    int rv = 0;
+
+    for (guint round = 0; round < rounds || rounds == 0; round++) {
+        GTimer *timer = g_timer_new ();
+        rv = kiro_client_sync (client);
+        double full = g_timer_elapsed (timer, NULL);
+
+        // Let the server change some blocks, so the delta sync has something
+        // to do
+        g_usleep (G_USEC_PER_SEC / 10);
+
+        g_timer_start (timer);
+        rv |= kiro_client_sync_delta (client);
+        double delta = g_timer_elapsed (timer, NULL);
+        g_timer_destroy (timer);
+
+        if (rv < 0) {
+            printf ("Sync failed\n");
+            break;
+        }
+
+        // Compare what the delta sync fetched with the whole memory
+        memcpy (copy, kiro_client_get_memory (client), size);
+        if (0 > (rv = kiro_client_sync (client))) {
+            printf ("Sync failed\n");
+            break;
+        }
+        gulong missed = count_stale (copy, kiro_client_get_memory (client), size);
+        stale += missed;
+
+        printf ("Full sync: %8.1fus (%7.1f MByte)  Delta sync: %8.1fus  Missed blocks: %lu\n", full * 1e6,
+                size / (1024. * 1024.), delta * 1e6, missed);
+    }
+
+    g_free (copy);
+    kiro_client_free (client);
+
+    if (rv < 0 || stale) {
+        printf ("FAILED: %s\n", (rv < 0) ? "Sync failed" : "Delta syncs missed changed blocks");
+        return 1;
+    }
+
+    printf ("PASSED: Delta syncs kept the mirror up to date\n");
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-delta serve <address> <port> [<size in MByte> [<changed blocks in %%>]]\n");
+        printf ("       kiro-test-delta clone <address> <port> [<rounds, 0 for no limit>]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve")) {
+        gulong size = argc > 4 ? strtoul (argv[4], NULL, 10) : 256;
+        guint percent = argc > 5 ? strtoul (argv[5], NULL, 10) : 2;
+        return run_serve (argv[2], argv[3], MAX (size, 1) * 1024 * 1024, MIN (percent, 100));
+    }
+
+    guint rounds = argc > 4 ? strtoul (argv[4], NULL, 10) : 20;
+    return run_clone (argv[2], argv[3], rounds);
+}
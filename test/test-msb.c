@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-msb.h"
+
+#define NUM_CHANNELS    40
+#define DEPTH           4
+
+
+struct stats {
+    KiroMsb     *msb;
+    guint       updates[NUM_CHANNELS];
+    guint       corrupt;
+};
+
+
+static KiroContinueFlag
+update_callback (guint channel, struct stats *stats)
+{
+    // Every element of a channel is filled with the index of the channel
+    guint32 *element = (guint32 *)kiro_msb_get_data (stats->msb, channel);
+    if (!element || *element != channel)
+        stats->corrupt++;
+
+    stats->updates[channel]++;
+    return KIRO_CALLBACK_CONTINUE;
+}
+
+
+static int
+run_serve (const char *address, const char *port, gulong interval_us)
+{
+    KiroMsb *msb = kiro_msb_new ();
+
+    // Give each channel a different element size, like different telemetry
+    // streams would have
+    for (guint i = 0; i < NUM_CHANNELS; i++) {
+        gchar *name = g_strdup_printf ("channel-%02u", i);
+        kiro_msb_add_channel (msb, name, 64 * (i + 1), DEPTH);
+        g_free (name);
+    }
+
+    if (!kiro_msb_serve (msb, address, port)) {
+        kiro_msb_free (msb);
+        return -1;
+    }
+
+    guint32 *element = g_malloc0 (64 * NUM_CHANNELS);
+
+    for (guint64 i = 0; ; i++) {
+        guint channel = i % NUM_CHANNELS;
+        *element = channel;
+        kiro_msb_push (msb, channel, element);
+        g_usleep (interval_us);
+    }
+
+    g_free (element);
+    kiro_msb_free (msb);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port, const gchar * const *channels)
+{
+    struct stats stats;
+    memset (&stats, 0, sizeof (stats));
+    stats.msb = kiro_msb_new ();
+
+    if (!kiro_msb_clone (stats.msb, address, port, channels)) {
+        kiro_msb_free (stats.msb);
+        return -1;
+    }
+
+    printf ("Remote KiroMsb has %u channels\n", kiro_msb_get_channel_count (stats.msb));
+    kiro_msb_add_callback (stats.msb, (KiroMsbCallbackFunc)update_callback, &stats);
+
+    while (1) {
+        guint before = 0;
+        for (guint i = 0; i < NUM_CHANNELS; i++)
+            before += stats.updates[i];
+
+        g_usleep (G_USEC_PER_SEC);
+
+        guint after = 0, active = 0;
+        for (guint i = 0; i < NUM_CHANNELS; i++) {
+            after += stats.updates[i];
+            active += (stats.updates[i] > 0);
+        }
+
+        printf ("Updates: %7u/s  Channels seen: %2u  Corrupt (total): %u\n", after - before, active, stats.corrupt);
+    }
+
+    kiro_msb_free (stats.msb);
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-msb serve <address> <port> [<push interval in us>]\n");
+        printf ("       kiro-test-msb clone <address> <port> [<channel> ...]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve"))
+        return run_serve (argv[2], argv[3], argc > 4 ? strtoul (argv[4], NULL, 10) : 1000);
+
+    // Subscribe to all channels unless some are named
+    return run_clone (argv[2], argv[3], argc > 4 ? (const gchar * const *)&argv[4] : NULL);
+}
@@ -0,0 +1,172 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+#define MAX_CLIENTS 64
+
+
+// Every subscriber runs in its own process and counts into its own slot of
+// a shared mapping
+struct stats {
+    guint64     pushes;
+    gint64      latency_sum;    // in microseconds
+    gint64      latency_max;    // in microseconds
+};
+
+
+static int
+run_serve (const char *address, const char *port, gulong size, gulong interval_us)
+{
+    char *mem = g_malloc0 (size);
+    KiroServer *server = kiro_server_new ();
+    if (0 > kiro_server_start (server, address, port, mem, size)) {
+        kiro_server_free (server);
+        g_free (mem);
+        return -1;
+    }
+
+    while (1) {
+        guint64 publishes = 0, reached = 0;
+        double publish_time = 0;
+        gint64 start = g_get_monotonic_time ();
+
+        while (g_get_monotonic_time () - start < G_USEC_PER_SEC) {
+            // The clients measure the latency against the time of the push.
+            // This is only meaningful if both sides share a clock (e.g. when
+            // running on the same host).
+            *(gint64 *)mem = g_get_real_time ();
+
+            GTimer *timer = g_timer_new ();
+            int rv = kiro_server_publish (server, 0, size);
+            publish_time += g_timer_elapsed (timer, NULL);
+            g_timer_destroy (timer);
+
+            publishes++;
+            reached += MAX (rv, 0);
+            g_usleep (interval_us);
+        }
+
+        printf ("Published: %6lu/s  Clients: %5.1f  Avg. time per publish: %8.1fus\n", publishes,
+                (double)reached / publishes, publish_time * 1e6 / publishes);
+    }
+
+    kiro_server_free (server);
+    g_free (mem);
+    return 0;
+}
+
+
+static void
+run_subscriber (const char *address, const char *port, struct stats *stats)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port) || 0 > kiro_client_subscribe (client)) {
+        printf ("Failed to connect and subscribe a client\n");
+        kiro_client_free (client);
+        return;
+    }
+
+    uint64_t known = kiro_client_get_push_sequence (client);
+    while (1) {
+        int rv = kiro_client_wait_push (client, known, 1000);
+        if (rv < 0)
+            break;
+        if (rv == 0)
+            continue;
+
+        gint64 latency = g_get_real_time () - *(gint64 *)kiro_client_get_memory (client);
+        uint64_t sequence = kiro_client_get_push_sequence (client);
+
+        __atomic_add_fetch (&stats->pushes, sequence - known, __ATOMIC_RELAXED);
+        __atomic_add_fetch (&stats->latency_sum, latency, __ATOMIC_RELAXED);
+        gint64 max = __atomic_load_n (&stats->latency_max, __ATOMIC_RELAXED);
+        while (latency > max && !__atomic_compare_exchange_n (&stats->latency_max, &max, latency, FALSE,
+                                                              __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        known = sequence;
+    }
+
+    kiro_client_free (client);
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint max_clients)
+{
+    struct stats *stats = mmap (NULL, MAX_CLIENTS * sizeof (struct stats), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        printf ("Failed to map shared memory for the statistics\n");
+        return -1;
+    }
+    memset (stats, 0, MAX_CLIENTS * sizeof (struct stats));
+
+    pid_t pids[MAX_CLIENTS];
+    guint running = 0;
+    guint64 pushes = 0;
+    gint64 latency_sum = 0;
+
+    // Double the number of subscribers every five seconds. The time per
+    // publish on the serving side shows how the fan-out scales.
+    for (guint clients = 1; clients <= max_clients; clients *= 2) {
+        for (; running < clients; running++) {
+            pids[running] = fork ();
+            if (pids[running] == 0) {
+                run_subscriber (address, port, &stats[running]);
+                _exit (0);
+            }
+        }
+
+        for (guint s = 0; s < 5; s++) {
+            g_usleep (G_USEC_PER_SEC);
+
+            guint64 total_pushes = 0;
+            gint64 total_latency = 0, latency_max = 0;
+            for (guint i = 0; i < running; i++) {
+                total_pushes += __atomic_load_n (&stats[i].pushes, __ATOMIC_RELAXED);
+                total_latency += __atomic_load_n (&stats[i].latency_sum, __ATOMIC_RELAXED);
+                latency_max = MAX (latency_max, __atomic_exchange_n (&stats[i].latency_max, 0, __ATOMIC_RELAXED));
+            }
+
+            guint64 delta = total_pushes - pushes;
+            printf ("Clients: %2u  Pushes: %8lu/s  Avg. latency: %8.1fus  Max. latency: %8lius\n", clients,
+                    delta, delta ? (double)(total_latency - latency_sum) / delta : 0., latency_max);
+            pushes = total_pushes;
+            latency_sum = total_latency;
+        }
+    }
+
+    for (guint i = 0; i < running; i++) {
+        kill (pids[i], SIGTERM);
+        waitpid (pids[i], NULL, 0);
+    }
+
+    munmap (stats, MAX_CLIENTS * sizeof (struct stats));
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-push-fanout serve <address> <port> [<size> [<publish interval in us>]]\n");
+        printf ("       kiro-test-push-fanout clone <address> <port> [<max. clients>]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve")) {
+        gulong size = argc > 4 ? strtoul (argv[4], NULL, 10) : 4096;
+        gulong interval = argc > 5 ? strtoul (argv[5], NULL, 10) : 1000;
+        return run_serve (argv[2], argv[3], MAX (size, sizeof (gint64)), interval);
+    }
+
+    guint max_clients = argc > 4 ? strtoul (argv[4], NULL, 10) : MAX_CLIENTS;
+    return run_clone (argv[2], argv[3], CLAMP (max_clients, 1, MAX_CLIENTS));
+}
@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+
+struct region {
+    const char  *name;
+    size_t      size;
+    uint64_t    *mem;
+};
+
+static struct region regions[] = {
+    { "frame", 4 * 1024 * 1024, NULL },
+    { "metadata", 4096, NULL },
+    { "calibration", 64 * 1024, NULL },
+};
+
+
+static void
+fill (struct region *region, uint64_t round)
+{
+    // Every word of a region carries the round it was written in
+    for (size_t i = 0; i < region->size / sizeof (uint64_t); i++)
+        region->mem[i] = round;
+}
+
+
+static int
+run_serve (const char *address, const char *port)
+{
+    KiroServer *server = kiro_server_new ();
+    uint64_t main_mem = 0;
+
+    if (0 > kiro_server_start (server, address, port, &main_mem, sizeof (main_mem))) {
+        kiro_server_free (server);
+        return -1;
+    }
+
+    gint ids[G_N_ELEMENTS (regions)];
+    for (guint i = 0; i < G_N_ELEMENTS (regions); i++) {
+        regions[i].mem = g_malloc (regions[i].size);
+        fill (&regions[i], 0);
+        ids[i] = kiro_server_add_region (server, regions[i].name, regions[i].mem, regions[i].size);
+        printf ("Providing region '%s' with ID %i\n", regions[i].name, ids[i]);
+    }
+
+    // Update all regions once per second. Every fifth round, the last region
+    // is removed and added again, so the clients have to look it up anew.
+    for (uint64_t round = 1; ; round++) {
+        g_usleep (G_USEC_PER_SEC);
+        for (guint i = 0; i < G_N_ELEMENTS (regions); i++)
+            fill (&regions[i], round);
+
+        if (round % 5 == 0) {
+            guint last = G_N_ELEMENTS (regions) - 1;
+            kiro_server_remove_region (server, ids[last]);
+            ids[last] = kiro_server_add_region (server, regions[last].name, regions[last].mem, regions[last].size);
+            printf ("Region '%s' now has ID %i\n", regions[last].name, ids[last]);
+        }
+    }
+
+    kiro_server_free (server);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint rounds)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port)) {
+        kiro_client_free (client);
+        return -1;
+    }
+
+    // A region may briefly be unavailable while the server adds it again,
+    // but every one must have been synced at some point
+    guint synced[G_N_ELEMENTS (regions)] = { 0 };
+    guint failures = 0;
+
+    for (guint r = 0; r < rounds || rounds == 0; r++) {
+        for (guint i = 0; i < G_N_ELEMENTS (regions); i++) {
+            gint id = kiro_client_lookup_region (client, regions[i].name);
+            if (id < 0) {
+                printf ("%-12s: not available\n", regions[i].name);
+                continue;
+            }
+
+            GTimer *timer = g_timer_new ();
+            if (0 > kiro_client_sync_region (client, id)) {
+                printf ("%-12s: sync failed\n", regions[i].name);
+                g_timer_destroy (timer);
+                failures++;
+                continue;
+            }
+            double elapsed = g_timer_elapsed (timer, NULL);
+            g_timer_destroy (timer);
+
+            // A region may be read while the server is filling it, so the
+            // words may be from two consecutive rounds
+            size_t size = kiro_client_get_region_size (client, id);
+            uint64_t *mem = (uint64_t *)kiro_client_get_region_memory (client, id);
+            guint bad = 0;
+            for (size_t w = 0; w < size / sizeof (uint64_t); w++)
+                bad += ((mem[w] > mem[0]) ? mem[w] - mem[0] : mem[0] - mem[w]) > 1;
+
+            printf ("%-12s: ID %2i  %8zu bytes  round %4" G_GUINT64_FORMAT "  %8.1fus  %s\n", regions[i].name, id, size,
+                    mem[0], elapsed * 1e6, bad ? "CORRUPT" : "ok");
+            failures += (bad != 0);
+            synced[i]++;
+        }
+        printf ("\n");
+        g_usleep (G_USEC_PER_SEC);
+    }
+
+    kiro_client_free (client);
+
+    for (guint i = 0; i < G_N_ELEMENTS (regions); i++) {
+        if (!synced[i]) {
+            printf ("FAILED: Region '%s' was never synced\n", regions[i].name);
+            return 1;
+        }
+    }
+
+    if (failures) {
+        printf ("FAILED: %u region syncs failed or were corrupt\n", failures);
+        return 1;
+    }
+
+    printf ("PASSED: All regions synced and intact\n");
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-regions serve <address> <port>\n");
+        printf ("       kiro-test-regions clone <address> <port> [<rounds, 0 for no limit>]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve"))
+        return run_serve (argv[2], argv[3]);
+
+    guint rounds = argc > 4 ? strtoul (argv[4], NULL, 10) : 10;
+    return run_clone (argv[2], argv[3], rounds);
+}
@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+
+static int
+run_serve (const char *address, const char *port, gulong side)
+{
+    // Every pixel of the frame holds its own coordinates
+    gulong size = side * side * sizeof (uint32_t);
+    uint32_t *frame = g_malloc (size);
+    for (gulong y = 0; y < side; y++)
+        for (gulong x = 0; x < side; x++)
+            frame[y * side + x] = (y << 16) | x;
+
+    KiroServer *server = kiro_server_new ();
+    if (0 > kiro_server_start (server, address, port, frame, size)) {
+        kiro_server_free (server);
+        g_free (frame);
+        return -1;
+    }
+
+    while (1)
+        g_usleep (G_USEC_PER_SEC);
+
+    kiro_server_free (server);
+    g_free (frame);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port, gulong side, gulong roi, guint rounds)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port)) {
+        kiro_client_free (client);
+        return -1;
+    }
+
+    if (kiro_client_get_memory_size (client) < side * side * sizeof (uint32_t)) {
+        printf ("The served frame is smaller than %lux%lu pixels\n", side, side);
+        kiro_client_free (client);
+        return -1;
+    }
+
+    gulong stride = side * sizeof (uint32_t);
+    roi = MIN (roi, side);
+    uint32_t *dst = g_malloc (roi * roi * sizeof (uint32_t));
+
+    gulong wrong = 0;
+    for (guint round = 0; round < rounds || rounds == 0; round++) {
+        gulong x = g_random_int_range (0, side - roi + 1);
+        gulong y = g_random_int_range (0, side - roi + 1);
+
+        GTimer *timer = g_timer_new ();
+        if (0 > kiro_client_sync (client))
+            goto fail;
+        double full = g_timer_elapsed (timer, NULL);
+
+        // What the ROI costs without batching: one sync per row
+        g_timer_start (timer);
+        for (gulong r = 0; r < roi; r++) {
+            gulong offset = (y + r) * stride + x * sizeof (uint32_t);
+            if (0 > kiro_client_sync_partial (client, offset, roi * sizeof (uint32_t), offset))
+                goto fail;
+        }
+        double rows = g_timer_elapsed (timer, NULL);
+
+        g_timer_start (timer);
+        if (0 > kiro_client_sync_roi (client, x, y, roi, roi, stride, sizeof (uint32_t), dst))
+            goto fail;
+        double batched = g_timer_elapsed (timer, NULL);
+        g_timer_destroy (timer);
+
+        gulong bad = 0;
+        for (gulong r = 0; r < roi; r++)
+            for (gulong c = 0; c < roi; c++)
+                bad += dst[r * roi + c] != (((y + r) << 16) | (x + c));
+
+        printf ("Full frame: %8.1fus  Row by row: %8.1fus  ROI: %8.1fus  Wrong pixels: %lu\n",
+                full * 1e6, rows * 1e6, batched * 1e6, bad);
+        wrong += bad;
+        g_usleep (G_USEC_PER_SEC / 2);
+    }
+
+    g_free (dst);
+    kiro_client_free (client);
+
+    if (wrong) {
+        printf ("FAILED: kiro_client_sync_roi returned %lu wrong pixels\n", wrong);
+        return 1;
+    }
+
+    printf ("PASSED: All ROIs were read correctly\n");
+    return 0;
+
+fail:
+    printf ("Sync failed\n");
+    g_free (dst);
+    kiro_client_free (client);
+    return -1;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-roi serve <address> <port> [<frame width>]\n");
+        printf ("       kiro-test-roi clone <address> <port> [<frame width> [<ROI width> [<rounds, 0 for no limit>]]]\n");
+        return -1;
+    }
+
+    gulong side = argc > 4 ? strtoul (argv[4], NULL, 10) : 4096;
+    side = CLAMP (side, 1, 65536);
+
+    if (!strcmp (argv[1], "serve"))
+        return run_serve (argv[2], argv[3], side);
+
+    gulong roi = argc > 5 ? strtoul (argv[5], NULL, 10) : 256;
+    guint rounds = argc > 6 ? strtoul (argv[6], NULL, 10) : 10;
+    return run_clone (argv[2], argv[3], side, MAX (roi, 1), rounds);
+}
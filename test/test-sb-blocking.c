@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "kiro-sb.h"
+
+#define NUM_WAITERS     32
+#define IDLE_SECONDS    5
+#define MAX_CPU_LOAD    0.05    // Fraction of one core
+
+
+struct waiter {
+    KiroSb      *sb;
+    guint       wakeups;
+    gboolean    stop;
+};
+
+
+static gpointer
+wait_func (gpointer data)
+{
+    struct waiter *w = (struct waiter *)data;
+
+    while (!g_atomic_int_get (&w->stop)) {
+        if (kiro_sb_get_data_blocking_timeout (w->sb, 1000))
+            g_atomic_int_inc (&w->wakeups);
+    }
+
+    return NULL;
+}
+
+
+static double
+cpu_seconds (void)
+{
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 3) {
+        printf ("Not enough aruments. Usage: kiro-test-sb-blocking <address> <port>\n");
+        return -1;
+    }
+
+    KiroSb *sb = kiro_sb_new ();
+    if (!kiro_sb_clone (sb, argv[1], argv[2])) {
+        kiro_sb_free (sb);
+        return -1;
+    }
+
+    struct waiter waiters[NUM_WAITERS];
+    GThread *threads[NUM_WAITERS];
+
+    for (int i = 0; i < NUM_WAITERS; i++) {
+        waiters[i].sb = sb;
+        waiters[i].wakeups = 0;
+        waiters[i].stop = FALSE;
+        threads[i] = g_thread_new ("waiter", wait_func, &waiters[i]);
+    }
+
+    // Between two elements all waiting threads have to sleep, so the CPU
+    // usage of this process should stay close to zero as long as the server
+    // pushes rarely (e.g. kiro-test-sb serve with the default interval).
+    printf ("%i threads waiting for new elements\n", NUM_WAITERS);
+
+    double start = cpu_seconds ();
+    for (int s = 0; s < IDLE_SECONDS; s++) {
+        guint wakeups = 0;
+        for (int i = 0; i < NUM_WAITERS; i++)
+            wakeups += g_atomic_int_get (&waiters[i].wakeups);
+
+        double cpu = cpu_seconds ();
+        g_usleep (G_USEC_PER_SEC);
+
+        guint now = 0;
+        for (int i = 0; i < NUM_WAITERS; i++)
+            now += g_atomic_int_get (&waiters[i].wakeups);
+
+        printf ("Wakeups: %6u/s  CPU: %5.1f%%\n", now - wakeups, (cpu_seconds () - cpu) * 100);
+    }
+
+    double load = (cpu_seconds () - start) / IDLE_SECONDS;
+
+    for (int i = 0; i < NUM_WAITERS; i++)
+        g_atomic_int_set (&waiters[i].stop, TRUE);
+
+    for (int i = 0; i < NUM_WAITERS; i++)
+        g_thread_join (threads[i]);
+
+    kiro_sb_free (sb);
+
+    if (load > MAX_CPU_LOAD) {
+        printf ("FAILED: Average CPU load of %.1f%% while waiting\n", load * 100);
+        return -1;
+    }
+
+    printf ("Average CPU load while waiting: %.1f%%\n", load * 100);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-sb.h"
+
+#define ELEMENT_SIZE    64
+#define DEPTH           4096
+#define BURST           1000
+#define BURST_PAUSE_US  10000
+#define SECONDS_PER_RUN 5
+
+
+struct window {
+    guint       count;
+    guint       delay_us;
+};
+
+// Coalescing windows the serving side cycles through. The first one disables
+// coalescing and serves as the reference.
+static const struct window windows[] = {
+    { 0, 0 }, { 16, 0 }, { 64, 100 }, { 256, 1000 }, { 1024, 5000 }, { 0, 1000 },
+};
+
+
+struct sample {
+    uint64_t    sequence;
+    gint64      pushed;         // Wall clock time of the push in microseconds
+};
+
+
+struct stats {
+    KiroSb      *sb;
+    guint64     callbacks;
+    guint64     elements;
+    guint64     dropped;
+    gint64      latency_sum;    // in microseconds
+    gint64      latency_max;    // in microseconds
+};
+
+
+static KiroContinueFlag
+stream_callback (uint64_t first, guint delivered, uint64_t dropped, struct stats *stats)
+{
+    // Latencies are only meaningful if both sides share a clock (e.g. when
+    // running on the same host)
+    gint64 now = g_get_real_time ();
+
+    for (uint64_t seq = first; seq < first + delivered; seq++) {
+        struct sample *sample = (struct sample *)kiro_sb_get_element (stats->sb, seq);
+        if (!sample)
+            continue;
+
+        gint64 latency = now - sample->pushed;
+        stats->latency_sum += latency;
+        stats->latency_max = MAX (stats->latency_max, latency);
+    }
+
+    stats->callbacks++;
+    stats->elements += delivered;
+    stats->dropped += dropped;
+    return KIRO_CALLBACK_CONTINUE;
+}
+
+
+static int
+run_serve (const char *address, const char *port)
+{
+    KiroSb *sb = kiro_sb_new ();
+    kiro_sb_set_depth (sb, DEPTH);
+    if (!kiro_sb_serve (sb, ELEMENT_SIZE, address, port)) {
+        kiro_sb_free (sb);
+        return -1;
+    }
+
+    char element[ELEMENT_SIZE];
+    memset (element, 0, ELEMENT_SIZE);
+    struct sample *sample = (struct sample *)element;
+    uint64_t sequence = 0;
+
+    for (guint w = 0; ; w = (w + 1) % G_N_ELEMENTS (windows)) {
+        kiro_sb_set_coalescing (sb, windows[w].count, windows[w].delay_us);
+        printf ("Window: max. %u elements, max. %uus\n", windows[w].count, windows[w].delay_us);
+
+        gint64 end = g_get_monotonic_time () + SECONDS_PER_RUN * G_USEC_PER_SEC;
+        while (g_get_monotonic_time () < end) {
+            // Bursts of tiny samples, pushed back to back
+            for (guint i = 0; i < BURST; i++) {
+                sample->sequence = sequence++;
+                sample->pushed = g_get_real_time ();
+                kiro_sb_push (sb, element);
+            }
+            g_usleep (BURST_PAUSE_US);
+        }
+    }
+
+    kiro_sb_free (sb);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port)
+{
+    struct stats stats;
+    memset (&stats, 0, sizeof (stats));
+    stats.sb = kiro_sb_new ();
+    kiro_sb_set_lossless (stats.sb, TRUE);
+    if (!kiro_sb_clone (stats.sb, address, port)) {
+        kiro_sb_free (stats.sb);
+        return -1;
+    }
+
+    kiro_sb_add_stream_callback (stats.sb, (KiroSbStreamCallbackFunc)stream_callback, &stats);
+
+    printf ("Elements/s  Callbacks/s  Elements/callback  Dropped/s  Avg. latency  Max. latency\n");
+    while (1) {
+        struct stats before = stats;
+        stats.latency_max = 0;
+        g_usleep (G_USEC_PER_SEC);
+
+        guint64 elements = stats.elements - before.elements;
+        guint64 callbacks = stats.callbacks - before.callbacks;
+        printf ("%10lu  %11lu  %17.1f  %9lu  %10.1fus  %10lius\n", elements, callbacks,
+                callbacks ? (double)elements / callbacks : 0., stats.dropped - before.dropped,
+                elements ? (double)(stats.latency_sum - before.latency_sum) / elements : 0.,
+                stats.latency_max);
+    }
+
+    kiro_sb_free (stats.sb);
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-sb-coalesce serve <address> <port>\n");
+        printf ("       kiro-test-sb-coalesce clone <address> <port>\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve"))
+        return run_serve (argv[2], argv[3]);
+
+    return run_clone (argv[2], argv[3]);
+}
@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-sb.h"
+
+#define PUSH_RATE       200     // Elements per second pushed by the serving side
+#define SLOW_CALLBACK   20000   // Time in microseconds a slow element callback takes
+
+
+struct phase {
+    const char  *name;
+    guint       workers;        // 0 runs the element callbacks inline
+    gulong      callback_us;    // Time each element callback takes
+    volatile gint syncs;
+    volatile gint handled;
+};
+
+
+static KiroContinueFlag
+sync_callback (struct phase *phase)
+{
+    g_atomic_int_inc (&phase->syncs);
+    return KIRO_CALLBACK_CONTINUE;
+}
+
+
+static KiroContinueFlag
+element_callback (KiroSbElement *element __attribute__ ((unused)), struct phase *phase)
+{
+    // Stands in for a consumer that does real work, e.g. writing to disk
+    if (phase->callback_us)
+        g_usleep (phase->callback_us);
+    g_atomic_int_inc (&phase->handled);
+    return KIRO_CALLBACK_CONTINUE;
+}
+
+
+static int
+run_serve (const char *address, const char *port)
+{
+    KiroSb *sb = kiro_sb_new ();
+    if (!kiro_sb_serve (sb, 4096, address, port)) {
+        kiro_sb_free (sb);
+        return -1;
+    }
+
+    char element[4096] = { 0 };
+    gint64 start = g_get_monotonic_time ();
+    for (guint64 pushed = 0; ; pushed++) {
+        gint64 due = start + (gint64)(pushed * (G_USEC_PER_SEC / PUSH_RATE));
+        gint64 now = g_get_monotonic_time ();
+        if (now < due)
+            g_usleep (due - now);
+        *(uint64_t *)element = pushed;
+        kiro_sb_push (sb, element);
+    }
+
+    kiro_sb_free (sb);
+    return 0;
+}
+
+
+/*
+ * Clones the remote SB for the given number of seconds and returns the sync
+ * cadence (in syncs per second) that was reached.
+ */
+static double
+measure (const char *address, const char *port, guint seconds, struct phase *phase)
+{
+    KiroSb *sb = kiro_sb_new ();
+    if (phase->workers)
+        kiro_sb_set_dispatch (sb, phase->workers, 4, KIRO_SB_DISPATCH_DROP_OLDEST);
+
+    if (!kiro_sb_clone (sb, address, port)) {
+        kiro_sb_free (sb);
+        return -1;
+    }
+
+    kiro_sb_add_sync_callback (sb, (KiroSbSyncCallbackFunc)sync_callback, phase);
+    kiro_sb_add_element_callback (sb, (KiroSbElementCallbackFunc)element_callback, phase);
+
+    // Let the clone settle before counting
+    g_usleep (G_USEC_PER_SEC / 2);
+    g_atomic_int_set (&phase->syncs, 0);
+    g_atomic_int_set (&phase->handled, 0);
+    g_usleep (seconds * G_USEC_PER_SEC);
+
+    double cadence = (double)g_atomic_int_get (&phase->syncs) / seconds;
+    double handled = (double)g_atomic_int_get (&phase->handled) / seconds;
+    guint64 dropped = kiro_sb_get_dispatch_dropped (sb);
+    kiro_sb_free (sb);
+
+    printf ("%-30s %8.1f syncs/s %8.1f handled/s %8lu dropped\n", phase->name, cadence, handled, (unsigned long)dropped);
+    return cadence;
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint seconds)
+{
+    struct phase cheap = { "2 workers, cheap callback", 2, 0, 0, 0 };
+    struct phase slow = { "2 workers, slow callback", 2, SLOW_CALLBACK, 0, 0 };
+    struct phase inline_slow = { "inline, slow callback", 0, SLOW_CALLBACK, 0, 0 };
+
+    double reference = measure (address, port, seconds, &cheap);
+    double dispatched = measure (address, port, seconds, &slow);
+    double blocked = measure (address, port, seconds, &inline_slow);
+
+    if (reference <= 0 || dispatched < 0 || blocked < 0) {
+        printf ("FAILED: Could not clone the remote SB\n");
+        return 1;
+    }
+
+    // With a worker pool, the cost of the element callbacks must not slow
+    // down syncing. Inline, it caps the cadence at one sync per callback.
+    if (dispatched < 0.8 * reference) {
+        printf ("FAILED: Sync cadence dropped from %.1f/s to %.1f/s with slow callbacks\n", reference, dispatched);
+        return 1;
+    }
+
+    printf ("PASSED: Sync cadence with slow callbacks is %.0f%% of the cheap one (%.0f%% inline)\n",
+            100 * dispatched / reference, 100 * blocked / reference);
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-sb-dispatch serve <address> <port>\n");
+        printf ("       kiro-test-sb-dispatch clone <address> <port> [<seconds per phase>]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve"))
+        return run_serve (argv[2], argv[3]);
+
+    guint seconds = argc > 4 ? strtoul (argv[4], NULL, 10) : 3;
+    return run_clone (argv[2], argv[3], MAX (seconds, 1));
+}
@@ -0,0 +1,114 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-sb.h"
+
+
+struct stats {
+    KiroSb      *sb;
+    guint64     delivered;
+    guint64     dropped;
+    guint64     corrupt;
+};
+
+
+static KiroContinueFlag
+stream_callback (uint64_t first, guint delivered, uint64_t dropped, struct stats *stats)
+{
+    // The serving side tags every element with its sequence number
+    for (uint64_t seq = first; seq < first + delivered; seq++) {
+        uint64_t *element = (uint64_t *)kiro_sb_get_element (stats->sb, seq);
+        if (!element || *element != seq)
+            stats->corrupt++;
+    }
+
+    stats->delivered += delivered;
+    stats->dropped += dropped;
+    return KIRO_CALLBACK_CONTINUE;
+}
+
+
+static int
+run_serve (const char *address, const char *port, gulong size, guint depth)
+{
+    KiroSb *sb = kiro_sb_new ();
+    kiro_sb_set_depth (sb, depth);
+    if (!kiro_sb_serve (sb, size, address, port)) {
+        kiro_sb_free (sb);
+        return -1;
+    }
+
+    char *element = g_malloc0 (size);
+
+    // Increase the push rate by 25% every two seconds. The rate at which the
+    // clone starts to report dropped elements is the sustainable lossless rate.
+    double rate = 1000;
+    while (1) {
+        printf ("Pushing %.0f elements/s (%.2f MByte/s)\n", rate, (rate * size) / (1024 * 1024));
+        gint64 start = g_get_monotonic_time ();
+        guint64 pushed = 0;
+
+        while (g_get_monotonic_time () - start < 2 * G_USEC_PER_SEC) {
+            // Don't sleep, since the interval can be well below the timer
+            // resolution
+            gint64 due = start + (gint64)(pushed * (G_USEC_PER_SEC / rate));
+            if (g_get_monotonic_time () < due)
+                continue;
+
+            *(uint64_t *)element = kiro_sb_get_offset (sb);
+            kiro_sb_push (sb, element);
+            pushed++;
+        }
+        rate *= 1.25;
+    }
+
+    g_free (element);
+    kiro_sb_free (sb);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port)
+{
+    struct stats stats = { 0 };
+    stats.sb = kiro_sb_new ();
+    kiro_sb_set_lossless (stats.sb, TRUE);
+    if (!kiro_sb_clone (stats.sb, address, port)) {
+        kiro_sb_free (stats.sb);
+        return -1;
+    }
+
+    kiro_sb_add_stream_callback (stats.sb, (KiroSbStreamCallbackFunc)stream_callback, &stats);
+
+    while (1) {
+        guint64 delivered = stats.delivered;
+        guint64 dropped = stats.dropped;
+        g_usleep (G_USEC_PER_SEC);
+        printf ("Delivered: %8lu/s  Dropped: %8lu/s  Corrupt (total): %lu\n",
+                stats.delivered - delivered, stats.dropped - dropped, stats.corrupt);
+    }
+
+    kiro_sb_free (stats.sb);
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-sb-lossless serve <address> <port> [<element size> [<depth>]]\n");
+        printf ("       kiro-test-sb-lossless clone <address> <port>\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve")) {
+        gulong size = argc > 4 ? strtoul (argv[4], NULL, 10) : 4096;
+        guint depth = argc > 5 ? strtoul (argv[5], NULL, 10) : 1024;
+        return run_serve (argv[2], argv[3], MAX (size, sizeof (uint64_t)), depth);
+    }
+
+    return run_clone (argv[2], argv[3]);
+}
@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "kiro-sb.h"
+
+#define ELEMENT_SIZE 1024
+
+
+struct stats {
+    KiroSb      *sb;
+    guint       callbacks;
+    gint64      latency_sum;    // in microseconds
+};
+
+
+static KiroContinueFlag
+sync_callback (struct stats *stats)
+{
+    // The serving side puts the time of the push into the first bytes of the
+    // element. This is only meaningful if both sides share a clock (e.g. when
+    // running on the same host).
+    gint64 *pushed = (gint64 *)kiro_sb_get_data (stats->sb);
+    stats->latency_sum += g_get_real_time () - *pushed;
+    stats->callbacks++;
+    return KIRO_CALLBACK_CONTINUE;
+}
+
+
+static double
+cpu_seconds (void)
+{
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+
+static int
+run_serve (const char *address, const char *port, gulong interval_ms)
+{
+    KiroSb *sb = kiro_sb_new ();
+    if (!kiro_sb_serve (sb, ELEMENT_SIZE, address, port)) {
+        kiro_sb_free (sb);
+        return -1;
+    }
+
+    char element[ELEMENT_SIZE];
+    memset (element, 0, ELEMENT_SIZE);
+
+    while (1) {
+        *(gint64 *)element = g_get_real_time ();
+        kiro_sb_push (sb, element);
+        g_usleep (interval_ms * 1000);
+    }
+
+    kiro_sb_free (sb);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port)
+{
+    struct stats stats = { 0 };
+    stats.sb = kiro_sb_new ();
+    if (!kiro_sb_clone (stats.sb, address, port)) {
+        kiro_sb_free (stats.sb);
+        return -1;
+    }
+
+    kiro_sb_add_sync_callback (stats.sb, (KiroSbSyncCallbackFunc)sync_callback, &stats);
+
+    while (1) {
+        guint callbacks = stats.callbacks;
+        gint64 latency_sum = stats.latency_sum;
+        double cpu = cpu_seconds ();
+        g_usleep (1000 * 1000);
+
+        callbacks = stats.callbacks - callbacks;
+        latency_sum = stats.latency_sum - latency_sum;
+        printf ("Updates: %5u/s  Avg. push-to-callback latency: %8.1fus  CPU: %5.1f%%\n", callbacks,
+                callbacks ? (double)latency_sum / callbacks : 0., (cpu_seconds () - cpu) * 100);
+    }
+
+    kiro_sb_free (stats.sb);
+    return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-sb serve <address> <port> [<push interval in ms>]\n");
+        printf ("       kiro-test-sb clone <address> <port>\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve"))
+        return run_serve (argv[2], argv[3], argc > 4 ? strtoul (argv[4], NULL, 10) : 1000);
+
+    return run_clone (argv[2], argv[3]);
+}
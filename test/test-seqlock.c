@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+
+
+static int
+run_serve (const char *address, const char *port, gulong size)
+{
+    uint64_t *mem = g_malloc0 (size);
+    KiroServer *server = kiro_server_new ();
+    if (0 > kiro_server_start (server, address, port, mem, size)) {
+        kiro_server_free (server);
+        g_free (mem);
+        return -1;
+    }
+
+    // Overwrite the whole memory with the number of the round as fast as
+    // possible. A consistent snapshot holds the same number in every word.
+    guint64 writes = 0;
+    gint64 start = g_get_monotonic_time ();
+    for (uint64_t round = 1; ; round++) {
+        kiro_server_write_begin (server);
+        for (gulong w = 0; w < size / sizeof (uint64_t); w++)
+            mem[w] = round;
+        kiro_server_write_end (server);
+        writes++;
+
+        if (g_get_monotonic_time () - start >= G_USEC_PER_SEC) {
+            printf ("Writes: %8lu/s\n", writes);
+            writes = 0;
+            start = g_get_monotonic_time ();
+        }
+    }
+
+    kiro_server_free (server);
+    g_free (mem);
+    return 0;
+}
+
+
+static gboolean
+is_torn (KiroClient *client)
+{
+    uint64_t *mem = (uint64_t *)kiro_client_get_memory (client);
+    gulong words = kiro_client_get_memory_size (client) / sizeof (uint64_t);
+
+    for (gulong w = 1; w < words; w++) {
+        if (mem[w] != mem[0])
+            return TRUE;
+    }
+    return FALSE;
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint seconds)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port)) {
+        kiro_client_free (client);
+        return -1;
+    }
+
+    guint64 total = 0;
+    for (guint s = 0; s < seconds || seconds == 0; s++) {
+        guint64 plain = 0, plain_torn = 0;
+        guint64 consistent = 0, consistent_torn = 0, given_up = 0;
+        gint64 start = g_get_monotonic_time ();
+
+        // Plain syncs show how often the stress actually tears a snapshot
+        while (g_get_monotonic_time () - start < G_USEC_PER_SEC) {
+            if (0 > kiro_client_sync (client))
+                goto fail;
+            plain++;
+            plain_torn += is_torn (client);
+
+            int rv = kiro_client_sync_consistent (client);
+            if (rv < 0)
+                goto fail;
+            if (rv > 0) {
+                given_up++;
+                continue;
+            }
+            consistent++;
+            consistent_torn += is_torn (client);
+        }
+
+        printf ("Plain: %7" G_GUINT64_FORMAT "/s (%7" G_GUINT64_FORMAT " torn)  Consistent: %7" G_GUINT64_FORMAT "/s (%"
+                G_GUINT64_FORMAT " torn, %" G_GUINT64_FORMAT " given up)\n",
+                plain, plain_torn, consistent, consistent_torn, given_up);
+        if (consistent_torn) {
+            printf ("FAILED: kiro_client_sync_consistent returned a torn snapshot\n");
+            kiro_client_free (client);
+            return 1;
+        }
+        total += consistent;
+    }
+
+    kiro_client_free (client);
+    if (total == 0) {
+        printf ("FAILED: kiro_client_sync_consistent never got a consistent snapshot\n");
+        return 1;
+    }
+
+    printf ("PASSED: %" G_GUINT64_FORMAT " consistent snapshots, none of them torn\n", total);
+    return 0;
+
+fail:
+    printf ("Sync failed\n");
+    kiro_client_free (client);
+    return -1;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-seqlock serve <address> <port> [<size>]\n");
+        printf ("       kiro-test-seqlock clone <address> <port> [<seconds, 0 for no limit>]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve")) {
+        gulong size = argc > 4 ? strtoul (argv[4], NULL, 10) : 1024 * 1024;
+        return run_serve (argv[2], argv[3], MAX (size, 2 * sizeof (uint64_t)));
+    }
+
+    guint seconds = argc > 4 ? strtoul (argv[4], NULL, 10) : 10;
+    return run_clone (argv[2], argv[3], seconds);
+}
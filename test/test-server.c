@@ -185,6 +185,7 @@ main (void)
         sleep (1);
         buffer = kiro_trb_dma_push (rb);
         print_current_frame (buffer, frame, 512, 512, rand);
+        kiro_trb_dma_commit (rb, buffer);
         frame++;
         if (frame % 1000 == 0)
             kiro_server_realloc (server, kiro_trb_get_raw_buffer (rb), kiro_trb_get_raw_size (rb));
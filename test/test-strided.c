@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-server.h"
+#include "kiro-client.h"
+#include "kiro-trb.h"
+
+
+// Every element of the ring buffer starts with a small summary of the frame
+// it holds
+struct summary {
+    uint64_t    frame;
+    uint64_t    check;      // ~frame, to spot summaries that were read while being written
+};
+
+
+static int
+run_serve (const char *address, const char *port, gulong element_size, gulong elements)
+{
+    KiroServer *server = kiro_server_new ();
+    KiroTrb *rb = kiro_trb_new ();
+
+    if (0 > kiro_trb_reshape (rb, element_size, elements)
+        || 0 > kiro_server_start (server, address, port, kiro_trb_get_raw_buffer (rb), kiro_trb_get_raw_size (rb))) {
+        kiro_trb_free (rb);
+        kiro_server_free (server);
+        return -1;
+    }
+
+    for (uint64_t frame = 1; ; frame++) {
+        struct summary *summary = kiro_trb_dma_push (rb);
+        memset ((char *)summary + sizeof (struct summary), frame & 0xff, element_size - sizeof (struct summary));
+        summary->frame = frame;
+        summary->check = ~frame;
+        kiro_trb_dma_commit (rb, summary);
+        g_usleep (G_USEC_PER_SEC / 100);
+    }
+
+    kiro_trb_free (rb);
+    kiro_server_free (server);
+    return 0;
+}
+
+
+static int
+run_clone (const char *address, const char *port, guint rounds)
+{
+    KiroClient *client = kiro_client_new ();
+    if (0 > kiro_client_connect (client, address, port)
+        || 0 > kiro_client_sync_partial (client, 0, sizeof (struct KiroTrbInfo), 0)) {
+        kiro_client_free (client);
+        return -1;
+    }
+
+    struct KiroTrbInfo *info = (struct KiroTrbInfo *)kiro_client_get_memory (client);
+    gulong element_size = info->element_size;
+    gulong elements = (info->buffer_size_bytes - sizeof (struct KiroTrbInfo)) / element_size;
+    struct summary *summaries = g_new (struct summary, elements);
+
+    printf ("Ring buffer with %lu elements of %lu bytes\n", elements, element_size);
+
+    // Only the element that is being written while it is read can be torn
+    uint64_t first = 0, last = 0;
+    gulong too_torn = 0;
+
+    for (guint round = 0; round < rounds || rounds == 0; round++) {
+        GTimer *timer = g_timer_new ();
+        if (0 > kiro_client_sync_strided (client, sizeof (struct KiroTrbInfo), element_size,
+                                          sizeof (struct summary), elements, summaries))
+            goto fail;
+        double strided = g_timer_elapsed (timer, NULL);
+
+        g_timer_start (timer);
+        if (0 > kiro_client_sync (client))
+            goto fail;
+        double full = g_timer_elapsed (timer, NULL);
+        g_timer_destroy (timer);
+
+        uint64_t newest = 0;
+        gulong filled = 0, torn = 0;
+        for (gulong i = 0; i < elements; i++) {
+            if (summaries[i].frame == 0)
+                continue;
+            if (summaries[i].check != ~summaries[i].frame) {
+                torn++;
+                continue;
+            }
+            filled++;
+            newest = MAX (newest, summaries[i].frame);
+        }
+
+        printf ("Summaries: %8.1fus (%lu bytes)  Full sync: %8.1fus (%lu bytes)  Newest frame: %lu  Filled: %lu  Torn: %lu\n",
+                strided * 1e6, elements * sizeof (struct summary), full * 1e6,
+                kiro_client_get_memory_size (client), newest, filled, torn);
+
+        if (round == 0)
+            first = newest;
+        last = newest;
+        too_torn += (torn > 2);
+        g_usleep (G_USEC_PER_SEC);
+    }
+
+    g_free (summaries);
+    kiro_client_free (client);
+
+    if (too_torn) {
+        printf ("FAILED: %lu reads of the summaries returned more torn ones than the producer can explain\n", too_torn);
+        return 1;
+    }
+
+    if (rounds > 1 && last <= first) {
+        printf ("FAILED: The newest frame did not advance\n");
+        return 1;
+    }
+
+    printf ("PASSED: Summaries were read intact\n");
+    return 0;
+
+fail:
+    printf ("Sync failed\n");
+    g_free (summaries);
+    kiro_client_free (client);
+    return -1;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 4 || (strcmp (argv[1], "serve") && strcmp (argv[1], "clone"))) {
+        printf ("Usage: kiro-test-strided serve <address> <port> [<element size in kByte> [<elements>]]\n");
+        printf ("       kiro-test-strided clone <address> <port> [<rounds, 0 for no limit>]\n");
+        return -1;
+    }
+
+    if (!strcmp (argv[1], "serve")) {
+        gulong size = argc > 4 ? strtoul (argv[4], NULL, 10) : 1024;
+        gulong elements = argc > 5 ? strtoul (argv[5], NULL, 10) : 1000;
+        return run_serve (argv[2], argv[3], MAX (size, 1) * 1024, MAX (elements, 1));
+    }
+
+    guint rounds = argc > 4 ? strtoul (argv[4], NULL, 10) : 10;
+    return run_clone (argv[2], argv[3], rounds);
+}
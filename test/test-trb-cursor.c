@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-trb.h"
+#include <assert.h>
+
+#define ELEMENT_COUNT   8
+
+
+static void
+push_sequence (KiroTrb *trb, uint64_t count)
+{
+    // Every element carries its sequence number
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t seq = kiro_trb_get_offset (trb);
+        kiro_trb_push (trb, &seq);
+    }
+}
+
+
+static uint64_t
+check_spans (struct KiroTrbSpan *spans, guint num_spans, uint64_t first)
+{
+    // Spans have to be contiguous in ascending sequence order, starting at
+    // @first, and every element has to hold its own sequence number
+    uint64_t next = first;
+
+    for (guint i = 0; i < num_spans; i++) {
+        assert (spans[i].first == next);
+        assert (spans[i].count > 0);
+        assert (spans[i].meta == NULL);
+
+        uint64_t *elements = (uint64_t *)spans[i].data;
+        for (uint64_t j = 0; j < spans[i].count; j++)
+            assert (elements[j] == next + j);
+
+        next += spans[i].count;
+    }
+
+    return next - first;
+}
+
+
+int
+main (void)
+{
+    KiroTrb *trb = kiro_trb_new ();
+    if (0 > kiro_trb_reshape (trb, sizeof (uint64_t), ELEMENT_COUNT)) {
+        printf ("Failed to allocate the ring buffer\n");
+        return -1;
+    }
+
+    struct KiroTrbCursor cursor;
+    struct KiroTrbSpan spans[2];
+    uint64_t lost = 0;
+    guint num_spans;
+
+    // A new cursor only sees elements that are pushed after its creation
+    push_sequence (trb, 3);
+    kiro_trb_cursor_init (trb, &cursor);
+    assert (cursor.next == 3);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (num_spans == 0);
+    assert (lost == 0);
+
+    // Elements that do not cross the end of the memory come in one span
+    push_sequence (trb, 4);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (num_spans == 1);
+    assert (lost == 0);
+    assert (check_spans (spans, num_spans, 3) == 4);
+    assert (cursor.next == 7);
+
+    // Reading again without new pushes advances nothing
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (num_spans == 0);
+    assert (cursor.next == 7);
+
+    // Slots 7 to 1 wrap around the end of the memory and need two spans
+    push_sequence (trb, 3);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (num_spans == 2);
+    assert (lost == 0);
+    assert (spans[0].count == 1);
+    assert (spans[1].count == 2);
+    assert (check_spans (spans, num_spans, 7) == 3);
+    assert (cursor.next == 10);
+
+    // Exactly one full ring is still readable without loss
+    push_sequence (trb, ELEMENT_COUNT);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (lost == 0);
+    assert (check_spans (spans, num_spans, 10) == ELEMENT_COUNT);
+    assert (cursor.next == 10 + ELEMENT_COUNT);
+
+    // A consumer that fell behind by more than one ring gets told how many
+    // elements it missed and continues with the oldest one still held
+    push_sequence (trb, ELEMENT_COUNT + 5);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (lost == 5);
+    assert (check_spans (spans, num_spans, 10 + ELEMENT_COUNT + 5) == ELEMENT_COUNT);
+    assert (cursor.next == kiro_trb_get_offset (trb));
+
+    // @lost may be omitted
+    push_sequence (trb, 2 * ELEMENT_COUNT);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, NULL);
+    assert (check_spans (spans, num_spans, kiro_trb_get_offset (trb) - ELEMENT_COUNT) == ELEMENT_COUNT);
+
+    // A cursor that is ahead of a flushed buffer starts over at its offset
+    kiro_trb_flush (trb);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (num_spans == 0);
+    assert (lost == 0);
+    assert (cursor.next == kiro_trb_get_offset (trb));
+
+    push_sequence (trb, 2);
+    num_spans = kiro_trb_cursor_read (trb, &cursor, spans, &lost);
+    assert (num_spans == 1);
+    assert (check_spans (spans, num_spans, 0) == 2);
+
+    kiro_trb_free (trb);
+    printf ("Cursor test passed\n");
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-trb.h"
+#include <assert.h>
+
+#define ELEMENT_SIZE    (1024 * 1024)
+#define ELEMENT_COUNT   256
+#define PUSHES          1000
+
+
+int
+main (int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf ("Not enough aruments. Usage: kiro-test-trb-file <path>\n");
+        return -1;
+    }
+
+    KiroTrb *trb = kiro_trb_new ();
+    GTimer *timer = g_timer_new ();
+
+    if (0 > kiro_trb_open_file (trb, argv[1], ELEMENT_SIZE, ELEMENT_COUNT)) {
+        kiro_trb_free (trb);
+        return -1;
+    }
+
+    double elapsed = g_timer_elapsed (timer, NULL);
+
+    // Re-adopting the own memory must keep the file mapping, which can't be
+    // resized
+    kiro_trb_adopt (trb, kiro_trb_get_raw_buffer (trb));
+    assert (0 > kiro_trb_resize (trb, 2, NULL));
+
+    uint64_t start = kiro_trb_get_offset (trb);
+    printf ("Opened '%s' in %.3fms, resuming at offset %" G_GUINT64_FORMAT "\n", argv[1], elapsed * 1000, start);
+
+    // Each element is tagged with its own sequence number, so the content can
+    // be checked after the next restart
+    char *element = malloc (ELEMENT_SIZE);
+    if (start > 0) {
+        uint64_t *last = (uint64_t *)kiro_trb_get_element (trb, -1);
+        assert (*last == start - 1);
+    }
+
+    g_timer_reset (timer);
+    for (uint64_t i = start; i < start + PUSHES; i++) {
+        *(uint64_t *)element = i;
+        kiro_trb_push (trb, element);
+    }
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    printf ("Pushed %i elements at %.2fGbyte/s, offset is now %" G_GUINT64_FORMAT "\n", PUSHES,
+            ((double)ELEMENT_SIZE * PUSHES / elapsed) / (1024 * 1024 * 1024), kiro_trb_get_offset (trb));
+
+    free (element);
+    g_timer_destroy (timer);
+    kiro_trb_free (trb);
+    return 0;
+}
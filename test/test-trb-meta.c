@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-trb.h"
+#include <assert.h>
+
+#define ELEMENT_SIZE    64
+#define ELEMENT_COUNT   4
+
+
+static void
+check_element (KiroTrb *trb, glong index, uint64_t sequence, uint64_t size, uint64_t tag)
+{
+    struct KiroTrbMeta *meta = kiro_trb_get_meta (trb, index);
+    uint64_t *element = (uint64_t *)kiro_trb_get_element (trb, index);
+
+    assert (meta != NULL);
+    assert (meta->sequence == sequence);
+    assert (meta->size == size);
+    assert (meta->tag == tag);
+    assert (*element == sequence);
+}
+
+
+static void
+test_push (void)
+{
+    KiroTrb *trb = kiro_trb_new ();
+    assert (0 == kiro_trb_reshape_with_meta (trb, ELEMENT_SIZE, ELEMENT_COUNT));
+
+    // Records have to follow their elements through several laps
+    for (uint64_t seq = 0; seq < 3 * ELEMENT_COUNT; seq++) {
+        uint64_t element[ELEMENT_SIZE / sizeof (uint64_t)] = { seq };
+        assert (0 == kiro_trb_push_with_meta (trb, element, sizeof (uint64_t), seq * 10));
+        check_element (trb, -1, seq, sizeof (uint64_t), seq * 10);
+    }
+
+    for (glong i = 1; i <= ELEMENT_COUNT; i++) {
+        uint64_t seq = 3 * ELEMENT_COUNT - i;
+        check_element (trb, -i, seq, sizeof (uint64_t), seq * 10);
+    }
+
+    // Without a metadata column there is nothing to report
+    kiro_trb_reshape (trb, ELEMENT_SIZE, ELEMENT_COUNT);
+    assert (kiro_trb_get_meta (trb, 0) == NULL);
+
+    kiro_trb_free (trb);
+}
+
+
+static void
+test_dma_commit (gboolean multi_producer)
+{
+    KiroTrb *trb = kiro_trb_new ();
+    assert (0 == kiro_trb_reshape_with_meta (trb, ELEMENT_SIZE, ELEMENT_COUNT));
+
+    if (multi_producer)
+        assert (0 == kiro_trb_enable_multi_producer (trb));
+
+    for (uint64_t seq = 0; seq < 2 * ELEMENT_COUNT + 1; seq++) {
+        uint64_t *element = (uint64_t *)kiro_trb_dma_push (trb);
+        assert (element != NULL);
+
+        // In multi-producer mode the element is not published before it is
+        // committed, so it is still found at index 0
+        glong index = multi_producer ? 0 : -1;
+        assert (kiro_trb_get_offset (trb) == (multi_producer ? seq : seq + 1));
+
+        // Until the element is committed, its record must not claim it is
+        // complete. Neither as the new element, nor as the one it replaces.
+        struct KiroTrbMeta *meta = kiro_trb_get_meta (trb, index);
+        assert (meta->sequence != seq);
+        if (seq >= ELEMENT_COUNT)
+            assert (meta->sequence != seq - ELEMENT_COUNT);
+
+        *element = seq;
+        meta->tag = seq + 1;
+        assert (0 == kiro_trb_dma_commit (trb, element));
+        assert (kiro_trb_get_offset (trb) == seq + 1);
+        check_element (trb, -1, seq, ELEMENT_SIZE, seq + 1);
+    }
+
+    // Pointers that are not elements of the buffer are rejected
+    uint64_t outside;
+    assert (0 > kiro_trb_dma_commit (trb, &outside));
+
+    kiro_trb_free (trb);
+}
+
+
+static void
+test_version (void)
+{
+    KiroTrb *trb = kiro_trb_new ();
+    assert (0 == kiro_trb_reshape_with_meta (trb, ELEMENT_SIZE, ELEMENT_COUNT));
+
+    struct KiroTrbInfo *header = (struct KiroTrbInfo *)kiro_trb_get_raw_buffer (trb);
+    assert (header->version == KIRO_TRB_VERSION);
+
+    // Memory of a different layout must neither be cloned nor adopted
+    size_t size = kiro_trb_get_raw_size (trb);
+    void *foreign = g_malloc (size);
+    memcpy (foreign, header, size);
+    ((struct KiroTrbInfo *)foreign)->version = KIRO_TRB_VERSION + 1;
+
+    KiroTrb *other = kiro_trb_new ();
+    assert (0 > kiro_trb_clone (other, foreign));
+    assert (0 == kiro_trb_is_setup (other));
+
+    kiro_trb_adopt (other, foreign);
+    assert (0 == kiro_trb_is_setup (other));
+
+    kiro_trb_free (other);
+    kiro_trb_free (trb);
+}
+
+
+int
+main (void)
+{
+    test_push ();
+    test_dma_commit (FALSE);
+    test_dma_commit (TRUE);
+    test_version ();
+
+    printf ("Metadata test passed\n");
+    return 0;
+}
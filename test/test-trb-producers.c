@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-trb.h"
+#include <assert.h>
+
+#define ELEMENT_SIZE    4096
+#define ELEMENT_COUNT   1024
+#define TOTAL_PUSHES    (1024 * 1024)   // Default number of pushes per run
+
+
+struct producer {
+    KiroTrb     *trb;
+    GMutex      *lock;      // Only used for the mutex based reference
+    guint64     pushes;
+    char        pattern;    // Fill byte that identifies the producer
+};
+
+
+/*
+ * Every element starts with its sequence number (if the producer knows it)
+ * and is filled with the pattern of its producer. A torn element mixes the
+ * patterns of two producers.
+ */
+static void
+fill_element (char *element, uint64_t seq, char pattern)
+{
+    memset (element, pattern, ELEMENT_SIZE);
+    memcpy (element, &seq, sizeof (seq));
+}
+
+
+static gpointer
+reserve_commit_producer (gpointer data)
+{
+    struct producer *p = (struct producer *)data;
+
+    for (guint64 i = 0; i < p->pushes; i++) {
+        uint64_t seq;
+        void *slot = kiro_trb_reserve (p->trb, &seq);
+        fill_element (slot, seq, p->pattern);
+        kiro_trb_commit (p->trb, seq);
+    }
+
+    return NULL;
+}
+
+
+static gpointer
+dma_producer (gpointer data)
+{
+    struct producer *p = (struct producer *)data;
+
+    for (guint64 i = 0; i < p->pushes; i++) {
+        void *slot = kiro_trb_dma_push (p->trb);
+        // The sequence number of a dma push is not known to the producer
+        fill_element (slot, G_MAXUINT64, p->pattern);
+        kiro_trb_dma_commit (p->trb, slot);
+    }
+
+    return NULL;
+}
+
+
+static gpointer
+mutex_producer (gpointer data)
+{
+    struct producer *p = (struct producer *)data;
+    char element[ELEMENT_SIZE];
+
+    for (guint64 i = 0; i < p->pushes; i++) {
+        g_mutex_lock (p->lock);
+        fill_element (element, kiro_trb_get_offset (p->trb), p->pattern);
+        kiro_trb_push (p->trb, element);
+        g_mutex_unlock (p->lock);
+    }
+
+    return NULL;
+}
+
+
+static void
+check_contents (KiroTrb *trb, int num_threads)
+{
+    uint64_t offset = kiro_trb_get_offset (trb);
+    uint64_t held = MIN (offset, kiro_trb_get_max_elements (trb));
+
+    for (uint64_t i = 1; i <= held; i++) {
+        char *element = (char *)kiro_trb_get_element (trb, -(glong)i);
+        uint64_t seq;
+        memcpy (&seq, element, sizeof (seq));
+        assert (seq == offset - i || seq == G_MAXUINT64);
+
+        char pattern = element[sizeof (seq)];
+        assert (pattern >= 1 && pattern <= num_threads);
+        for (int j = sizeof (seq); j < ELEMENT_SIZE; j++)
+            assert (element[j] == pattern);
+    }
+}
+
+
+static double
+run (GThreadFunc func, int num_threads, gboolean multi_producer, guint64 total)
+{
+    KiroTrb *trb = kiro_trb_new ();
+    kiro_trb_reshape (trb, ELEMENT_SIZE, ELEMENT_COUNT);
+
+    if (multi_producer)
+        kiro_trb_enable_multi_producer (trb);
+
+    GMutex lock;
+    g_mutex_init (&lock);
+
+    struct producer *producers = g_new0 (struct producer, num_threads);
+    GThread **threads = g_new0 (GThread *, num_threads);
+
+    GTimer *timer = g_timer_new ();
+
+    for (int i = 0; i < num_threads; i++) {
+        producers[i].trb = trb;
+        producers[i].lock = &lock;
+        producers[i].pushes = total / num_threads;
+        producers[i].pattern = (char)(i + 1);
+        threads[i] = g_thread_new ("producer", func, &producers[i]);
+    }
+
+    for (int i = 0; i < num_threads; i++)
+        g_thread_join (threads[i]);
+
+    double elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    // Every pushed element has to be visible to readers once all producers are done
+    assert (kiro_trb_get_offset (trb) == (uint64_t)(total / num_threads) * num_threads);
+    check_contents (trb, num_threads);
+
+    g_free (threads);
+    g_free (producers);
+    g_mutex_clear (&lock);
+    kiro_trb_free (trb);
+
+    return ((total / num_threads) * num_threads) / elapsed;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    // The default is a benchmark. A small number of pushes (that still wraps
+    // the buffer) is enough to check correctness.
+    guint64 total = argc > 1 ? g_ascii_strtoull (argv[1], NULL, 10) : TOTAL_PUSHES;
+    total = MAX (total, 16);
+
+    printf ("Threads  reserve/commit [Mpush/s]  dma push/commit [Mpush/s]  mutex + push [Mpush/s]\n");
+
+    for (int threads = 1; threads <= 16; threads *= 2) {
+        double mp = run (reserve_commit_producer, threads, TRUE, total);
+        double dma = run (dma_producer, threads, TRUE, total);
+        double mutex = run (mutex_producer, threads, FALSE, total);
+        printf ("%7i  %24.2f  %25.2f  %22.2f\n", threads, mp / 1e6, dma / 1e6, mutex / 1e6);
+    }
+
+    return 0;
+}
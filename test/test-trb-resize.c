@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kiro-trb.h"
+#include <assert.h>
+
+#define ELEMENT_SIZE    (1024 * 1024)
+
+
+static void
+check_sequence (KiroTrb *trb, uint64_t held)
+{
+    // Every element carries its sequence number in its first bytes
+    uint64_t offset = kiro_trb_get_offset (trb);
+
+    for (uint64_t i = 1; i <= held; i++) {
+        uint64_t *element = (uint64_t *)kiro_trb_get_element (trb, -(glong)i);
+        assert (*element == offset - i);
+    }
+}
+
+
+static void
+timed_resize (KiroTrb *trb, uint64_t count)
+{
+    uint64_t old_count = kiro_trb_get_max_elements (trb);
+    uint64_t offset = kiro_trb_get_offset (trb);
+    GTimer *timer = g_timer_new ();
+
+    if (0 > kiro_trb_resize (trb, count, NULL)) {
+        printf ("Failed to resize to %" G_GUINT64_FORMAT " elements\n", count);
+        exit (-1);
+    }
+
+    double elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    uint64_t moved = MIN (offset, MIN (old_count, count));
+    printf ("Resize %5" G_GUINT64_FORMAT " -> %5" G_GUINT64_FORMAT " elements: %8.2fms (%.2fGbyte/s migrated)\n", old_count, count,
+            elapsed * 1000, ((double)moved * ELEMENT_SIZE / elapsed) / (1024 * 1024 * 1024));
+
+    assert (kiro_trb_get_offset (trb) == offset);
+    check_sequence (trb, moved);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    uint64_t size_mb = 1024;
+    if (argc > 1)
+        size_mb = strtoull (argv[1], NULL, 10);
+
+    uint64_t count = (size_mb * 1024 * 1024) / ELEMENT_SIZE;
+    printf ("Using a ring of %" G_GUINT64_FORMAT " elements with %i bytes each\n", count, ELEMENT_SIZE);
+
+    KiroTrb *trb = kiro_trb_new ();
+    if (0 > kiro_trb_reshape (trb, ELEMENT_SIZE, count)) {
+        printf ("Failed to allocate the ring buffer\n");
+        return -1;
+    }
+
+    // Fill the buffer one and a half times, so the oldest element is in the
+    // middle of the ring
+    for (uint64_t i = 0; i < count + (count / 2); i++) {
+        uint64_t *element = (uint64_t *)kiro_trb_dma_push (trb);
+        memset (element, 0, ELEMENT_SIZE);
+        *element = i;
+        kiro_trb_dma_commit (trb, element);
+    }
+
+    timed_resize (trb, count * 2);
+    timed_resize (trb, count);
+    timed_resize (trb, count / 2);
+
+    kiro_trb_free (trb);
+    return 0;
+}